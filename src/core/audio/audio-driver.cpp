@@ -0,0 +1,84 @@
+#include "audio-driver.hpp"
+
+#include <algorithm>
+#include <thread>
+#include <plog/Log.h>
+
+#include "core/globals.hpp"
+
+namespace top1::audio {
+
+  /// Modules that may run at the same time
+  constexpr int ParallelModules = 3;
+
+  void AudioDriver::startWorkers(int realtimePriority) {
+    int cores = std::thread::hardware_concurrency();
+    int n = std::clamp(cores - 1, 0, ParallelModules - 1);
+    workers = std::make_unique<WorkerPool>(n, true);
+    if (realtimePriority >= 0) {
+      workers->setRealtime(realtimePriority);
+    }
+    updateSpinTime();
+    Globals::events.bufferSizeChanged.add([this] (uint) { updateSpinTime(); });
+    Globals::events.samplerateChanged.add([this] (uint) { updateSpinTime(); });
+    LOGI << "Processing with " << n << " worker threads";
+  }
+
+  void AudioDriver::updateSpinTime() {
+    if (!workers) return;
+    std::chrono::duration<double> period (bufferSize / double(Globals::samplerate));
+    workers->setSpinTime(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(period / 4));
+  }
+
+  void AudioDriver::processBlock(ProcessData& data) {
+    using Node = DspStats::Node;
+    auto start = DspStats::Clock::now();
+    stats.beginPeriod(start);
+
+    data.audio.proc = {procBuf.data(), data.nframes};
+    data.midi = {midiBuf.begin(), midiBuf.end()};
+
+    ProcessData synthData = data;
+    synthData.audio.proc = {synthBuf.data(), data.nframes};
+    ProcessData drumsData = data;
+    drumsData.audio.proc = {drumsBuf.data(), data.nframes};
+    std::fill(synthData.audio.proc.begin(), synthData.audio.proc.end(), 0);
+    std::fill(drumsData.audio.proc.begin(), drumsData.audio.proc.end(), 0);
+
+    auto sources = [&] (int module) {
+      switch (module) {
+      case 0:
+        stats.time(Node::Synth, [&] { Globals::synth.process(synthData); });
+        break;
+      case 1:
+        stats.time(Node::Drums, [&] { Globals::drums.process(drumsData); });
+        break;
+      case 2:
+        stats.time(Node::TapeIn, [&] { Globals::tapedeck.preProcess(data); });
+        break;
+      }
+    };
+    if (workers) {
+      workers->run(ParallelModules, sources);
+    } else {
+      for (int i = 0; i < ParallelModules; i++) sources(i);
+    }
+
+    for (int i = 0; i < data.nframes; i++) {
+      data.audio.proc[i] = synthData.audio.proc[i] + drumsData.audio.proc[i];
+    }
+
+    stats.time(Node::Effect, [&] { Globals::effect.process(data); });
+    stats.time(Node::TapeOut, [&] { Globals::tapedeck.postProcess(data); });
+    stats.time(Node::Mixer, [&] { Globals::mixer.process(data); });
+    stats.time(Node::Metronome, [&] { Globals::metronome.process(data); });
+
+    midiBuf.clear();
+
+    std::chrono::duration<double> period (data.nframes / double(Globals::samplerate));
+    stats.endPeriod(DspStats::Clock::now() - start,
+                    std::chrono::duration_cast<DspStats::Duration>(period));
+  }
+
+} // top1::audio
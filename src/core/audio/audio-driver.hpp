@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include "util/typedefs.hpp"
+#include "util/worker-pool.hpp"
+#include "core/audio/processor.hpp"
+#include "core/audio/dsp-stats.hpp"
+
+namespace top1::audio {
+
+  /**
+   * A backend that drives the audio processing.
+   *
+   * The backend owns the audio thread. It gets the input and the midi events
+   * of each period from somewhere, and calls <processBlock> to run all
+   * modules on them. See <JackAudio> and <OfflineAudio>.
+   */
+  class AudioDriver {
+  public:
+
+    uint bufferSize = 0;
+
+    /// Load and timings of <processBlock>, and the xruns of the backend
+    DspStats stats;
+
+    virtual ~AudioDriver() = default;
+
+    /// Connect to the audio system, and set the samplerate and buffer size.
+    /// Calls `Globals::exit()` if that fails.
+    virtual void init() = 0;
+    /// Start processing audio, after all modules are initialized.
+    /// Not called if <init> failed
+    virtual void startProcess() = 0;
+    virtual void exit() = 0;
+
+  protected:
+
+    std::atomic_bool isProcessing {false};
+
+    RTBuffer<float> procBuf;
+
+    /// Output buffers of the modules that run in parallel, summed into
+    /// `procBuf` when they are done
+    RTBuffer<float> synthBuf;
+    RTBuffer<float> drumsBuf;
+
+    /// Runs the independent modules of a period in parallel. Without it,
+    /// everything runs on the audio thread
+    std::unique_ptr<WorkerPool> workers;
+
+    /// The midi events of the current period. Fill it before
+    /// <processBlock>, which clears it
+    midi::MidiEventBuffer midiBuf;
+
+    /**
+     * Start the workers for <processBlock>, one less than there are cores,
+     * but no more than there are independent modules.
+     *
+     * Idle workers spin for a quarter of a period, and then sleep until the
+     * next period, so they leave the cpus to other threads in between.
+     *
+     * @realtimePriority The priority of the audio thread, if it is realtime,
+     *                   or a negative number.
+     */
+    void startWorkers(int realtimePriority = -1);
+    /// Set the spin time of the workers from the period length
+    void updateSpinTime();
+
+    /**
+     * Run all modules on one period.
+     *
+     * The modules form a graph: the tapedeck input, the synth and the drums
+     * only depend on the input and the midi, so they run in parallel, the
+     * synth and the drums into their own buffers. These are summed into
+     * `proc`, and from there the effect, the tapedeck output, the mixer and
+     * the metronome run in order.
+     *
+     * Sets `data.audio.proc` and `data.midi`, and records the time of each
+     * module and of the whole period in <stats>. Call this from the audio
+     * thread only.
+     */
+    void processBlock(ProcessData& data);
+  };
+
+} // top1::audio
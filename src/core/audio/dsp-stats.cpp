@@ -0,0 +1,76 @@
+#include "dsp-stats.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+namespace top1::audio {
+
+  void DspStats::beginPeriod(Clock::time_point start) {
+    std::int64_t now = start.time_since_epoch().count();
+    std::int64_t last = lastStart.exchange(now, std::memory_order_relaxed);
+    if (last != 0) {
+      atomicMax(worstInterval, now - last);
+    }
+  }
+
+  void DspStats::endPeriod(Duration work, Duration period) {
+    std::int64_t load = work.count() * LoadScale / std::max<std::int64_t>(period.count(), 1);
+    lastLoad.store(load, std::memory_order_relaxed);
+    atomicMax(maxLoad, load);
+    atomicMax(worstWork, work.count());
+    totalWork.fetch_add(work.count(), std::memory_order_relaxed);
+    totalPeriod.fetch_add(period.count(), std::memory_order_relaxed);
+    callbacks.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  DspStats::Snapshot DspStats::snapshot() const {
+    constexpr auto relaxed = std::memory_order_relaxed;
+    Snapshot s;
+    s.callbacks = callbacks.load(relaxed);
+    s.xruns = xruns.load(relaxed);
+    s.load = lastLoad.load(relaxed) / LoadScale;
+    s.maxLoad = maxLoad.load(relaxed) / LoadScale;
+    std::int64_t period = totalPeriod.load(relaxed);
+    s.avgLoad = period > 0 ? totalWork.load(relaxed) / double(period) : 0;
+    s.worstWork = Duration(worstWork.load(relaxed));
+    s.worstInterval = Duration(worstInterval.load(relaxed));
+    s.latency = latency.load(relaxed);
+    for (int i = 0; i < NodeCount; i++) {
+      s.nodeTime[i] = Duration(nodeTime[i].load(relaxed));
+      s.nodeWorst[i] = Duration(nodeWorst[i].load(relaxed));
+    }
+    return s;
+  }
+
+  static double numSecs(DspStats::Duration d) {
+    return std::chrono::duration<double>(d).count();
+  }
+
+  nlohmann::json DspStats::Snapshot::jsonSerialize() const {
+    auto ret = nlohmann::json::object();
+    ret["callbacks"] = callbacks;
+    ret["xruns"] = xruns;
+    ret["load"] = load;
+    ret["max load"] = maxLoad;
+    ret["average load"] = avgLoad;
+    ret["worst callback"] = numSecs(worstWork);
+    ret["worst interval"] = numSecs(worstInterval);
+    ret["latency frames"] = latency;
+    auto nodes = nlohmann::json::object();
+    for (int i = 0; i < NodeCount; i++) {
+      nodes[nodeNames[i]] = {
+        {"last", numSecs(nodeTime[i])},
+        {"worst", numSecs(nodeWorst[i])}
+      };
+    }
+    ret["modules"] = nodes;
+    return ret;
+  }
+
+  void DspStats::writeToFile(const fs::path& path) const {
+    std::ofstream stream(path, std::ios::trunc);
+    stream << std::setw(2) << snapshot().jsonSerialize() << std::endl;
+  }
+
+} // top1::audio
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <utility>
+
+#include <json.hpp>
+
+#include "filesystem.hpp"
+
+namespace top1::audio {
+
+  /**
+   * Load and timing counters of the audio thread.
+   *
+   * The audio thread updates these with relaxed atomics only, and any other
+   * thread may take a <Snapshot> at any time. The snapshot is not taken
+   * atomically as a whole, so counters from the period in progress may be
+   * off by one.
+   */
+  class DspStats {
+  public:
+
+    using Clock = std::chrono::steady_clock;
+    using Duration = std::chrono::nanoseconds;
+
+    /// The timed nodes of the processing graph
+    enum class Node {
+      TapeIn,
+      Synth,
+      Drums,
+      Effect,
+      TapeOut,
+      Mixer,
+      Metronome,
+    };
+
+    static constexpr int NodeCount = 7;
+
+    static constexpr std::array<const char*, NodeCount> nodeNames = {
+      "Tapedeck in", "Synth", "Drums", "Effect", "Tapedeck out", "Mixer",
+      "Metronome"
+    };
+
+    struct Snapshot {
+      std::int64_t callbacks = 0;
+      std::int64_t xruns = 0;
+
+      /// Work time / period time of the last callback
+      float load = 0;
+      /// The highest load of a single callback
+      float maxLoad = 0;
+      /// Total work time / total period time
+      float avgLoad = 0;
+
+      /// The longest time a callback took
+      Duration worstWork {0};
+      /// The longest time between the starts of two callbacks
+      Duration worstInterval {0};
+      /// The output latency reported by the audio system, in frames
+      int latency = 0;
+
+      std::array<Duration, NodeCount> nodeTime {};
+      std::array<Duration, NodeCount> nodeWorst {};
+
+      nlohmann::json jsonSerialize() const;
+    };
+
+    /* Audio thread */
+
+    /// Call at the start of each callback.
+    void beginPeriod(Clock::time_point start);
+
+    /// Call at the end of each callback.
+    ///
+    /// @work The time since the start of the callback
+    /// @period The time the period lasts at the current samplerate
+    void endPeriod(Duration work, Duration period);
+
+    /// Run `f` and record its time as the time of `node`
+    template<typename F>
+    void time(Node node, F&& f) {
+      auto start = Clock::now();
+      std::forward<F>(f)();
+      Duration d = Clock::now() - start;
+      int i = static_cast<int>(node);
+      nodeTime[i].store(d.count(), std::memory_order_relaxed);
+      atomicMax(nodeWorst[i], d.count());
+    }
+
+    /* Any thread */
+
+    /// Count an xrun. Safe to call from the audio system's callbacks
+    void xrun() {
+      xruns.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void setLatency(int frames) {
+      latency.store(frames, std::memory_order_relaxed);
+    }
+
+    Snapshot snapshot() const;
+
+    /// Write a snapshot to a json file
+    void writeToFile(const fs::path& path) const;
+
+  private:
+
+    using Counter = std::atomic<std::int64_t>;
+
+    static void atomicMax(Counter& c, std::int64_t v) {
+      auto prev = c.load(std::memory_order_relaxed);
+      while (prev < v
+             && !c.compare_exchange_weak(prev, v, std::memory_order_relaxed));
+    }
+
+    /// Fixed point factor of the stored loads
+    static constexpr double LoadScale = 1e6;
+
+    Counter callbacks {0};
+    Counter xruns {0};
+    Counter lastLoad {0};
+    Counter maxLoad {0};
+    Counter totalWork {0};
+    Counter totalPeriod {0};
+    Counter worstWork {0};
+    Counter worstInterval {0};
+    Counter lastStart {0};
+    std::atomic_int latency {0};
+    std::array<Counter, NodeCount> nodeTime {};
+    std::array<Counter, NodeCount> nodeWorst {};
+  };
+
+} // top1::audio
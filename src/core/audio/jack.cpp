@@ -11,7 +11,6 @@
 
 #include "core/globals.hpp"
 #include "util/event.hpp"
-#include "util/timer.hpp"
 
 namespace top1::audio {
 
@@ -53,6 +52,12 @@ namespace top1::audio {
         return 0;
       }, this);
 
+    jack_set_xrun_callback(client,
+      [](void *arg) {
+        ((JackAudio*)arg)->stats.xrun();
+        return 0;
+      }, this);
+
     jack_set_error_function(jackError);
     jack_set_info_function(jackLogInfo);
 
@@ -75,6 +80,9 @@ namespace top1::audio {
   }
 
   void JackAudio::startProcess() {
+    startWorkers(jack_is_realtime(client)
+                 ? jack_client_real_time_priority(client) : -1);
+    updateLatency();
     isProcessing = true;
   }
 
@@ -94,6 +102,15 @@ namespace top1::audio {
     LOGI << fmt::format("Jack changed the buffer size to {}", buffsize);
     bufferSize = buffsize;
     Globals::events.bufferSizeChanged.runAll(buffsize);
+    updateLatency();
+  }
+
+  void JackAudio::updateLatency() {
+    // The buffer size is set on activation, before the ports exist
+    if (ports.outL == nullptr) return;
+    jack_latency_range_t range;
+    jack_port_get_latency_range(ports.outL, JackPlaybackLatency, &range);
+    stats.setLatency(range.max + bufferSize);
   }
 
   void JackAudio::setupPorts() {
@@ -194,19 +211,13 @@ namespace top1::audio {
   void JackAudio::process(uint nframes) {
     if (!(isProcessing && Globals::running())) return;
 
-    static auto& timer = timer::dispatcher.timers["Audio Frame time"];
-    if (timer.running) timer.stopTimer();
-    timer.startTimer();
-
     if (nframes > bufferSize) {
       LOGE << "Jack requested more frames than expected";
       return;
     }
 
-    // Clear the old data
     ProcessData processData;
     processData.nframes = nframes;
-    procBuf.clear();
 
     float* outLData = (float*) jack_port_get_buffer(ports.outL, nframes);
     float* outRData = (float*) jack_port_get_buffer(ports.outR, nframes);
@@ -215,52 +226,18 @@ namespace top1::audio {
     processData.audio.outL  = {outLData, nframes};
     processData.audio.outR  = {outRData, nframes};
     processData.audio.input = {inData, nframes};
-    processData.audio.proc  = {procBuf.data(), nframes};
 
     // Get new midi events
-    void *midiBuf = jack_port_get_buffer(ports.midiIn, nframes);
-    uint nevents = jack_midi_get_event_count(midiBuf);
+    void *jackMidi = jack_port_get_buffer(ports.midiIn, nframes);
+    uint nevents = jack_midi_get_event_count(jackMidi);
 
     jack_midi_event_t event;
     for (uint i = 0; i < nevents; i++) {
-      using namespace midi;
-
-      jack_midi_event_get(&event, midiBuf, i);
-      midi::MidiEvent mEvent;
-
-      mEvent.channel = event.buffer[0] & 0b00001111;
-      mEvent.data = event.buffer + 1;
-      mEvent.time = event.time;
-
-      MidiEvent::byte type = event.buffer[0] >> 4;
-      switch (type) {
-      case MidiEvent::NOTE_OFF:
-        mEvent.type = MidiEvent::NOTE_OFF;
-        processData.midi.emplace_back(new NoteOffEvent(mEvent));
-        break;
-      case MidiEvent::NOTE_ON:
-        mEvent.type = MidiEvent::NOTE_ON;
-        processData.midi.emplace_back(new NoteOnEvent(mEvent));
-        break;
-      case MidiEvent::CONTROL_CHANGE:
-        mEvent.type = MidiEvent::CONTROL_CHANGE;
-        processData.midi.emplace_back(new ControlChangeEvent(mEvent));
-        break;
-      }
+      jack_midi_event_get(&event, jackMidi, i);
+      midiBuf.push(event.buffer, event.size, event.time);
     }
 
-    Globals::tapedeck.preProcess(processData);
-    Globals::synth.process(processData);
-    Globals::drums.process(processData);
-    Globals::effect.process(processData);
-    Globals::tapedeck.postProcess(processData);
-    Globals::mixer.process(processData);
-    Globals::metronome.process(processData);
-
-    // TODO: fix or replace poly_ptr so it works with smart pointers
-    for (auto&& e : processData.midi) {
-      delete e;
-    }
+    processBlock(processData);
   }
 
 } // top1::audio
@@ -9,32 +9,31 @@
 
 #include <jack/jack.h>
 
-#include "core/audio/processor.hpp"
+#include "core/audio/audio-driver.hpp"
 
 namespace top1::audio {
 
-  class JackAudio {
+  /// The driver for a JACK server
+  class JackAudio final : public AudioDriver {
     struct {
       jack_port_t *outL;
       jack_port_t *outR;
       jack_port_t *input;
       jack_port_t *midiIn;
       jack_port_t *midiOut;
-    } ports;
-
-    RTBuffer<float> procBuf;
+    } ports {};
 
     jack_client_t *client;
     jack_status_t jackStatus;
 
-    std::atomic_bool isProcessing {false};
-
     enum class PortType {
       Audio,
       Midi
     };
 
     void setupPorts();
+    /// Set the latency in <stats>, from the output port and the buffer size
+    void updateLatency();
 
     std::vector<std::string> findPorts(int criteria,
       PortType type = PortType::Audio);
@@ -48,16 +47,15 @@ namespace top1::audio {
     void buffersizeCallback(uint nframes);
     public:
 
-    uint bufferSize;
     using AudioSample = jack_default_audio_sample_t;
     const size_t sampleSize = sizeof(AudioSample);
     const std::string clientName = "TOP-1";
 
     JackAudio() {}
 
-    void init();
-    void startProcess();
-    void exit();
+    void init() override;
+    void startProcess() override;
+    void exit() override;
 
   };
 
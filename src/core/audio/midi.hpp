@@ -1,8 +1,10 @@
 #pragma once
 
+#include <array>
 #include <cmath>
+#include <variant>
 
-#include "util/poly-ptr.hpp"
+#include "util/type_traits.hpp"
 
 namespace top1::midi {
 
@@ -10,42 +12,113 @@ namespace top1::midi {
 
     typedef unsigned char byte;
 
-    enum EventType {
+    enum EventType : byte {
       NOTE_OFF = 0b1000,
       NOTE_ON = 0b1001,
       CONTROL_CHANGE = 0b1011,
     } type;
 
-    int channel;
-    byte *data;
-    int time;
+    byte channel = 0;
+    /// The frame in the period
+    int time = 0;
 
   };
 
   struct NoteOnEvent : public MidiEvent {
-    int key = data[0];
-    int velocity = data[1];
+    byte key = 0;
+    byte velocity = 0;
 
-    NoteOnEvent(const MidiEvent& event) : MidiEvent(event) {};
+    NoteOnEvent(int channel = 0, byte key = 0, byte velocity = 0, int time = 0)
+      : MidiEvent {NOTE_ON, byte(channel), time}, key (key), velocity (velocity) {}
   };
 
   struct NoteOffEvent : public MidiEvent {
-    int key = data[0];
-    int velocity = data[1];
+    byte key = 0;
+    byte velocity = 0;
 
-    NoteOffEvent(const MidiEvent& event) : MidiEvent(event) {};
+    NoteOffEvent(int channel = 0, byte key = 0, byte velocity = 0, int time = 0)
+      : MidiEvent {NOTE_OFF, byte(channel), time}, key (key), velocity (velocity) {}
   };
 
   struct ControlChangeEvent : public MidiEvent {
-    int controler = data[0];
-    int value = data[1];
+    byte controler = 0;
+    byte value = 0;
 
-    ControlChangeEvent(const MidiEvent& event) : MidiEvent(event) {};
+    ControlChangeEvent(int channel = 0, byte controler = 0, byte value = 0, int time = 0)
+      : MidiEvent {CONTROL_CHANGE, byte(channel), time},
+        controler (controler), value (value) {}
   };
 
-  // TODO: Replace with variant AnyMidiEvent
-  using MidiEventPtr = top1::poly_ptr<MidiEvent,
-    NoteOnEvent, NoteOffEvent, ControlChangeEvent>;
+  /// Any midi event, by value. Use `top1::match` to get the type
+  using AnyMidiEvent = std::variant<NoteOnEvent, NoteOffEvent, ControlChangeEvent>;
+
+  /// The frame in the period of any event
+  inline int eventTime(const AnyMidiEvent& event) {
+    return std::visit([] (const MidiEvent& e) { return e.time; }, event);
+  }
+
+  /**
+   * The midi events of a period.
+   *
+   * The events are stored inline, and nothing is allocated after
+   * construction, so this can be filled on the audio thread. Events past
+   * <Capacity> are dropped.
+   */
+  class MidiEventBuffer {
+    using byte = MidiEvent::byte;
+  public:
+    static constexpr std::size_t Capacity = 512;
+
+    /// Parse raw midi bytes, and add the event.
+    ///
+    /// Only the event types above are added.
+    /// @return false if the event was unknown, incomplete, or did not fit
+    bool push(const byte* bytes, std::size_t size, int time) {
+      if (size < 3) return false;
+      int channel = bytes[0] & 0b00001111;
+      switch (bytes[0] >> 4) {
+      case MidiEvent::NOTE_OFF:
+        return push(NoteOffEvent(channel, bytes[1], bytes[2], time));
+      case MidiEvent::NOTE_ON:
+        return push(NoteOnEvent(channel, bytes[1], bytes[2], time));
+      case MidiEvent::CONTROL_CHANGE:
+        return push(ControlChangeEvent(channel, bytes[1], bytes[2], time));
+      default:
+        return false;
+      }
+    }
+
+    bool push(const AnyMidiEvent& event) {
+      if (count == Capacity) {
+        nDropped++;
+        return false;
+      }
+      events[count++] = event;
+      return true;
+    }
+
+    void clear() {
+      count = 0;
+    }
+
+    std::size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    AnyMidiEvent* begin() { return events.data(); }
+    AnyMidiEvent* end() { return events.data() + count; }
+    const AnyMidiEvent* begin() const { return events.data(); }
+    const AnyMidiEvent* end() const { return events.data() + count; }
+
+    AnyMidiEvent& operator[](std::size_t i) { return events[i]; }
+
+    /// Events dropped since construction, because the buffer was full
+    int dropped() const { return nDropped; }
+
+  private:
+    std::array<AnyMidiEvent, Capacity> events;
+    std::size_t count = 0;
+    int nDropped = 0;
+  };
 
   inline float freqTable[128];
 
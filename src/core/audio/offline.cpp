@@ -0,0 +1,132 @@
+#include "offline.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <plog/Log.h>
+
+#include "core/globals.hpp"
+
+namespace top1::audio {
+
+  OfflineAudio::~OfflineAudio() {
+    exit();
+  }
+
+  void OfflineAudio::init() {
+    uint samplerate = options.samplerate;
+    int inputLength = 0;
+    try {
+      if (!options.input.empty()) {
+        if (!fs::exists(options.input)) {
+          throw "Input file not found";
+        }
+        input.open(options.input);
+        samplerate = input.info.samplerate;
+        inputLength = input.length() / input.info.channels;
+      }
+      if (!options.midi.empty()) {
+        midi.read(options.midi);
+      }
+      fs::remove(options.output);
+      output.info.channels = 2;
+      output.info.samplerate = samplerate;
+      output.open(options.output);
+      output.seek(0);
+    } catch (const char* e) {
+      LOGF << "Offline audio: " << e;
+      Globals::exit();
+      return;
+    } catch (ByteFile::Error& e) {
+      LOGF << "Offline audio: " << e.what();
+      Globals::exit();
+      return;
+    }
+
+    length = options.length >= 0 ? options.length
+      : std::max<int>(inputLength, std::ceil(midi.length() * samplerate));
+
+    Globals::samplerate = samplerate;
+    Globals::events.samplerateChanged.runAll(samplerate);
+    bufferSize = options.bufferSize;
+    Globals::events.bufferSizeChanged.runAll(bufferSize);
+
+    LOGI << "Initialized OfflineAudio, rendering " << length << " frames to "
+         << options.output;
+  }
+
+  void OfflineAudio::startProcess() {
+    if (!output.is_open()) {
+      LOGE << "OfflineAudio was not initialized, not rendering";
+      return;
+    }
+    startWorkers();
+    isProcessing = true;
+    thread = std::thread(&OfflineAudio::run, this);
+  }
+
+  void OfflineAudio::exit() {
+    if (thread.joinable() && thread.get_id() != std::this_thread::get_id()) {
+      thread.join();
+    }
+    output.close();
+    input.close();
+  }
+
+  void OfflineAudio::run() {
+    render();
+    Globals::exit();
+  }
+
+  void OfflineAudio::render() {
+    std::vector<float> inFrames(bufferSize * std::max(input.info.channels, 1));
+    std::vector<float> inData(bufferSize), outL(bufferSize), outR(bufferSize);
+    std::vector<float> interleaved(2 * bufferSize);
+    int inputLength = input.is_open() ? input.length() / input.info.channels : 0;
+    auto event = midi.events.begin();
+
+    auto start = std::chrono::steady_clock::now();
+    int pos = 0;
+    for (; pos < length && Globals::running(); pos += bufferSize) {
+      int n = std::min<int>(bufferSize, length - pos);
+      ProcessData processData;
+      processData.nframes = n;
+
+      std::fill(inData.begin(), inData.end(), 0);
+      int avail = std::clamp(inputLength - pos, 0, n);
+      if (avail > 0) {
+        int channels = input.info.channels;
+        input.seek(pos * channels);
+        input.read_samples(inFrames.data(), avail * channels);
+        for (int i = 0; i < avail; i++) {
+          inData[i] = inFrames[i * channels];
+        }
+      }
+
+      for (; event != midi.events.end()
+             && event->time * Globals::samplerate < pos + n; event++) {
+        int time = std::clamp<int>(event->time * Globals::samplerate - pos, 0, n - 1);
+        midiBuf.push(event->bytes.data(), event->size, time);
+      }
+
+      std::fill(outL.begin(), outL.end(), 0);
+      std::fill(outR.begin(), outR.end(), 0);
+      processData.audio.outL  = {outL.data(), n};
+      processData.audio.outR  = {outR.data(), n};
+      processData.audio.input = {inData.data(), n};
+      processBlock(processData);
+
+      for (int i = 0; i < n; i++) {
+        interleaved[2 * i] = outL[i];
+        interleaved[2 * i + 1] = outR[i];
+      }
+      output.write_samples(interleaved.data(), 2 * n);
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    double seconds = std::min(pos, length) / double(Globals::samplerate);
+    LOGI << "Rendered " << seconds << " s of audio in " << elapsed.count()
+         << " s (" << seconds / std::max(elapsed.count(), 1e-9) << "x realtime)";
+    output.flush();
+  }
+
+} // top1::audio
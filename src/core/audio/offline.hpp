@@ -0,0 +1,67 @@
+#pragma once
+
+#include <thread>
+#include <vector>
+
+#include "filesystem.hpp"
+#include "core/audio/audio-driver.hpp"
+#include "util/midi-file.hpp"
+#include "util/soundfile.hpp"
+
+namespace top1::audio {
+
+  /**
+   * A driver that renders to a file, as fast as the CPU allows.
+   *
+   * Input audio is read from a sound file, and midi from a Standard MIDI
+   * File. The stereo output is written to a sound file. No audio hardware
+   * or server is needed, and the result does not depend on timing, as long
+   * as the tape is loaded synchronously (see `Globals::offline`).
+   *
+   * Calls `Globals::exit()` when done.
+   */
+  class OfflineAudio final : public AudioDriver {
+  public:
+
+    struct Options {
+      /// Sound file with the input. Only the first channel is used.
+      /// Empty for silence
+      fs::path input;
+      /// Standard MIDI File with the midi input. Empty for none
+      fs::path midi;
+      /// Where to write the output. Overwritten if it exists
+      fs::path output;
+      /// The number of frames to render, or -1 to stop at the end of the
+      /// input and the midi, whichever is later
+      int length = -1;
+      uint bufferSize = 256;
+      /// Only used without input. Otherwise the samplerate of the input
+      uint samplerate = 44100;
+    };
+
+    OfflineAudio(Options options) : options (std::move(options)) {}
+    ~OfflineAudio();
+
+    void init() override;
+    void startProcess() override;
+    void exit() override;
+
+    /// Render all of it on the calling thread, without the workers, and
+    /// flush the output. Unlike <startProcess>, does not call
+    /// `Globals::exit()`
+    void render();
+
+  private:
+
+    Options options;
+    SoundFile input;
+    SoundFile output;
+    MidiFile midi;
+    int length = 0;
+    std::thread thread;
+
+    /// Render all of it, then exit
+    void run();
+  };
+
+} // top1::audio
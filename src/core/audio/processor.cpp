@@ -5,8 +5,12 @@
 namespace top1::audio {
 namespace detail {
 
-  void registerAudioBufferResize(std::function<void(uint)> eventHandler) {
-    Globals::events.bufferSizeChanged.add(eventHandler);
+  uint registerAudioBufferResize(std::function<void(uint)> eventHandler) {
+    return Globals::events.bufferSizeChanged.add(eventHandler);
+  }
+
+  void unregisterAudioBufferResize(uint id) {
+    Globals::events.bufferSizeChanged.remove(id);
   }
 
 } // detail
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <functional>
 #include <gsl/span>
 
@@ -37,7 +38,8 @@ namespace top1 {
 
     namespace detail {
       // No including "core/globals.hpp" in headers
-      void registerAudioBufferResize(std::function<void(uint)>);
+      uint registerAudioBufferResize(std::function<void(uint)>);
+      void unregisterAudioBufferResize(uint);
     }
 
     /*
@@ -45,7 +47,7 @@ namespace top1 {
      *
      * This is the container used in AudioProcessors, and it should be used
      * in any place where the realtime data is copied out. It is resized on
-     * the bufferSizeChanged event
+     * the bufferSizeChanged event, until it is destroyed
      */
     template<typename T>
       class RTBuffer : public top1::DynArray<T> {
@@ -65,15 +67,24 @@ namespace top1 {
       RTBuffer(size_type sizeFactor = 1)
         : top1::DynArray<T>(0),
         sFactor (sizeFactor) {
-        detail::registerAudioBufferResize([this] (uint newSize) {
+        handler = detail::registerAudioBufferResize([this] (uint newSize) {
             this->resize(newSize * sFactor);
           });
       }
 
+      // The handler refers to this buffer
+      RTBuffer(const RTBuffer&) = delete;
+      RTBuffer& operator=(const RTBuffer&) = delete;
+
+      ~RTBuffer() {
+        detail::unregisterAudioBufferResize(handler);
+      }
+
       using top1::DynArray<T>::operator[];
 
       private:
       size_type sFactor;
+      uint handler;
     };
 
     /*
@@ -96,28 +107,86 @@ namespace top1 {
         /// The location of the spans relative to the audio buffer
         ///
         /// Will mostly be zero, but is set on `slice`
-        int offset;
+        int offset = 0;
       } audio;
 
       int nframes;
-      // ProcessData is passed by const&, so this needs mutable
-      // Maybe that is a bad idea?
-      mutable std::vector<midi::MidiEventPtr> midi;
-
+      /// The midi events of the period, ordered by time.
+      ///
+      /// A view of a buffer owned by the <AudioDriver>, so copying
+      /// ProcessData is cheap and nothing is allocated per period.
+      gsl::span<midi::AnyMidiEvent> midi;
+
+      /**
+       * The frames `[bounds.i, bounds.o)` of the period.
+       *
+       * The midi events are the ones in those frames. Their times are still
+       * relative to the whole period, see `audio.offset`.
+       */
       ProcessData slice(Range bounds) const {
         int s = bounds.o - bounds.i;
-        if (bounds.i < 0 || s > nframes) {
+        if (bounds.i < 0 || s < 0 || bounds.o > nframes) {
           throw "Illegal ProcessData slice";
         }
         ProcessData ret;
-        ret.audio.offset += bounds.i;
+        ret.audio.offset = audio.offset + bounds.i;
         ret.nframes = s;
         ret.audio.outL  = {audio.outL.data() + bounds.i, s};
         ret.audio.outR  = {audio.outR.data() + bounds.i, s};
         ret.audio.input = {audio.input.data() + bounds.i, s};
         ret.audio.proc  = {audio.proc.data() + bounds.i, s};
+        auto before = [] (const midi::AnyMidiEvent& e, int t) {
+          return midi::eventTime(e) < t;
+        };
+        auto first = std::lower_bound(midi.begin(), midi.end(),
+          audio.offset + bounds.i, before);
+        auto last = std::lower_bound(first, midi.end(),
+          audio.offset + bounds.o, before);
+        ret.midi = midi.subspan(first - midi.begin(), last - first);
         return ret;
       }
+
+      /**
+       * Call `f` with consecutive slices covering the period, split at the
+       * times of the midi events.
+       *
+       * Each slice starts at the time of its first event, so a module that
+       * applies the events at the start of the data it is given is sample
+       * accurate. Events closer than `minFrames` to the start of a slice
+       * are moved to it, to not split into tiny slices. Slices are at least
+       * one frame long, even if `minFrames` is less.
+       *
+       * @f Invocable with `(const ProcessData&)`
+       */
+      template<typename F>
+      void splitAtEvents(int minFrames, F&& f) const {
+        if (midi.empty()) {
+          f(*this);
+          return;
+        }
+        // Otherwise an event at the start of a slice would end it right away
+        minFrames = std::max(minFrames, 1);
+        int from = 0;
+        std::ptrdiff_t first = 0;
+        std::ptrdiff_t event = 0;
+        while (from < nframes) {
+          while (event < midi.size()
+                 && midi::eventTime(midi[event]) - audio.offset < from + minFrames) {
+            event++;
+          }
+          int to = nframes;
+          if (event < midi.size()) {
+            to = std::min(midi::eventTime(midi[event]) - audio.offset, nframes);
+          }
+          // Events past the end of the period go in the last slice
+          if (to == nframes) event = midi.size();
+          ProcessData s = slice({from, to});
+          s.midi = midi.subspan(first, event - first);
+          f(s);
+          from = to;
+          first = event;
+        }
+      }
     };
 
   } // audio
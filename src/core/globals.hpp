@@ -5,9 +5,11 @@
 #include <array>
 #include <atomic>
 #include <condition_variable>
+#include <memory>
 #include <filesystem.hpp>
 
 #include "util/event.hpp"
+#include "util/sample-pool.hpp"
 
 #include "core/datafile.hpp"
 #include "core/audio/jack.hpp"
@@ -40,8 +42,16 @@ namespace top1 {
 
     static inline DataFile dataFile;
     static inline uint samplerate = 44100;
-
-    static inline audio::JackAudio jackAudio;
+    /// Samples shared by all sampler modules
+    static inline audio::SamplePool samplePool;
+
+    /// Set in `main` before <init>: JACK, or the offline renderer
+    static inline std::unique_ptr<audio::AudioDriver> audioDriver;
+    /// Run without opening a window
+    static inline bool headless = false;
+    /// Rendering to a file: the tape is read on the audio thread, and no
+    /// state is saved on exit
+    static inline bool offline = false;
     static inline ui::MainUI ui;
 
     static inline modules::SynthModuleDispatcher synth;
@@ -54,12 +64,12 @@ namespace top1 {
     static inline void init() {
       dataFile.path = data_dir / "modules.json";
       dataFile.read();
-      jackAudio.init();
+      audioDriver->init();
       tapedeck.init();
       mixer.init();
       synth.current().init();
       drums.current().init();
-      ui.init();
+      if (!headless) ui.init();
     }
 
     //TODO: status codes etc
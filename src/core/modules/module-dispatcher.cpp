@@ -1,5 +1,7 @@
 #include "core/modules/module-dispatcher.hpp"
 
+#include <algorithm>
+
 #include "core/globals.hpp"
 
 namespace top1::modules {
@@ -11,5 +13,44 @@ namespace top1::modules {
     void displayScreen(ui::Screen& ptr) {
       Globals::ui.display(ptr);
     }
+
+    bool startsNote(const midi::AnyMidiEvent& event, const midi::NoteOffEvent& off) {
+      auto* on = std::get_if<midi::NoteOnEvent>(&event);
+      return on && on->channel == off.channel && on->key == off.key;
+    }
+  }
+
+  void SynthModuleDispatcher::process(const audio::ProcessData& data) {
+    if (modules.size() == 0) return;
+    auto& module = *modules[currentModule].val;
+    data.splitAtEvents(MinSliceFrames, [&] (const audio::ProcessData& slice) {
+        if (slice.midi.empty() && heldOffs.empty()) {
+          module.process(slice);
+          return;
+        }
+        sliceEvents.clear();
+        for (auto&& off : heldOffs) {
+          std::get<midi::NoteOffEvent>(off).time = slice.audio.offset;
+          sliceEvents.push(off);
+        }
+        heldOffs.clear();
+        auto begin = slice.midi.begin();
+        auto end = slice.midi.end();
+        for (auto event = begin; event != end; event++) {
+          auto* off = std::get_if<midi::NoteOffEvent>(&*event);
+          auto started = [&] (const midi::AnyMidiEvent& e) {
+            return detail::startsNote(e, *off);
+          };
+          if (!off || std::none_of(begin, event, started)) {
+            sliceEvents.push(*event);
+          } else if (std::none_of(event + 1, end, started)) {
+            heldOffs.push(*event);
+          }
+          // Otherwise the note is started again in this slice
+        }
+        audio::ProcessData s = slice;
+        s.midi = {sliceEvents.begin(), sliceEvents.end()};
+        module.process(s);
+      });
   }
 }
@@ -62,6 +62,10 @@ namespace top1::modules {
         std::make_unique<T>(std::forward<Args>(args)...));
     }
 
+    /// Remove the module registered as `name`, if there is one.
+    /// If it was the current module, the first one is current after this
+    void unregisterModule(const std::string& name);
+
     tree::Node makeNode() override;
 
     void readNode(top1::tree::Node node) override;
@@ -70,10 +74,22 @@ namespace top1::modules {
   class SynthModuleDispatcher : public ModuleDispatcher<SynthModule> {
   public:
 
-    void process(const audio::ProcessData& data) {
-      if (modules.size() > 0)
-        modules[currentModule].val->process(data);
-    }
+    /// The shortest slice a period is split into, see <process>
+    static constexpr int MinSliceFrames = 16;
+
+    /// Process the current module, with the period split at the midi
+    /// events, so they are sample accurate.
+    ///
+    /// The modules apply the events of a slice at its start. A note-off
+    /// for a note started earlier in the same slice is held back to the
+    /// start of the next slice, so short notes are still heard.
+    void process(const audio::ProcessData& data);
+
+  private:
+    /// The events passed to the module for a slice
+    midi::MidiEventBuffer sliceEvents;
+    /// Note-offs held back to the next slice, which may be in the next period
+    midi::MidiEventBuffer heldOffs;
   };
 
   class EffectModuleDispatcher : public ModuleDispatcher<EffectModule> {
@@ -132,6 +148,24 @@ namespace top1::modules {
     }
   }
 
+  template<typename M>
+  void ModuleDispatcher<M>::unregisterModule(const std::string& name) {
+    auto found = std::find(modules.begin(), modules.end(), name);
+    if (found == modules.end()) return;
+    std::size_t idx = found - modules.begin();
+    modules.erase(found);
+    if (currentModule > idx) {
+      currentModule--;
+    } else if (currentModule == idx) {
+      currentModule = 0;
+    }
+    selectorScreen->items.clear();
+    for (std::size_t i = 0; i < modules.size(); i++) {
+      selectorScreen->items.push_back({modules[i].key, (int)i});
+    }
+    selectorScreen->selectedItem = currentModule;
+  }
+
   template<typename M>
   top1::tree::Node ModuleDispatcher<M>::makeNode() {
     top1::tree::Map node;
@@ -66,6 +66,9 @@ namespace top1::ui {
     K_LIFT,
     K_DROP,
     K_CUT,
+    K_UNDO,
+
+    K_DSP_STATS,
   };
 
   using PressedKeys = bool[256];
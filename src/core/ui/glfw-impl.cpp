@@ -83,7 +83,9 @@ namespace top1::ui {
 
     case GLFW_KEY_X:     return K_CUT;
     case GLFW_KEY_C:     if (mods & GLFW_MOD_CONTROL) return K_LIFT; else break;
-    case GLFW_KEY_V:     if (mods & GLFW_MOD_CONTROL) return K_DROP;
+    case GLFW_KEY_V:     if (mods & GLFW_MOD_CONTROL) return K_DROP; else break;
+    case GLFW_KEY_Z:     if (mods & GLFW_MOD_CONTROL) return K_UNDO; else break;
+    case GLFW_KEY_P:     if (mods & GLFW_MOD_CONTROL) return K_DSP_STATS; else break;
 
     case GLFW_KEY_LEFT_SHIFT:
     case GLFW_KEY_RIGHT_SHIFT:
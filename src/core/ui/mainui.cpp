@@ -3,6 +3,7 @@
 #include "core/globals.hpp"
 
 #include <thread>
+#include <fmt/format.h>
 
 namespace top1::ui {
 
@@ -17,11 +18,50 @@ namespace top1::ui {
   }
 
   void MainUI::exit() {
-    uiThread.join();
+    // Not started when headless
+    if (uiThread.joinable()) uiThread.join();
   }
 
   void MainUI::draw(drawing::Canvas& ctx) {
     currentScreen->draw(ctx);
+    if (showStats) drawStats(ctx);
+  }
+
+  void MainUI::drawStats(drawing::Canvas& ctx) {
+    using namespace drawing;
+    using Stats = audio::DspStats;
+    constexpr float lineHeight = 11;
+    auto stats = Globals::audioDriver->stats.snapshot();
+    auto ms = [] (Stats::Duration d) {
+      return std::chrono::duration<double, std::milli>(d).count();
+    };
+
+    ctx.beginPath();
+    ctx.rect({5, 5}, {150, (5 + Stats::NodeCount) * lineHeight + 6});
+    ctx.fill(Colours::Black);
+
+    ctx.font(Fonts::Mono);
+    ctx.font(10);
+    ctx.textAlign(TextAlign::Left, TextAlign::Top);
+    Point p = {10, 8};
+    auto line = [&] (const std::string& text, Colour colour) {
+      ctx.beginPath();
+      ctx.fillStyle(colour);
+      ctx.fillText(text, p);
+      p.y += lineHeight;
+    };
+
+    line(fmt::format("DSP {:3.0f}% max {:3.0f}%", stats.load * 100, stats.maxLoad * 100),
+         stats.maxLoad > 0.8 ? Colours::Red : Colours::Green);
+    line(fmt::format("avg {:3.0f}% xruns {}", stats.avgLoad * 100, stats.xruns),
+         stats.xruns > 0 ? Colours::Red : Colours::White);
+    line(fmt::format("worst {:.2f} ms", ms(stats.worstWork)), Colours::White);
+    line(fmt::format("interval {:.2f} ms", ms(stats.worstInterval)), Colours::White);
+    line(fmt::format("latency {} fr", stats.latency), Colours::White);
+    for (int i = 0; i < Stats::NodeCount; i++) {
+      line(fmt::format("{:<12} {:.2f}", Stats::nodeNames[i], ms(stats.nodeWorst[i])),
+           Colours::Gray60);
+    }
   }
 
   bool MainUI::keypress(ui::Key key) {
@@ -91,6 +131,9 @@ namespace top1::ui {
     case K_METRONOME:
       Globals::metronome.display();
       break;
+    case K_DSP_STATS:
+      showStats = !showStats;
+      break;
     default:
       return false;
     }
@@ -11,6 +11,9 @@ namespace top1::ui {
     bool globKeyPre(Key key);
     bool globKeyPost(Key key);
 
+    /// Draw the load and timings of the audio thread over the screen
+    void drawStats(drawing::Canvas& ctx);
+
   public:
 
     ui::PressedKeys keys;
@@ -27,6 +30,9 @@ namespace top1::ui {
 
     Screen* currentScreen;
 
+    /// Show the DSP stats overlay. Toggled by <K_DSP_STATS>
+    bool showStats = false;
+
     std::thread uiThread;
 
     void display(Screen& screen);
@@ -1,8 +1,12 @@
+#include <charconv>
+#include <chrono>
+#include <cstring>
 #include <mutex>
 #include <plog/Log.h>
 #include <plog/Appenders/ConsoleAppender.h>
 
 #include "core/audio/jack.hpp"
+#include "core/audio/offline.hpp"
 #include "core/audio/midi.hpp"
 #include "core/ui/mainui.hpp"
 #include "modules/tapedeck.hpp"
@@ -13,6 +17,17 @@
 #include "modules/synth-sampler.hpp"
 #include "modules/nuke.hpp"
 #include "core/globals.hpp"
+#include "util/bounce.hpp"
+#include "util/bytefile.hpp"
+
+/// Parse the whole of `str` as a number into `out`.
+/// @return false if it is not one
+template<typename T>
+static bool parseNumber(const char* str, T& out) {
+  const char* end = str + std::strlen(str);
+  auto [ptr, ec] = std::from_chars(str, end, out);
+  return ec == std::errc() && ptr == end && ptr != str;
+}
 
 int main(int argc, char *argv[]) {
   using namespace top1;
@@ -22,6 +37,58 @@ int main(int argc, char *argv[]) {
       .addAppender(&consoleAppender);
     LOGI << "LOGGING NOW";
 
+    // top-1 --bounce <file>: mix the tape down to a file, without starting
+    // the audio server or the UI
+    if (argc == 3 && std::string(argv[1]) == "--bounce") {
+      Globals::dataFile.path = Globals::data_dir / "modules.json";
+      Globals::dataFile.read();
+      try {
+        bounce(Globals::data_dir / "tape.wav", argv[2], Globals::mixer.mix(), 0,
+          [] (float p) { LOGD << "Bounced " << int(p * 100) << "%"; });
+      } catch (const char* e) {
+        LOGF << e;
+        return 1;
+      } catch (ByteFile::Error& e) {
+        LOGF << e.what();
+        return 1;
+      }
+      return 0;
+    }
+
+    // top-1 --render <file> [--input <file>] [--midi <file>] [--frames <n>]
+    // [--buffer <n>]: run all modules on the input, as fast as possible,
+    // and write the output to a file. Needs no audio server or display.
+    if (argc >= 3 && std::string(argv[1]) == "--render") {
+      audio::OfflineAudio::Options options;
+      options.output = argv[2];
+      for (int i = 3; i < argc; i += 2) {
+        std::string opt = argv[i];
+        if (i + 1 == argc) {
+          LOGF << "Missing value for " << opt;
+          return 1;
+        }
+        bool valid = true;
+        if (opt == "--input") options.input = argv[i + 1];
+        else if (opt == "--midi") options.midi = argv[i + 1];
+        else if (opt == "--frames") valid = parseNumber(argv[i + 1], options.length);
+        else if (opt == "--buffer") valid = parseNumber(argv[i + 1], options.bufferSize)
+                                      && options.bufferSize > 0;
+        else {
+          LOGF << "Unknown option " << opt;
+          return 1;
+        }
+        if (!valid) {
+          LOGF << "Invalid value for " << opt << ": " << argv[i + 1];
+          return 1;
+        }
+      }
+      Globals::audioDriver = std::make_unique<audio::OfflineAudio>(options);
+      Globals::headless = true;
+      Globals::offline = true;
+    } else {
+      Globals::audioDriver = std::make_unique<audio::JackAudio>();
+    }
+
     midi::generateFreqTable(440);
     std::mutex mut;
     std::unique_lock lock (mut);
@@ -39,9 +106,21 @@ int main(int argc, char *argv[]) {
     Globals::init();
     Globals::events.postInit.runAll();
 
-    Globals::jackAudio.startProcess();
+    // The driver exits if it could not be initialized
+    if (Globals::running()) Globals::audioDriver->startProcess();
 
-    Globals::notifyExit.wait(lock);
+    // An offline render may be done before we get here
+    auto statsPath = Globals::data_dir / "dsp-stats.json";
+    auto statsWritten = std::chrono::steady_clock::now();
+    while (Globals::running()) {
+      Globals::notifyExit.wait_for(lock, std::chrono::milliseconds(100));
+      auto now = std::chrono::steady_clock::now();
+      if (now - statsWritten > std::chrono::seconds(5)) {
+        Globals::audioDriver->stats.writeToFile(statsPath);
+        statsWritten = now;
+      }
+    }
+    Globals::audioDriver->stats.writeToFile(statsPath);
 
   } catch (const char* e) {
     LOGF << e;
@@ -50,8 +129,8 @@ int main(int argc, char *argv[]) {
     Globals::ui.exit();
     Globals::mixer.exit();
     Globals::tapedeck.exit();
-    Globals::jackAudio.exit();
-    Globals::dataFile.write();
+    Globals::audioDriver->exit();
+    if (!Globals::offline) Globals::dataFile.write();
     Globals::events.postExit.runAll();
   }
 
@@ -60,8 +139,8 @@ int main(int argc, char *argv[]) {
   Globals::ui.exit();
   Globals::mixer.exit();
   Globals::tapedeck.exit();
-  Globals::jackAudio.exit();
-  Globals::dataFile.write();
+  Globals::audioDriver->exit();
+  if (!Globals::offline) Globals::dataFile.write();
   Globals::events.postExit.runAll();
   return 0;
 }
@@ -5,7 +5,7 @@
 #include "core/ui/module-ui.hpp"
 #include "core/ui/drawing.hpp"
 #include "core/ui/icons.hpp"
-#include "util/soundfile.hpp"
+#include "modules/sample-playback.hpp"
 
 namespace top1::ui::drawing {
 
@@ -34,12 +34,13 @@ namespace top1::modules {
   DrumSampler::DrumSampler() :
     SynthModule(&props),
     maxSampleSize (16 * Globals::samplerate),
-    sampleData (maxSampleSize),
     editScreen (new DrumSampleScreen(this)) {
 
     Globals::events.samplerateChanged.add([&] (uint sr) {
         maxSampleSize = 16 * sr;
-        sampleSpeed = sampleSampleRate / float(sr);
+        // Samples are stored at the samplerate they were loaded for
+        auto current = sample.current();
+        if (current && int(sr) != current->samplerate) load();
       });
 
   }
@@ -54,63 +55,14 @@ namespace top1::modules {
 
   void DrumSampler::process(const audio::ProcessData& data) {
     for (auto &&nEvent : data.midi) {
-      nEvent.match([&] (midi::NoteOnEvent& e) {
+      match(nEvent, [&] (midi::NoteOnEvent& e) {
           if (e.channel == 1) {
             currentVoiceIdx = e.key % nVoices;
             auto &&voice = props.voiceData[currentVoiceIdx];
             voice.playProgress = (voice.fwd()) ? 0 : voice.length() - 1;
             voice.trigger = true;
           }
-        }, [] (auto&&) {});
-    }
-
-    for (auto &&voice : props.voiceData) {
-
-      float playSpeed = voice.speed * sampleSpeed;
-
-      // Process audio
-      if (voice.playProgress >= 0 && playSpeed > 0) {
-        if (voice.fwd()) {
-          if (voice.loop() && voice.trigger) {
-            for(int i = 0; i < data.nframes; ++i) {
-              data.audio.proc[i] += sampleData[voice.in + voice.playProgress];
-              voice.playProgress += playSpeed;
-              if (voice.playProgress >= voice.length()) {
-                voice.playProgress = 0;
-              }
-            }
-          } else {
-            int frms = std::min<int>(data.nframes, voice.length() - voice.playProgress);
-            for(int i = 0; i < frms; ++i) {
-              data.audio.proc[i] += sampleData[voice.in + voice.playProgress];
-              voice.playProgress += playSpeed;
-            }
-            if (voice.playProgress >= voice.length()) {
-              voice.playProgress = -1;
-            }
-          }
-        } else {
-          if (voice.loop() && voice.trigger) {
-            for(int i = 0; i < data.nframes; ++i) {
-              data.audio.proc[i] += sampleData[voice.in + voice.playProgress];
-              voice.playProgress -= playSpeed;
-              if (voice.playProgress < 0) {
-                voice.playProgress = voice.length() -1;
-              }
-            }
-          } else {
-            int frms = std::min<int>(data.nframes, voice.playProgress);
-            for(int i = 0; i < frms; ++i) {
-              data.audio.proc[i] += sampleData[voice.in + voice.playProgress];
-              voice.playProgress -= playSpeed;
-            }
-          }
-        }
-      }
-    }
-
-    for (auto &&nEvent : data.midi) {
-      nEvent.match([&] (midi::NoteOffEvent& e) {
+        }, [&] (midi::NoteOffEvent& e) {
           if (e.channel == 1) {
             auto &&voice = props.voiceData[e.key % nVoices];
             voice.trigger = false;
@@ -119,7 +71,33 @@ namespace top1::modules {
             }
           }
         }, [] (auto&&) {});
-    };
+    }
+
+    unsigned swaps = sample.swapCount();
+    const auto* playing = sample.acquire();
+    // Fit the ranges here, as the screen and this thread use them
+    if (swaps != rangesFitTo) {
+      assignVoices(playing ? playing->frames.size() : 0);
+      rangesFitTo = swaps;
+      sampleChanged = true;
+    }
+    gsl::span<const float> frames;
+    if (playing) frames = playing->frames;
+    for (auto &&voice : props.voiceData) {
+      if (voice.playProgress >= 0 && voice.speed > 0) {
+        voice.playProgress = play_sample(data.audio.proc.first(data.nframes),
+          voiceData(frames, voice), voice.playProgress, voice.speed,
+          voice.fwd(), voice.loop() && voice.trigger);
+      }
+    }
+    sample.release();
+  }
+
+  gsl::span<const float> DrumSampler::voiceData(gsl::span<const float> frames,
+                                                const Props::VoiceData& voice) {
+    int in = std::clamp<int>(voice.in, 0, frames.size());
+    int out = std::clamp<int>(voice.out, in, frames.size());
+    return frames.subspan(in, out - in);
   }
 
   void DrumSampler::display() {
@@ -127,24 +105,13 @@ namespace top1::modules {
   }
 
   void DrumSampler::load() {
+    const std::string& name = props.sampleName;
+    if (name.empty()) LOGI << "Empty sampleName";
+    sample.load(Globals::samplePool, name.empty() ? fs::path() : samplePath(name),
+                Globals::samplerate, maxSampleSize);
+  }
 
-    auto path = samplePath(props.sampleName);
-    std::size_t rs = 0;
-    if (!(path.empty() || props.sampleName.get().empty())) {
-      SoundFile sf;
-        sf.open(path);
-      rs = std::min<int>(maxSampleSize, sf.length());
-      sampleData.resize(rs);
-      sf.read_samples(sampleData.data(), rs);
-
-      sampleSampleRate = sf.info.samplerate;
-      sampleSpeed = sampleSampleRate / float(Globals::samplerate);
-      if (sf.length() == 0) LOGD << "Empty sample file";
-    } else {
-      sampleData.resize(0);
-      LOGI << "Empty sampleName";
-    }
-
+  void DrumSampler::assignVoices(std::size_t rs) {
     for (auto &&v : props.voiceData) {
       v.in.mode.max = rs;
       v.out.mode.max = rs;
@@ -159,23 +126,12 @@ namespace top1::modules {
         vd.out = (i + 1) * rs / nVoices;
       }
     }
-
-    auto &mwf = editScreen->mainWF;
-    mwf->clear();
-    for (auto &&s : sampleData) {
-      mwf->addFrame(s);
-    }
-
-    auto &wf = editScreen->topWF;
-    wf->clear();
-    for (auto &&s : sampleData) {
-      wf->addFrame(s);
-    }
-    editScreen->topWFW.viewRange = {0, wf->size() - 1};
   }
 
   void DrumSampler::init() {
+    // Start with the sample in place
     load();
+    sample.wait();
   }
 
   /****************************************/
@@ -210,15 +166,30 @@ namespace top1::modules {
 
   DrumSampleScreen::DrumSampleScreen(DrumSampler *m) :
     ui::ModuleScreen<DrumSampler> (m),
-    topWF (new audio::Waveform(module->sampleData.size()
+    topWF (new audio::Waveform(module->maxSampleSize
                                / ui::drawing::topWFsize.w / 4.0, 1.0)),
     topWFW (topWF, ui::drawing::topWFsize),
     mainWF (new audio::Waveform(50, 1.0)),
     mainWFW (mainWF, ui::drawing::mainWFsize) {}
 
+  void DrumSampleScreen::updateWaveforms() {
+    auto sample = module->sample.current();
+    mainWF->clear();
+    topWF->clear();
+    if (sample) {
+      for (auto &&s : sample->frames) {
+        mainWF->addFrame(s);
+        topWF->addFrame(s);
+      }
+    }
+    topWFW.viewRange = {0, topWF->size() - 1};
+  }
+
   void modules::DrumSampleScreen::draw(ui::drawing::Canvas &ctx) {
     using namespace ui::drawing;
 
+    if (module->sampleChanged.exchange(false)) updateWaveforms();
+
     Colour colourCurrent;
 
     ctx.callAt(topWFpos, [&] () {
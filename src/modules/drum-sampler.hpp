@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <fmt/format.h>
 
 #include "filesystem.hpp"
@@ -10,7 +11,7 @@
 #include "core/ui/canvas.hpp"
 
 #include "util/algorithm.hpp"
-#include "util/dyn-array.hpp"
+#include "util/sample-slot.hpp"
 
 namespace top1::modules {
 
@@ -23,9 +24,12 @@ namespace top1::modules {
   public:
 
     size_t maxSampleSize = 0;
-    top1::DynArray<float> sampleData;
-    int sampleSampleRate = 44100;
-    float sampleSpeed = 1;
+    /// Shared with the other samplers through <Globals::samplePool>.
+    /// Empty when no sample is loaded
+    audio::SampleSlot sample;
+    /// Set when the audio thread starts playing a new sample, and has fit
+    /// the ranges to it, for the screen to update
+    std::atomic_bool sampleChanged {false};
 
     std::unique_ptr<DrumSampleScreen> editScreen;
 
@@ -78,11 +82,25 @@ namespace top1::modules {
 
     void display() override;
 
+    /// Load the sample named by the props on a background thread, without
+    /// waiting. The old sample plays until the new one is ready
     void load();
 
     void init() override;
 
     static fs::path samplePath(std::string name);
+
+  private:
+
+    /// The part of `frames` played by `voice`
+    static gsl::span<const float> voiceData(gsl::span<const float> frames,
+                                            const Props::VoiceData& voice);
+
+    /// Fit the voices to a sample of `size` frames
+    void assignVoices(std::size_t size);
+
+    /// The <audio::SampleSlot::swapCount> the ranges were fit to
+    unsigned rangesFitTo = 0;
   };
 
   class DrumSampleScreen : public ui::ModuleScreen<DrumSampler> {
@@ -96,6 +114,8 @@ namespace top1::modules {
     DrumSampleScreen(DrumSampler *);
 
     void draw(ui::drawing::Canvas&) override;
+    /// Redraw the waveforms from the current sample
+    void updateWaveforms();
 
     bool keypress(ui::Key) override;
     void rotary(ui::RotaryEvent) override;
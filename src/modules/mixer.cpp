@@ -19,19 +19,24 @@ namespace top1::modules {
 
   // Mixing!
 
+  TapeMix Mixer::mix() const {
+    TapeMix mix;
+    for (int t = 0; t < nTapeTracks; t++) {
+      mix.tracks[t] = {props.tracks[t].level.get(), props.tracks[t].pan.get(),
+                       props.tracks[t].muted.get()};
+    }
+    return mix;
+  }
+
   void Mixer::process(const audio::ProcessData& data) {
     TIME_SCOPE("Mixer::Process");
     auto &trackBuffer = Globals::tapedeck.trackBuffer;
-    auto level = generate_sequence<4>([this] (int n) { return props.tracks[n].level.get(); });
-    auto pan = generate_sequence<4>([this] (int n) { return props.tracks[n].pan.get(); });
+    auto mix = this->mix();
     for (uint f = 0; f < data.nframes; f++) {
       float lMix = 0, rMix = 0;
-      for (uint t = 0; t < 4 ; t++) {
-        if (!props.tracks[t].muted) {
-          lMix += trackBuffer[f][t] * level[t] * (1-pan[t]);
-          rMix += trackBuffer[f][t] * level[t] * (1+pan[t]);
-        }
-        graphs[t].add(trackBuffer[f][t] * level[t]);
+      mix.mixFrame(trackBuffer[f], lMix, rMix);
+      for (uint t = 0; t < nTapeTracks ; t++) {
+        graphs[t].add(trackBuffer[f][t] * mix.tracks[t].level);
       }
       data.audio.outL[f] =
         lMix + data.audio.proc[f] * Globals::tapedeck.props.gain;
@@ -46,33 +51,38 @@ namespace top1::modules {
 
   using namespace ui::drawing;
 
+  /// The track controlled by knob `n` (from 0), in the bank of the track
+  /// selected on the tapedeck
+  static std::optional<Track> knobTrack(int n) {
+    return Track::inBank(Globals::tapedeck.state.track.bank(), n);
+  }
+
   void MixerScreen::draw(ui::drawing::Canvas& ctx) {
 
-    drawMixerSegment(ctx, 1, 18, 32.5);
-    drawMixerSegment(ctx, 2, 93, 32.5);
-    drawMixerSegment(ctx, 3, 168, 32.5);
-    drawMixerSegment(ctx, 4, 243, 32.5);
+    const float x[Track::BankSize] = {18, 93, 168, 243};
+    for (uint n = 0; n < Track::BankSize; n++) {
+      if (auto track = knobTrack(n)) {
+        drawMixerSegment(ctx, track->name(), x[n], 32.5);
+      }
+    }
 
   }
 
   bool MixerScreen::keypress(ui::Key key) {
     using namespace ui;
+    int knob;
     switch (key) {
-    case K_BLUE_CLICK:
-      module->props.tracks[0].muted.step();
-      return true;
-    case K_GREEN_CLICK:
-      module->props.tracks[1].muted.step();
-      return true;
-    case K_WHITE_CLICK:
-      module->props.tracks[2].muted.step();
-      return true;
-    case K_RED_CLICK:
-      module->props.tracks[3].muted.step();
-      return true;
+    case K_BLUE_CLICK:  knob = 0; break;
+    case K_GREEN_CLICK: knob = 1; break;
+    case K_WHITE_CLICK: knob = 2; break;
+    case K_RED_CLICK:   knob = 3; break;
     default:
       return false;
     }
+    if (auto track = knobTrack(knob)) {
+      module->props.tracks[track->idx].muted.step();
+    }
+    return true;
   }
 
   bool MixerScreen::keyrelease(ui::Key key) {
@@ -81,22 +91,25 @@ namespace top1::modules {
   }
 
   void MixerScreen::rotary(ui::RotaryEvent e) {
+    auto track = knobTrack(static_cast<int>(e.rotary));
+    if (!track) return;
     if (Globals::ui.keys[ui::K_SHIFT]) {
-      module->props.tracks[static_cast<int>(e.rotary)].pan.step(e.clicks);
+      module->props.tracks[track->idx].pan.step(e.clicks);
     } else {
-      module->props.tracks[static_cast<int>(e.rotary)].level.step(e.clicks);
+      module->props.tracks[track->idx].level.step(e.clicks);
     }
   }
 
   void MixerScreen::drawMixerSegment(ui::drawing::Canvas& ctx,
                                      int track, float x, float y) {
 
+    // The colour of the knob
     Colour trackCol;
-    switch (track) {
-    case 1: trackCol = Colours::Blue; break;
-    case 2: trackCol = Colours::Green; break;
-    case 3: trackCol = Colours::White; break;
-    case 4: trackCol = Colours::Red; break;
+    switch ((track - 1) % Track::BankSize) {
+    case 0: trackCol = Colours::Blue; break;
+    case 1: trackCol = Colours::Green; break;
+    case 2: trackCol = Colours::White; break;
+    case 3: trackCol = Colours::Red; break;
     }
     Colour muteCol = (module->props.tracks[track-1].muted) ? Colours::Red : Colours::Gray60;
     float mix = module->props.tracks[track-1].level;
@@ -8,6 +8,8 @@
 
 #include "util/algorithm.hpp"
 #include "util/audio.hpp"
+#include "util/tape-config.hpp"
+#include "util/bounce.hpp"
 
 namespace top1::modules {
   class MixerScreen;
@@ -24,18 +26,21 @@ namespace top1::modules {
         using Properties::Properties;
       };
 
-      std::array<TrackInfo, 4> tracks = generate_sequence<4>([this] (int n) -> TrackInfo {
+      std::array<TrackInfo, nTapeTracks> tracks = generate_sequence<nTapeTracks>([this] (int n) -> TrackInfo {
           return TrackInfo(this, fmt::format("Track {}", n + 1));
         });
     } props;
 
-    std::array<audio::Graph, 4> graphs;
+    std::array<audio::Graph, nTapeTracks> graphs;
 
     Mixer();
 
     void display();
 
     void process(const audio::ProcessData&);
+
+    /// The current settings, as used by <process>
+    TapeMix mix() const;
   };
 
   class MixerScreen : public ui::ModuleScreen<Mixer> {
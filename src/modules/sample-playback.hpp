@@ -0,0 +1,63 @@
+#pragma once
+
+#include <algorithm>
+#include <gsl/span>
+
+namespace top1::modules {
+
+  /**
+   * Add a mono sample to `out`, as the samplers play it.
+   *
+   * Plays `sample` from `progress`, stepping `speed` frames for each frame
+   * of output, backwards unless `fwd` is set. When `loop` is set, playback
+   * wraps around at the end, otherwise it stops there.
+   *
+   * Samples are converted to the samplerate of the audio system when they
+   * are loaded, so at unity speed this is a plain sum of whole frames.
+   *
+   * @return The progress to continue from, or -1 when the end was reached
+   */
+  inline float play_sample(gsl::span<float> out, gsl::span<const float> sample,
+                           float progress, float speed, bool fwd, bool loop)
+  {
+    const int len = sample.size();
+    const int n = out.size();
+    if (len <= 0) return -1;
+    if (!fwd) progress = std::min<float>(progress, len - 1);
+    auto atEnd = [&] (auto p) { return fwd ? p >= len : p < 0; };
+    const float start = fwd ? 0 : len - 1;
+
+    if (speed == 1 && progress == int(progress)) {
+      int p = progress;
+      for (int i = 0; i < n;) {
+        if (atEnd(p)) {
+          if (!loop) return -1;
+          p = start;
+        }
+        int k = std::min(n - i, fwd ? len - p : p + 1);
+        if (fwd) {
+          for (int j = 0; j < k; j++) out[i + j] += sample[p + j];
+          p += k;
+        } else {
+          for (int j = 0; j < k; j++) out[i + j] += sample[p - j];
+          p -= k;
+        }
+        i += k;
+      }
+      progress = p;
+    } else {
+      const float step = fwd ? speed : -speed;
+      for (int i = 0; i < n; i++) {
+        if (atEnd(progress)) {
+          if (!loop) return -1;
+          progress = start;
+        }
+        out[i] += sample[int(progress)];
+        progress += step;
+      }
+    }
+    if (atEnd(progress)) return loop ? start : -1;
+    return progress;
+  }
+
+} // top1::modules
@@ -20,10 +20,12 @@ namespace top1::modules {
 
   void SimpleDrumsModule::process(const audio::ProcessData& data) {
     for (auto &&nEvent : data.midi) {
-      nEvent.match([&] (midi::NoteOnEvent& e) {
+      match(nEvent, [&] (midi::NoteOnEvent& e) {
           currentVoiceIdx = e.key % 24;
           voices[currentVoiceIdx].props.trigger = true;
           voices[currentVoiceIdx].props.envelope.sustain = float(e.velocity)/128.f;
+        }, [&] (midi::NoteOffEvent& e) {
+          voices[e.key % 24].props.trigger = false;
         }, [] (auto&&) {});
     }
     for (auto &&voice : voices) {
@@ -34,11 +36,6 @@ namespace top1::modules {
           out += in;
         });
     }
-    for (auto &&nEvent : data.midi) {
-      nEvent.match([&] (midi::NoteOffEvent& e) {
-          voices[e.key % 24].props.trigger = false;
-        }, [] (auto&&) {});
-    };
   }
 
   top1::tree::Node SimpleDrumsModule::makeNode() {
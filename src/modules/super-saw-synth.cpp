@@ -16,27 +16,24 @@ namespace top1::modules {
 
   void SuperSawSynth::process(const audio::ProcessData& data) {
     for (auto &&nEvent : data.midi) {
-      nEvent.match([&] (midi::NoteOnEvent& e) {
+      match(nEvent, [&] (midi::NoteOnEvent& e) {
           if (e.channel == 0) {
             props.key = e.key;
             props.trigger = 1;
             props.velocity = float(e.velocity)/128.f;
           }
-        }, [] (auto&&) {});
-    }
-    buf.clear();
-    FaustSynthModule::process({buf.data(), data.nframes});
-    for_both(buf.begin(), buf.end(), data.audio.proc.begin(),
-      data.audio.proc.end(), [] (auto in, auto& out) {out += in;});
-    for (auto &&nEvent : data.midi) {
-      nEvent.match([&] (midi::NoteOffEvent& e) {
+        }, [&] (midi::NoteOffEvent& e) {
           if (e.channel == 0) {
             if (e.key == props.key) {
               props.trigger = 0;
             }
           }
         }, [] (auto&&) {});
-    };
+    }
+    buf.clear();
+    FaustSynthModule::process({buf.data(), data.nframes});
+    for_both(buf.begin(), buf.end(), data.audio.proc.begin(),
+      data.audio.proc.end(), [] (auto in, auto& out) {out += in;});
   }
 
 } // top1::modules
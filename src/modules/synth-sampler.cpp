@@ -6,19 +6,20 @@
 #include "core/ui/drawing.hpp"
 #include "core/ui/icons.hpp"
 #include "core/globals.hpp"
-#include "util/soundfile.hpp"
+#include "modules/sample-playback.hpp"
 
 namespace top1::modules {
 
   SynthSampler::SynthSampler() :
     SynthModule(&props),
     maxSampleSize (16 * Globals::samplerate),
-    sampleData (maxSampleSize),
     editScreen (new SynthSampleScreen(this)) {
 
     Globals::events.samplerateChanged.add([&] (uint sr) {
         maxSampleSize = 16 * sr;
-        sampleSpeed = sampleSampleRate / float(sr);
+        // Samples are stored at the samplerate they were loaded for
+        auto current = sample.current();
+        if (current && int(sr) != current->samplerate) load();
       });
 
   }
@@ -33,58 +34,12 @@ namespace top1::modules {
 
   void SynthSampler::process(const audio::ProcessData& data) {
     for (auto &&nEvent : data.midi) {
-      nEvent.match([&] (midi::NoteOnEvent& e) {
+      match(nEvent, [&] (midi::NoteOnEvent& e) {
           if (e.channel == 0) {
             props.playProgress = (props.fwd()) ? 0 : props.length() - 1;
             props.trigger = true;
           }
-        }, [] (auto) {});
-    }
-
-    float playSpeed = props.speed * sampleSpeed;
-
-    // Process audio
-    if (props.playProgress >= 0 && playSpeed > 0) {
-      if (props.fwd()) {
-        if (props.loop() && props.trigger) {
-          for(int i = 0; i < data.nframes; ++i) {
-            data.audio.proc[i] += sampleData[props.in + props.playProgress];
-            props.playProgress += playSpeed;
-            if (props.playProgress >= props.length()) {
-              props.playProgress = 0;
-            }
-          }
-        } else {
-          int frms = std::min<int>(data.nframes, props.length() - props.playProgress);
-          for(int i = 0; i < frms; ++i) {
-            data.audio.proc[i] += sampleData[props.in + props.playProgress];
-            props.playProgress += playSpeed;
-          }
-          if (props.playProgress >= props.length()) {
-            props.playProgress = -1;
-          }
-        }
-      } else {
-        if (props.loop() && props.trigger) {
-          for(int i = 0; i < data.nframes; ++i) {
-            data.audio.proc[i] += sampleData[props.in + props.playProgress];
-            props.playProgress -= playSpeed;
-            if (props.playProgress < 0) {
-              props.playProgress = props.length() -1;
-            }
-          }
-        } else {
-          int frms = std::min<int>(data.nframes, props.playProgress);
-          for(int i = 0; i < frms; ++i) {
-            data.audio.proc[i] += sampleData[props.in + props.playProgress];
-            props.playProgress -= playSpeed;
-          }
-        }
-      }
-    }
-
-    for (auto &&nEvent : data.midi) {
-      nEvent.match([&] (midi::NoteOffEvent& e) {
+        }, [&] (midi::NoteOffEvent& e) {
           if (e.channel == 0) {
             props.trigger = false;
             if (props.stop()) {
@@ -92,7 +47,25 @@ namespace top1::modules {
             }
           }
         }, [] (auto) {});
-    };
+    }
+
+    unsigned swaps = sample.swapCount();
+    const auto* playing = sample.acquire();
+    // Fit the ranges here, as the screen and this thread use them
+    if (swaps != rangesFitTo) {
+      assignRange(playing ? playing->frames.size() : 0);
+      rangesFitTo = swaps;
+      sampleChanged = true;
+    }
+    if (playing && props.playProgress >= 0 && props.speed > 0) {
+      gsl::span<const float> frames = playing->frames;
+      int in = std::clamp<int>(props.in, 0, frames.size());
+      int out = std::clamp<int>(props.out, in, frames.size());
+      props.playProgress = play_sample(data.audio.proc.first(data.nframes),
+        frames.subspan(in, out - in), props.playProgress, props.speed,
+        props.fwd(), props.loop() && props.trigger);
+    }
+    sample.release();
   }
 
   void SynthSampler::display() {
@@ -100,24 +73,13 @@ namespace top1::modules {
   }
 
   void SynthSampler::load() {
+    const std::string& name = props.sampleName;
+    if (name.empty()) LOGI << "Empty sampleName";
+    sample.load(Globals::samplePool, name.empty() ? fs::path() : samplePath(name),
+                Globals::samplerate, maxSampleSize);
+  }
 
-    auto path = samplePath(props.sampleName);
-    std::size_t rs = 0;
-    if (!(path.empty() || props.sampleName.get().empty())) {
-      SoundFile sf;
-      sf.open(path);
-      rs = std::min<int>(maxSampleSize, sf.length());
-      sampleData.resize(rs);
-      sf.read_samples(sampleData.data(), rs);
-
-      sampleSampleRate = sf.info.samplerate;
-      sampleSpeed = sampleSampleRate / float(Globals::samplerate);
-      if (sf.length() == 0) LOGD << "Empty sample file";
-    } else {
-      sampleData.resize(0);
-      LOGI << "Empty sampleName";
-    }
-
+  void SynthSampler::assignRange(std::size_t rs) {
     props.in.mode.max = rs;
     props.out.mode.max = rs;
 
@@ -126,23 +88,12 @@ namespace top1::modules {
       props.in = 0;
       props.out = rs;
     }
-
-    auto &mwf = editScreen->mainWF;
-    mwf->clear();
-    for (auto &&s : sampleData) {
-      mwf->addFrame(s);
-    }
-
-    auto &wf = editScreen->topWF;
-    wf->clear();
-    for (auto &&s : sampleData) {
-      wf->addFrame(s);
-    }
-    editScreen->topWFW.viewRange = {0, wf->size() - 1};
   }
 
   void SynthSampler::init() {
+    // Start with the sample in place
     load();
+    sample.wait();
   }
 } // top1::module
 
@@ -189,15 +140,30 @@ namespace top1::modules {
 
   SynthSampleScreen::SynthSampleScreen(SynthSampler *m) :
     ui::ModuleScreen<SynthSampler> (m),
-    topWF (new audio::Waveform(module->sampleData.size() / ui::drawing::topWFsize.w / 4.0, 1.0)
+    topWF (new audio::Waveform(module->maxSampleSize / ui::drawing::topWFsize.w / 4.0, 1.0)
            ),
     topWFW (topWF, ui::drawing::topWFsize),
     mainWF (new audio::Waveform(50, 1.0)),
     mainWFW (mainWF, ui::drawing::mainWFsize) {}
 
+  void SynthSampleScreen::updateWaveforms() {
+    auto sample = module->sample.current();
+    mainWF->clear();
+    topWF->clear();
+    if (sample) {
+      for (auto &&s : sample->frames) {
+        mainWF->addFrame(s);
+        topWF->addFrame(s);
+      }
+    }
+    topWFW.viewRange = {0, topWF->size() - 1};
+  }
+
   void modules::SynthSampleScreen::draw(ui::drawing::Canvas &ctx) {
     using namespace ui::drawing;
 
+    if (module->sampleChanged.exchange(false)) updateWaveforms();
+
     Colour colourCurrent;
     auto& props = module->props;
 
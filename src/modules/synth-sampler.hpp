@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <fmt/format.h>
 
 #include "filesystem.hpp"
@@ -7,8 +8,7 @@
 #include "core/ui/canvas.hpp"
 #include "core/ui/module-ui.hpp"
 #include "core/ui/waveform-widget.hpp"
-
-#include "util/dyn-array.hpp"
+#include "util/sample-slot.hpp"
 
 namespace top1::modules {
 
@@ -18,9 +18,12 @@ namespace top1::modules {
   public:
 
     size_t maxSampleSize = 0;
-    top1::DynArray<float> sampleData;
-    int sampleSampleRate = 44100;
-    float sampleSpeed = 1;
+    /// Shared with the other samplers through <Globals::samplePool>.
+    /// Empty when no sample is loaded
+    audio::SampleSlot sample;
+    /// Set when the audio thread starts playing a new sample, and has fit
+    /// the ranges to it, for the screen to update
+    std::atomic_bool sampleChanged {false};
 
     std::unique_ptr<SynthSampleScreen> editScreen;
 
@@ -58,11 +61,21 @@ namespace top1::modules {
 
     void display() override;
 
+    /// Load the sample named by the props on a background thread, without
+    /// waiting. The old sample plays until the new one is ready
     void load();
 
     void init() override;
 
     static fs::path samplePath(std::string name);
+
+  private:
+
+    /// Fit the range to a sample of `size` frames
+    void assignRange(std::size_t size);
+
+    /// The <audio::SampleSlot::swapCount> the ranges were fit to
+    unsigned rangesFitTo = 0;
   };
 
   class SynthSampleScreen : public ui::ModuleScreen<SynthSampler> {
@@ -76,6 +89,8 @@ namespace top1::modules {
     SynthSampleScreen(SynthSampler *);
 
     void draw(ui::drawing::Canvas&) override;
+    /// Redraw the waveforms from the current sample
+    void updateWaveforms();
 
     bool keypress(ui::Key) override;
     void rotary(ui::RotaryEvent) override;
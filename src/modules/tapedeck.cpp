@@ -88,7 +88,7 @@ namespace top1::modules {
     tapeScreen (new TapeScreen(this)) {}
 
   void Tapedeck::init() {
-    tapeBuffer.init();
+    tapeBuffer.init(Globals::data_dir / "tape.wav", Globals::offline);
     display();
   }
 
@@ -130,22 +130,22 @@ namespace top1::modules {
   void Tapedeck::goToLoopIn() {
     if (state.recording()) return;
     if (loopSect.in < 0) return;
-    tapeBuffer.goTo(loopSect.in);
+    tapeBuffer.requestGoTo(loopSect.in);
   }
 
   void Tapedeck::goToLoopOut() {
     if (state.recording()) return;
     if (loopSect.out < 0) return;
-    tapeBuffer.goTo(loopSect.out);
+    tapeBuffer.requestGoTo(loopSect.out);
   }
 
 
   void Tapedeck::goToBar(BeatPos bar) {
-    if (state.doJumps()) tapeBuffer.goTo(Globals::metronome.getBarTime(bar));
+    if (state.doJumps()) tapeBuffer.requestGoTo(Globals::metronome.getBarTime(bar));
   }
 
   void Tapedeck::goToBarRel(BeatPos bars) {
-    if (state.doJumps()) tapeBuffer.goTo(Globals::metronome.getBarTimeRel(bars));
+    if (state.doJumps()) tapeBuffer.requestGoTo(Globals::metronome.getBarTimeRel(bars));
   }
 
   int Tapedeck::timeUntil(TapeTime tt) {
@@ -168,6 +168,10 @@ namespace top1::modules {
   // Audio Processing
   void Tapedeck::preProcess(const audio::ProcessData& data) {
 
+    tapeBuffer.applyPendingJump();
+    tapeBuffer.setLoop(state.looping && loopSect.size() > 0
+                       ? loopSect : TapeBuffer::TapeSlice{});
+    tapeBuffer.syncDisk();
     tapePosition = tapeBuffer.position();
     {
       constexpr uint time = 200; // animation time from 0 to 1 in ms
@@ -200,34 +204,54 @@ namespace top1::modules {
     trackBuffer.clear();
 
     auto playAudio = [this](uint at, uint nframes) {
-      state.forPlayDir<void>([&] {
-          uint readSize = nframes * state.playSpeed;
-          auto data = tapeBuffer.readFW(readSize);
-          if (readSize == 0) data.emplace_back(0);
-          // TODO: This is bad, its an overflow, fix it goddammit!
-          // Happens every time a loop is longer than the tapebuffer
-          while (data.size() < readSize) data.emplace_back(0);
-          for (uint i = 0; i < nframes; i++) {
-            trackBuffer[at + i] = data[i * state.playSpeed];
-          }
-        }, [&] {
-          uint readSize = nframes * -state.playSpeed;
-          if (tapeBuffer.position() == 0) readSize = 0;
-          auto data = tapeBuffer.readBW(readSize);
-          if (readSize == 0) data.emplace_back(0);
-          // TODO: This is bad, its an overflow, fix it goddammit!
-          // Happens every time a loop is longer than the tapebuffer
-          while (data.size() < readSize) data.emplace_back(0);
-          for (uint i = 0; i < nframes; i++) {
-            trackBuffer[at + i] = data[i * -state.playSpeed];
-          }
-        });
+      gsl::span<AudioFrame> out = {trackBuffer.data() + at, nframes};
+      float speed = std::abs(state.playSpeed);
+      if (state.playSpeed < 0 && tapeBuffer.position() == 0) {
+        std::fill(out.begin(), out.end(), AudioFrame{});
+        return;
+      }
+      if (speed == 1) {
+        state.forPlayDir<void>([&] { tapeBuffer.readFW(out); },
+                               [&] { tapeBuffer.readBW(out); });
+        resamplerDir = 0;
+        return;
+      }
+      gsl::span<AudioFrame> work = {readBuffer.data(), readBuffer.size()};
+      auto read = [&] (gsl::span<AudioFrame> in) {
+        state.forPlayDir<void>([&] { tapeBuffer.readFW(in); },
+                               [&] { tapeBuffer.readBW(in); });
+      };
+      int dir = state.playSpeed > 0 ? 1 : -1;
+      TapeTime pos = tapeBuffer.position();
+      if (pos == resamplerPos && dir == resamplerDir) {
+        // Skip the frames the resampler has read already
+        tapeBuffer.goTo(pos + dir * resampler.ahead());
+      } else {
+        // The history is no good after a jump or a change of direction.
+        // Read it from the tape before the playPoint instead.
+        resampler.reset(work, [&] (gsl::span<AudioFrame> history) {
+            constexpr int size = decltype(resampler)::History;
+            // Before the start of the tape, it is silence
+            int silent = dir > 0 ? std::max(size - pos, 0) : 0;
+            std::fill(history.begin(), history.begin() + silent, AudioFrame{});
+            tapeBuffer.goTo(pos - dir * (size - silent));
+            read(history.subspan(silent));
+          });
+      }
+      resampler.interpolation =
+        decltype(resampler)::Interpolation(props.interpolation.get());
+      resampler.process(out, speed, work, read);
+      // Keep the playPoint at what is heard, not at what the resampler has
+      // read ahead, so the loop points and recording line up with the audio
+      tapeBuffer.goTo(tapeBuffer.position() - dir * resampler.ahead());
+      resamplerPos = tapeBuffer.position();
+      resamplerDir = dir;
     };
 
     // Start recording by pressing a key
     if (!state.recording() && state.doStartRec() && state.readyToRec) {
-      for (auto event : data.midi) {
-        if (event.is<midi::NoteOnEvent>()) {
+      for (auto&& event : data.midi) {
+        if (std::holds_alternative<midi::NoteOnEvent>(event)) {
           state.play(1);
           break;
         }
@@ -257,31 +281,48 @@ namespace top1::modules {
 
   void Tapedeck::postProcess(const audio::ProcessData& data) {
     TapeTime pos = tapeBuffer.position();
-    if (!state.recording() && state.recLast) {
-      recSect = {0,0};
-    }
+    tapeBuffer.flushPendingWrites();
+    tapeBuffer.applyPendingUndo();
+    tapeBuffer.applyPendingJob();
+    tapeBuffer.applyPendingCut();
+
+    // Without overdub, recording replaces the track. It punches in with a
+    // crossfade over the first period, and out with one over the period
+    // after recording stopped, so there are no clicks at either end
+    bool replace = !props.overdub;
+    bool punchIn = replace && state.recording() && !state.recLast;
+    bool punchOut = replace && !state.recording() && state.recLast;
+    auto mode = TapeBuffer::WriteMode::Overdub;
+    if (punchIn || punchOut) mode = TapeBuffer::WriteMode::Crossfade;
+    else if (replace) mode = TapeBuffer::WriteMode::Overwrite;
+    // The crossfade gain at a frame of the period
+    auto fadeAt = [&] (uint frame) {
+      float g = frame / float(data.nframes);
+      return punchOut ? 1 - g : g;
+    };
+
     auto recAudio = [&](uint from, uint recFrames) {
-      std::vector<AudioFrame> buf;
+      audio::Section<float> fade = {fadeAt(from), fadeAt(from + recFrames)};
       state.forPlayDir<void>([&] {
-          uint writeSize = recFrames * state.playSpeed;
+          uint writeSize = std::min<uint>(recFrames * state.playSpeed, writeBuffer.size());
           for (uint i = 0; i < writeSize; i++) {
-            buf.push_back(data.audio.proc[int(from + i / state.playSpeed)]);
+            writeBuffer[i] = data.audio.proc[int(from + i / state.playSpeed)];
           }
-          tapeBuffer.writeFW(buf, (data.nframes - from) * state.playSpeed - writeSize,
-                             [this](AudioFrame o, AudioFrame n) {
-                               return o[state.track.idx] + n[state.track.idx];});
+          overruns += tapeBuffer.writeFW({writeBuffer.data(), writeSize},
+            state.track, mode,
+            (data.nframes - from) * state.playSpeed - writeSize, fade);
           if (recSect.size() < 1) {
             recSect.in = pos - (data.nframes - from) * state.playSpeed;
           }
           recSect.out = pos - (data.nframes - from) * state.playSpeed + writeSize;
         }, [&] {
-          uint writeSize = recFrames * -state.playSpeed;
+          uint writeSize = std::min<uint>(recFrames * -state.playSpeed, writeBuffer.size());
           for (uint i = 0; i < writeSize; i++) {
-            buf.push_back(data.audio.proc[int(from + i / -state.playSpeed)]);
+            writeBuffer[i] = data.audio.proc[int(from + i / -state.playSpeed)];
           }
-          tapeBuffer.writeBW(buf, (data.nframes - from) * state.playSpeed - writeSize,
-                             [this](AudioFrame o, AudioFrame n) {
-                               return o[state.track.idx] + n[state.track.idx];});
+          overruns += tapeBuffer.writeBW({writeBuffer.data(), writeSize},
+            state.track, mode,
+            (data.nframes - from) * -state.playSpeed - writeSize, fade);
           if (recSect.size() < 1) {
             recSect.out = pos + (data.nframes - from) * -state.playSpeed;
           }
@@ -290,7 +331,11 @@ namespace top1::modules {
       tapeBuffer.trackSlices[state.track.idx].addSlice(recSect);
     };
 
-    if (state.recording()) {
+    if (state.recording() || punchOut) {
+      if (!state.recLast) {
+        // Each recording pass can be undone on its own
+        tapeBuffer.beginEdit(state.track);
+      }
       if (state.doLoop() && state.looping) {
         TapeTime leftTillOut = state.forPlayDir<TapeTime>(
                                                           [&] {return loopSect.out - pos;},
@@ -309,6 +354,9 @@ namespace top1::modules {
         recAudio(0, data.nframes);
       }
     }
+    if (!state.recording() && state.recLast) {
+      recSect = {0,0};
+    }
     state.recLast = state.recording();
 
     for (uint i = 0; i < data.nframes; i++) {
@@ -332,16 +380,10 @@ namespace top1::modules {
       }
       return false;
     case ui::K_TRACK_1:
-      module->state.track = Track::makeName(1);
-      return true;
     case ui::K_TRACK_2:
-      module->state.track = Track::makeName(2);
-      return true;
     case ui::K_TRACK_3:
-      module->state.track = Track::makeName(3);
-      return true;
     case ui::K_TRACK_4:
-      module->state.track = Track::makeName(4);
+      module->state.track = module->state.track.select(key - ui::K_TRACK_1, shift);
       return true;
     case ui::K_LEFT:
       if (shift) module->goToBarRel(-1);
@@ -364,8 +406,7 @@ namespace top1::modules {
       return true;
     case ui::K_CUT:
       if (module->state.doTapeOps())
-        module->tapeBuffer.trackSlices[module->state.track.idx].cut(
-                                                                    module->tapeBuffer.position());
+        module->tapeBuffer.cut(module->state.track);
       return true;
     case ui::K_LIFT:
       if (module->state.doTapeOps())
@@ -375,6 +416,10 @@ namespace top1::modules {
       if (module->state.doTapeOps())
         module->tapeBuffer.drop(module->state.track);
       return true;
+    case ui::K_UNDO:
+      if (module->state.doTapeOps())
+        module->tapeBuffer.undo();
+      return true;
     default:
       return false;
     }
@@ -383,6 +428,7 @@ namespace top1::modules {
   void TapeScreen::rotary(ui::RotaryEvent e) {
     switch (e.rotary) {
     case ui::Rotary::Blue:
+      module->props.overdub.step(e.clicks);
       break;
     case ui::Rotary::Green:
       break;
@@ -423,6 +469,7 @@ namespace top1::ui::drawing {
     const Colour OtherTrack = 0x505050;
     const Colour LoopMarker = Green;
     const Colour BarMarker = Gray70;
+    const Colour Waveform = Gray60;
 
   }
 }
@@ -826,11 +873,13 @@ namespace top1::modules {
       }
     }
 
-    // Tracks
+    // Tracks, squeezed together when there are more than four
+    const float laneHeight = std::min(5.f, 20.f / nTapeTracks);
     Track::foreach([&](Track t){
         auto slices = module->tapeBuffer.trackSlices[t.idx].slicesIn(inView);
         TapeBuffer::TapeSlice current;
-        float lW = 3;
+        float lW = std::min(3.f, laneHeight);
+        float y = 195 + laneHeight * t.idx;
         for (auto slice : slices) {
           Colour col;
           if (t == module->state.track) {
@@ -852,8 +901,8 @@ namespace top1::modules {
               ctx.beginPath();
               ctx.strokeStyle(col);
               ctx.lineWidth(lW);
-              ctx.moveTo(timeToCoord(std::max<float>(inView.in, slice.in)), 195 + 5*t.idx);
-              ctx.lineTo(timeToCoord(std::min<float>(inView.out, slice.out)), 195 + 5*t.idx);
+              ctx.moveTo(timeToCoord(std::max<float>(inView.in, slice.in)), y);
+              ctx.lineTo(timeToCoord(std::min<float>(inView.out, slice.out)), y);
               ctx.stroke();
             }
           }
@@ -866,11 +915,30 @@ namespace top1::modules {
             ctx.beginPath();
             ctx.strokeStyle(Colours::CurrentSlice);
             ctx.lineWidth(lW);
-            ctx.moveTo(timeToCoord(std::max<float>(inView.in, current.in)), 195 + 5*t.idx);
-            ctx.lineTo(timeToCoord(std::min<float>(inView.out, current.out)), 195 + 5*t.idx);
+            ctx.moveTo(timeToCoord(std::max<float>(inView.in, current.in)), y);
+            ctx.lineTo(timeToCoord(std::min<float>(inView.out, current.out)), y);
             ctx.stroke();
           }
         }
+
+        // Waveform, drawn over the slices
+        {
+          using PeakPyramid = audio::PeakPyramid<nTapeTracks>;
+          constexpr int columns = 110;
+          std::array<TapeBuffer::Peak, columns> peaks;
+          module->tapeBuffer.peaks(t, inView, peaks);
+          float colWidth = float(coordWidth) / columns;
+          ctx.beginPath();
+          ctx.strokeStyle(Colours::Waveform);
+          ctx.lineWidth(1);
+          for (int i = 0; i < columns; i++) {
+            if (peaks[i].min == 0 && peaks[i].max == 0) continue;
+            float x = startCoord + (i + 0.5) * colWidth;
+            ctx.moveTo(x, y - laneHeight / 2 * PeakPyramid::toFloat(peaks[i].max));
+            ctx.lineTo(x, y - laneHeight / 2 * PeakPyramid::toFloat(peaks[i].min));
+          }
+          ctx.stroke();
+        }
       });
 
     // LoopArrow
@@ -1107,6 +1175,16 @@ namespace top1::modules {
     ctx.beginPath();
     ctx.fillText(module->tapeBuffer.timeStr(), 160, 30);
 
+    // Progress of a lift or drop
+    if (float progress = module->tapeBuffer.clipboardProgress(); progress < 1) {
+      ctx.beginPath();
+      ctx.strokeStyle(Colours::White);
+      ctx.lineWidth(1.5);
+      ctx.moveTo(110, 52);
+      ctx.lineTo(110 + 100 * progress, 52);
+      ctx.stroke();
+    }
+
     // #rect4292
     ctx.beginPath();
     ctx.globalAlpha(1.0);
@@ -8,6 +8,7 @@
 #include "core/ui/canvas.hpp"
 #include "core/ui/module-ui.hpp"
 #include "util/tapebuffer.hpp"
+#include "util/resampler.hpp"
 
 
 namespace top1::modules {
@@ -73,13 +74,33 @@ namespace top1::modules {
 
     struct Props : Properties {
       Property<float> gain = {this, "PROC_GAIN", 0.5, {0, 1, 0.01}};
+      /// A <audio::Resampler::Interpolation>, used when not at normal speed
+      Property<int> interpolation = {this, "INTERPOLATION", 1, {0, 2, 1}};
+      /// Add recordings to the track. Otherwise they replace it, with a
+      /// crossfade at either end
+      Property<bool> overdub = {this, "OVERDUB", true};
     } props;
 
     audio::Graph procGraph;
 
-    using AudioFrame = audio::AudioFrame<4, float>;
+    using AudioFrame = TapeFrame;
     audio::RTBuffer<AudioFrame> trackBuffer;
 
+    /// The fastest the tape can spool, in either direction
+    static constexpr uint maxSpeed = 5;
+    /// Raw frames read from the tape when playing at speeds other than 1.
+    /// One period extra, as room for the resampler history and lookahead
+    audio::RTBuffer<AudioFrame> readBuffer {maxSpeed + 1};
+    audio::Resampler<nTapeTracks, float> resampler;
+    /// Where, and in which direction, the resampler left the tape.
+    /// The playPoint is kept at the frame heard next, so this excludes the
+    /// frames the resampler has read ahead. If the tape has moved since,
+    /// the resampler history is read again.
+    TapeTime resamplerPos = 0;
+    int resamplerDir = 0;
+    /// Recorded samples, stretched to the tape speed
+    audio::RTBuffer<float> writeBuffer {maxSpeed};
+
     top1::TapeBuffer tapeBuffer;
 
     Tapedeck();
@@ -92,6 +113,7 @@ namespace top1::modules {
     audio::Section<top1::TapeTime> loopSect;
     audio::Section<top1::TapeTime> recSect;
 
+    /// Recorded frames the tape had no room for
     uint overruns = 0;
 
     void preProcess(const audio::ProcessData&);
@@ -0,0 +1,85 @@
+#include "bounce.hpp"
+
+#include <future>
+#include <thread>
+#include <vector>
+#include <plog/Log.h>
+
+#include "util/tapefile.hpp"
+
+namespace top1 {
+
+  /// Frames mixed by a worker at a time
+  constexpr int BlockFrames = 1 << 16;
+
+  void bounce(const fs::path& tapePath, const fs::path& outPath,
+              const TapeMix& mix, int threads, std::function<void(float)> progress) {
+    // Opening would create an empty tape
+    if (!fs::exists(tapePath)) {
+      throw ByteFile::Error(ByteFile::Error::Type::FileNotOpen, tapePath.string());
+    }
+    if (threads <= 0) {
+      threads = std::max<int>(std::thread::hardware_concurrency(), 1);
+    }
+
+    TapeFile tape;
+    tape.open(tapePath);
+    int length = tape.length_frames();
+
+    SoundFile out;
+    fs::remove(outPath);
+    out.info.channels = 2;
+    out.info.samplerate = tape.info.samplerate;
+    out.open(outPath);
+    out.seek(0);
+
+    LOGI << "Bouncing " << length << " frames to " << outPath
+         << " on " << threads << " threads";
+
+    // A batch is a block per thread. One batch is read while the
+    // other is mixed and written
+    int batchFrames = threads * BlockFrames;
+    std::vector<TapeFrame> input[2] = {
+      std::vector<TapeFrame>(batchFrames), std::vector<TapeFrame>(batchFrames)};
+    std::vector<float> output(2 * batchFrames);
+
+    auto read = [&] (int batch) {
+      int from = batch * batchFrames;
+      int n = std::clamp(length - from, 0, batchFrames);
+      tape.seek_frame(from);
+      tape.read_frames(input[batch % 2].data(), n);
+      return n;
+    };
+
+    int batch = 0;
+    int n = read(batch);
+    while (n > 0) {
+      auto next = std::async(std::launch::async, read, batch + 1);
+
+      auto&& frames = input[batch % 2];
+      std::vector<std::future<void>> workers;
+      for (int from = 0; from < n; from += BlockFrames) {
+        workers.push_back(std::async(std::launch::async, [&, from] {
+          int to = std::min(from + BlockFrames, n);
+          for (int i = from; i < to; i++) {
+            float l = 0, r = 0;
+            mix.mixFrame(frames[i], l, r);
+            output[2 * i] = l;
+            output[2 * i + 1] = r;
+          }
+        }));
+      }
+      for (auto&& w : workers) w.get();
+
+      out.write_samples(output.data(), 2 * n);
+      batch++;
+      n = next.get();
+      if (progress) progress(std::min(batch * float(batchFrames) / length, 1.f));
+    }
+
+    out.close();
+    tape.close();
+    LOGI << "Bounced to " << outPath;
+  }
+
+} // top1
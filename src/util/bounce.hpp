@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <functional>
+
+#include "filesystem.hpp"
+#include "util/tape-config.hpp"
+
+namespace top1 {
+
+  /// The mixer settings of a tape track
+  struct TrackMix {
+    float level = 0.5;
+    /// From -1 (left) to 1 (right)
+    float pan = 0;
+    bool muted = false;
+  };
+
+  /**
+   * The mixer settings of all tape tracks.
+   *
+   * This is the mix both the live mixer and <bounce> use, so a bounce
+   * sounds like playing the tape.
+   */
+  struct TapeMix {
+    std::array<TrackMix, nTapeTracks> tracks;
+
+    /// Add `frame` mixed to stereo to `l` and `r`
+    void mixFrame(const TapeFrame& frame, float& l, float& r) const {
+      for (int t = 0; t < nTapeTracks; t++) {
+        auto&& track = tracks[t];
+        if (track.muted) continue;
+        l += frame[t] * track.level * (1 - track.pan);
+        r += frame[t] * track.level * (1 + track.pan);
+      }
+    }
+  };
+
+  /**
+   * Mix a tape file down to a stereo sound file, faster than realtime.
+   *
+   * The tape is read in large blocks, which are mixed on `threads` worker
+   * threads while the next blocks are read. Nothing here depends on the
+   * audio server, so this works without it running. The tape must not be
+   * open anywhere else meanwhile.
+   *
+   * @out Overwritten if it exists. Gets the samplerate of the tape.
+   * @threads 0 for one per core
+   * @progress Called with the fraction done after each batch of blocks
+   * @throws ByteFile::Error if the tape does not exist, or a file could not
+   *         be opened
+   */
+  void bounce(const fs::path& tape, const fs::path& out, const TapeMix& mix,
+              int threads = 0, std::function<void(float)> progress = {});
+
+} // top1
@@ -1,5 +1,11 @@
 #include "util/bytefile.hpp"
 
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <plog/Log.h>
 #include <fmt/format.h>
 
@@ -35,13 +41,18 @@ namespace top1 {
     // TODO: Do swaps;
   }
 
+  void ByteFile::open_fd(int flags) {
+    fd = ::open(path.c_str(), flags, 0644);
+    pos = 0;
+  }
+
   void ByteFile::open(const Path& p) {
     if (is_open()) {
       throw "File already open";
     }
     path = p;
-    fstream.open(p, std::ios::in | std::ios::out | std::ios::binary);
-    if (!fstream) {
+    open_fd(O_RDWR);
+    if (!is_open()) {
       // File didnt exist, create it
       create_file();
     }
@@ -49,24 +60,26 @@ namespace top1 {
   }
 
   void ByteFile::close() {
-    if (fstream.is_open()) {
+    if (is_open()) {
       write_file();
-      fstream.close();
+      ::close(fd);
+      fd = -1;
     };
   }
 
   void ByteFile::flush() {
-    if (fstream.is_open()) {
+    // Nothing is buffered here, the writes are already with the OS
+    if (is_open()) {
       write_file();
-      fstream.flush();
     };
   }
 
   void ByteFile::create_file() {
     close();
-    fstream.open(path, std::ios::trunc | std::ios::out | std::ios::binary);
-    fstream.close();
-    fstream.open(path, std::ios::in | std::ios::out | std::ios::binary);
+    open_fd(O_RDWR | O_CREAT | O_TRUNC);
+    if (!is_open()) {
+      throw Error(Error::Type::ExceptionThrown, std::strerror(errno));
+    }
     write_file();
   }
 
@@ -78,44 +91,62 @@ namespace top1 {
   }
 
   bool ByteFile::is_open() const {
-    return fstream.is_open();
+    return fd >= 0;
   }
 
   ByteFile::Position ByteFile::seek(Position p, std::ios::seekdir d) {
     if (!is_open()) throw Error(Error::Type::FileNotOpen, "ByteFile::seek(p, d)");
-    if (p < 0 && d == std::ios::beg) {
-      p = 0;
+    if (d == std::ios::cur) {
+      p += pos;
+    } else if (d == std::ios::end) {
+      p += size();
     }
-    fstream.seekg(p, d);
-    fstream.seekp(p, d);
-    return p;
+    pos = std::max<Position>(p, 0);
+    return pos;
   }
 
   ByteFile::Position ByteFile::position() {
     if (!is_open()) throw Error(Error::Type::FileNotOpen, "ByteFile::position()");
-    LOGD << fstream.tellg();
-    auto r = fstream.seekp(fstream.tellg()).tellp();
-    if (fstream.eof()) {
-      fstream.clear();
-      throw Error(Error::Type::PastEnd);
-    }
-    if (!fstream.good()) {
-      fstream.clear();
-      throw Error(Error::Type::ExceptionThrown,
-        std::strerror(errno));
-    }
-    if (r < 0) {
-      LOGE << "got negative position from file";
-    }
-    return r;
+    return pos;
   }
 
   ByteFile::Position ByteFile::size() {
     if (!is_open()) throw Error(Error::Type::FileNotOpen, "ByteFile::size()");
-    auto p = fstream.tellg();
-    auto end = fstream.seekg(0, std::fstream::end).tellg();
-    fstream.seekg(p);
-    return Position(end);
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+      throw Error(Error::Type::ExceptionThrown, std::strerror(errno));
+    }
+    return Position(st.st_size);
+  }
+
+  std::streamsize ByteFile::read_at(Position offset, std::byte* data,
+                                    std::streamsize n) {
+    if (!is_open()) throw Error(Error::Type::FileNotOpen, "ByteFile::read_at()");
+    std::streamsize total = 0;
+    while (total < n) {
+      ssize_t r = ::pread(fd, data + total, n - total, offset + total);
+      if (r < 0) {
+        if (errno == EINTR) continue;
+        throw Error(Error::Type::ExceptionThrown, std::strerror(errno));
+      }
+      if (r == 0) break;
+      total += r;
+    }
+    return total;
+  }
+
+  void ByteFile::write_at(Position offset, const std::byte* data,
+                          std::streamsize n) {
+    if (!is_open()) throw Error(Error::Type::FileNotOpen, "ByteFile::write_at()");
+    std::streamsize total = 0;
+    while (total < n) {
+      ssize_t r = ::pwrite(fd, data + total, n - total, offset + total);
+      if (r < 0) {
+        if (errno == EINTR) continue;
+        throw Error(Error::Type::ExceptionThrown, std::strerror(errno));
+      }
+      total += r;
+    }
   }
 
 } // top1
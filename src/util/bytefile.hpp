@@ -3,9 +3,12 @@
 #include <string>
 // TODO: Replace with c++17 once implementations have it
 // #include <experimental/filesystem>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <ios>
 #include <iterator>
 #include <utility>
-#include <fstream>
 #include <filesystem.hpp>
 
 #include "util/result.hpp"
@@ -94,10 +97,23 @@ namespace top1 {
 
   };
 
-  /// TODO: Documentation
+  /**
+   * A binary file, read and written at a cursor.
+   *
+   * Backed by positional I/O (`pread`/`pwrite`) on a file descriptor: the
+   * cursor is kept here, so seeking is free, and every read or write is a
+   * single call at an explicit offset. Contiguous data is read and written
+   * directly, anything else in batches of <BatchSize> bytes.
+   *
+   * Offsets are 64 bit, so files can be larger than 2 GiB.
+   */
   class ByteFile {
   public:
 
+    /// The size of the buffer used to read or write through iterators that
+    /// are not pointers, or to convert data. A multiple of the page size
+    static constexpr std::size_t BatchSize = 1 << 16;
+
     struct Error : std::exception {
       enum class Type {
         FileNotOpen,
@@ -128,7 +144,7 @@ namespace top1 {
       }
     };
 
-    using Position = int;
+    using Position = std::int64_t;
     using Path = filesystem::path;
 
     struct Chunk {
@@ -152,14 +168,14 @@ namespace top1 {
       void write(ByteFile& file) {
         offset = file.position();
         file.write_bytes(id);
-        file.write_bytes(size);
+        write_size(file);
         write_fields(file);
 
         // Update size if changed
         if (std::size_t rs = file.position() - offset - 8; rs > size.as_u()) {
           size.as_u() = rs;
           file.seek(offset + 4);
-          file.write_bytes(size);
+          write_size(file);
           seek_past(file);
         }
       }
@@ -170,16 +186,33 @@ namespace top1 {
         offset = file.position();
         file.read_bytes(id).unwrap_ok();
         file.read_bytes(size).unwrap_ok();
+        if (file.bigEndianChunks) {
+          std::reverse(size.begin(), size.end());
+        }
         read_fields(file);
       }
 
       virtual void read_fields(ByteFile& file) {}
+
+    private:
+      /// `size` is kept in native byte order
+      void write_size(ByteFile& file) {
+        bytes<4> s = size;
+        if (file.bigEndianChunks) {
+          std::reverse(s.begin(), s.end());
+        }
+        file.write_bytes(s);
+      }
     };
 
     // Public data
 
     Path path;
 
+    /// Chunk sizes are stored big-endian, as in AIFF, instead of
+    /// little-endian, as in RIFF
+    bool bigEndianChunks = false;
+
     // Initialization
 
     ByteFile();
@@ -206,6 +239,14 @@ namespace top1 {
     Position position();
     Position size();
 
+    /// Read up to `n` bytes at `offset`, without moving the cursor.
+    /// Returns the number of bytes read, which is less than `n` only at the
+    /// end of the file
+    std::streamsize read_at(Position offset, std::byte* data, std::streamsize n);
+
+    /// Write `n` bytes at `offset`, without moving the cursor
+    void write_at(Position offset, const std::byte* data, std::streamsize n);
+
     template<typename OutIter,
       typename = std::enable_if<is_iterator_v<OutIter, std::byte,
                                   std::output_iterator_tag>>>
@@ -238,104 +279,125 @@ namespace top1 {
 
     // Data
   protected:
-    std::fstream fstream;
+    int fd = -1;
+    /// The cursor
+    Position pos = 0;
+
+  private:
+    void open_fd(int flags);
+
+    template<typename OutIter>
+    std::streamsize read_batched(OutIter&, std::streamsize);
   };
 
   /*
    * Template definitions
    */
 
+  template<typename OutIter>
+  std::streamsize ByteFile::read_batched(OutIter& iter, std::streamsize n) {
+    alignas(64) std::array<std::byte, BatchSize> buf;
+    std::streamsize total = 0;
+    while (total < n) {
+      std::streamsize want = std::min<std::streamsize>(n - total, BatchSize);
+      std::streamsize got = read_at(pos, buf.data(), want);
+      iter = std::copy_n(buf.begin(), got, iter);
+      pos += got;
+      total += got;
+      if (got < want) break;
+    }
+    return total;
+  }
+
   template<typename OutIter, typename>
   result<void, OutIter> ByteFile::read_bytes(OutIter f, OutIter l) {
     if (!is_open()) throw Error(Error::Type::FileNotOpen);
-    result<void, OutIter> res;
-    // If OutIter is a pointer, copy everything at once
+    // If OutIter is a pointer, read everything at once
     if constexpr (std::is_pointer_v<OutIter>) {
-      fstream.read((char*) f, l - f);
-      if (fstream.eof()) {
-        res = f + fstream.gcount() / sizeof(std::remove_pointer_t<OutIter>);
-        fstream.clear();
-      }
+      using T = std::remove_pointer_t<OutIter>;
+      std::streamsize n = (l - f) * sizeof(T);
+      std::streamsize got = read_at(pos, reinterpret_cast<std::byte*>(f), n);
+      pos += got;
+      if (got < n) return f + got / sizeof(T);
     } else {
-      char* ptr;
-      std::streamsize i = 0;
-      for (OutIter iter = f; iter != l; iter++, i++) {
-        fstream.read(ptr, 1);
-        if (fstream.eof()) {
-          res = iter;
-          fstream.clear();
-          break;
-        }
-        **iter = *ptr;
-      }
+      std::streamsize n = std::distance(f, l);
+      if (read_batched(f, n) < n) return f;
     }
-    seek(fstream.tellg());
-    return res;
+    return {};
   }
 
   template<typename OutIter, typename>
   result<void, std::streamsize> ByteFile::read_bytes(OutIter iter, int n) {
     if (!is_open()) throw Error(Error::Type::FileNotOpen);
-    // If OutIter is a pointer, copy everything at once
+    std::streamsize got;
+    // If OutIter is a pointer, read everything at once
     if constexpr (std::is_pointer_v<OutIter>) {
-        fstream.read((char*) iter, n);
-      } else {
-      char buf;
-      std::generate_n(iter, n, [&] {
-          fstream.read(&buf, 1);
-          return std::byte(buf);
-        });
-    }
-    if (fstream.eof()) {
-      fstream.clear();
-      return {seek(fstream.tellg())};
+      got = read_at(pos, reinterpret_cast<std::byte*>(iter), n);
+      pos += got;
+    } else {
+      got = read_batched(iter, n);
     }
-    seek(fstream.tellg());
+    if (got < n) return {got};
     return {};
   }
 
   template<std::size_t N>
   result<void, std::streamsize> ByteFile::read_bytes(bytes<N>& bs) {
-    fstream.read((char*)bs, N);
-    seek(fstream.tellg());
-    if (fstream.eof()) {
-      fstream.clear();
-      return {seek(fstream.tellg())};
-    }
-    seek(fstream.tellg());
+    if (!is_open()) throw Error(Error::Type::FileNotOpen);
+    std::streamsize got = read_at(pos, bs.begin(), N);
+    pos += got;
+    if (got < std::streamsize(N)) return {got};
     return {};
   }
 
   template<typename InIter, typename>
   void ByteFile::write_bytes(InIter f, InIter l) {
     if (!is_open()) throw Error(Error::Type::FileNotOpen);
-    // If InIter is a pointer, copy everything at once
+    // If InIter is a pointer, write everything at once
     if constexpr (std::is_pointer_v<InIter>) {
-        fstream.write((char*)f, l - f);
-      } else {
-      std::for_each(f, l, [&] (auto& b) {fstream.write((char*)&b, 1);});
+      using T = std::remove_pointer_t<InIter>;
+      std::streamsize n = (l - f) * sizeof(T);
+      write_at(pos, reinterpret_cast<const std::byte*>(f), n);
+      pos += n;
+    } else {
+      alignas(64) std::array<std::byte, BatchSize> buf;
+      while (f != l) {
+        std::size_t n = 0;
+        for (; f != l && n < BatchSize; f++, n++) {
+          buf[n] = static_cast<std::byte>(*f);
+        }
+        write_at(pos, buf.data(), n);
+        pos += n;
+      }
     }
-    seek(fstream.tellp());
   }
 
   template<typename InIter, typename>
   void ByteFile::write_bytes(InIter iter, int n) {
     if (!is_open()) throw Error(Error::Type::FileNotOpen);
-    // If InIter is a pointer, copy everything at once
+    // If InIter is a pointer, write everything at once
     if constexpr (std::is_pointer_v<InIter>) {
-        fstream.write((char*)iter, n);
-      } else {
-      for (int i = 0; i < n; i++, iter++) {
-        fstream.write(&(*iter), 1);
+      write_at(pos, reinterpret_cast<const std::byte*>(iter), n);
+      pos += n;
+    } else {
+      alignas(64) std::array<std::byte, BatchSize> buf;
+      while (n > 0) {
+        int batch = std::min<int>(n, BatchSize);
+        for (int i = 0; i < batch; i++, iter++) {
+          buf[i] = static_cast<std::byte>(*iter);
+        }
+        write_at(pos, buf.data(), batch);
+        pos += batch;
+        n -= batch;
       }
     }
-    seek(fstream.tellp());
   }
 
   template<std::size_t N>
   void ByteFile::write_bytes(const bytes<N>& bs) {
-    fstream.write((char*)bs, N);
-    seek(fstream.tellp());
+    if (!is_open()) throw Error(Error::Type::FileNotOpen);
+    write_at(pos, bs.begin(), N);
+    pos += N;
   }
 
   template<typename F>
@@ -2,6 +2,7 @@
 
 #include "util/typedefs.hpp"
 
+#include <utility>
 #include <vector>
 #include <functional>
 #include <plog/Log.h>
@@ -19,24 +20,31 @@ public:
 
   EventDispatcher() = default;
 
+  /// @return An id for <remove>, which stays valid when others are removed
   uint add(handler_type handler) {
-    handlers.push_back(handler);
-    return this->handlers.size() - 1;
+    handlers.push_back({nextId, handler});
+    return nextId++;
   }
 
-  void remove(unsigned int i){
-    handlers.erase(handlers.begin() + i);
+  void remove(uint id) {
+    for (auto it = handlers.begin(); it != handlers.end(); ++it) {
+      if (it->first == id) {
+        handlers.erase(it);
+        return;
+      }
+    }
   }
 
   void runAll(Args... args) {
     for (auto handler: this->handlers)  {
-      handler(args...);
+      handler.second(args...);
     }
   }
 
   uint operator+=(const handler_type& h) { return add(h); }
 private:
-  std::vector<handler_type> handlers;
+  std::vector<std::pair<uint, handler_type>> handlers;
+  uint nextId = 0;
 };
 
 }
@@ -0,0 +1,172 @@
+#include "midi-file.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+namespace top1 {
+
+  /// Reads the big endian fields of a midi file, checking the bounds
+  struct MidiReader {
+    const uint8_t* pos;
+    const uint8_t* end;
+
+    void need(std::size_t n) {
+      if (std::size_t(end - pos) < n) throw "Unexpected end of MIDI file";
+    }
+
+    uint8_t byte() {
+      need(1);
+      return *pos++;
+    }
+
+    uint32_t fixed(int bytes) {
+      need(bytes);
+      uint32_t v = 0;
+      for (int i = 0; i < bytes; i++) v = (v << 8) | *pos++;
+      return v;
+    }
+
+    /// A variable length quantity, 7 bits per byte
+    uint32_t vlq() {
+      uint32_t v = 0;
+      for (int i = 0; i < 4; i++) {
+        uint8_t b = byte();
+        v = (v << 7) | (b & 0x7F);
+        if (!(b & 0x80)) return v;
+      }
+      throw "Invalid MIDI variable length quantity";
+    }
+
+    void skip(std::size_t n) {
+      need(n);
+      pos += n;
+    }
+  };
+
+  struct MidiTickEvent {
+    uint32_t tick;
+    MidiFile::Event event;
+  };
+
+  struct MidiTempoChange {
+    uint32_t tick;
+    /// Microseconds per quarter note
+    uint32_t tempo;
+  };
+
+  static void readTrack(MidiReader r, std::vector<MidiTickEvent>& events,
+                        std::vector<MidiTempoChange>& tempos) {
+    uint32_t tick = 0;
+    uint8_t status = 0;
+    while (r.pos < r.end) {
+      tick += r.vlq();
+      uint8_t b = r.byte();
+      if (b == 0xFF) {
+        uint8_t type = r.byte();
+        uint32_t len = r.vlq();
+        if (type == 0x2F) return;
+        if (type == 0x51 && len == 3) {
+          tempos.push_back({tick, r.fixed(3)});
+        } else {
+          r.skip(len);
+        }
+        continue;
+      }
+      if (b == 0xF0 || b == 0xF7) {
+        r.skip(r.vlq());
+        continue;
+      }
+      if (b & 0x80) {
+        status = b;
+      } else {
+        // Running status
+        if (status == 0) throw "Invalid MIDI running status";
+        r.pos--;
+      }
+      MidiFile::Event e {0, {status, 0, 0}, 1};
+      int type = status >> 4;
+      int dataBytes = (type == 0xC || type == 0xD) ? 1 : 2;
+      for (int i = 0; i < dataBytes; i++) {
+        e.bytes[e.size++] = r.byte();
+      }
+      events.push_back({tick, e});
+    }
+  }
+
+  void MidiFile::read(const fs::path& path) {
+    std::ifstream file (path, std::ios::binary);
+    if (!file) throw "Could not open MIDI file";
+    std::vector<uint8_t> data ((std::istreambuf_iterator<char>(file)),
+      std::istreambuf_iterator<char>());
+    parse(data);
+  }
+
+  void MidiFile::parse(const std::vector<uint8_t>& data) {
+    MidiReader r {data.data(), data.data() + data.size()};
+    r.need(14);
+    if (!std::equal(r.pos, r.pos + 4, "MThd")) throw "Not a MIDI file";
+    r.skip(4);
+    uint32_t headerSize = r.fixed(4);
+    if (headerSize < 6) throw "Invalid MIDI header";
+    r.fixed(2); // Format. All formats are merged the same way
+    int nTracks = r.fixed(2);
+    uint16_t division = r.fixed(2);
+    r.skip(headerSize - 6);
+
+    std::vector<MidiTickEvent> tickEvents;
+    std::vector<MidiTempoChange> tempos;
+    for (int t = 0; t < nTracks && r.pos < r.end; t++) {
+      r.need(8);
+      bool isTrack = std::equal(r.pos, r.pos + 4, "MTrk");
+      r.skip(4);
+      uint32_t size = r.fixed(4);
+      r.need(size);
+      if (isTrack) {
+        readTrack({r.pos, r.pos + size}, tickEvents, tempos);
+      } else {
+        // Unknown chunks are skipped, and do not count as tracks
+        t--;
+      }
+      r.skip(size);
+    }
+
+    std::stable_sort(tickEvents.begin(), tickEvents.end(),
+      [] (auto& a, auto& b) { return a.tick < b.tick; });
+    std::stable_sort(tempos.begin(), tempos.end(),
+      [] (auto& a, auto& b) { return a.tick < b.tick; });
+
+    // Seconds per tick
+    double tickLength;
+    bool smpte = division & 0x8000;
+    if (smpte) {
+      int fps = -int8_t(division >> 8);
+      int ticksPerFrame = division & 0xFF;
+      if (fps <= 0 || ticksPerFrame == 0) throw "Invalid MIDI time division";
+      tickLength = 1.0 / (fps * ticksPerFrame);
+    } else {
+      if (division == 0) throw "Invalid MIDI time division";
+      // 120 bpm until the first tempo change
+      tickLength = 500000e-6 / division;
+    }
+
+    events.clear();
+    events.reserve(tickEvents.size());
+    auto tempo = tempos.begin();
+    uint32_t lastTick = 0;
+    double time = 0;
+    for (auto&& e : tickEvents) {
+      // SMPTE time does not depend on the tempo
+      for (; tempo != tempos.end() && tempo->tick <= e.tick; tempo++) {
+        time += (tempo->tick - lastTick) * tickLength;
+        lastTick = tempo->tick;
+        if (!smpte) tickLength = tempo->tempo * 1e-6 / division;
+      }
+      time += (e.tick - lastTick) * tickLength;
+      lastTick = e.tick;
+      e.event.time = time;
+      events.push_back(e.event);
+    }
+  }
+
+} // top1
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "filesystem.hpp"
+
+namespace top1 {
+
+  /**
+   * The channel events of a Standard MIDI File.
+   *
+   * All tracks are merged, and the times are converted to seconds using
+   * the tempo changes in the file. Meta and system exclusive events are
+   * skipped.
+   */
+  class MidiFile {
+  public:
+
+    struct Event {
+      /// Seconds from the start of the file
+      double time;
+      /// The status byte and up to two data bytes
+      std::array<uint8_t, 3> bytes;
+      int size;
+    };
+
+    /// Sorted by time. Events at the same time keep their order
+    std::vector<Event> events;
+
+    /**
+     * Read a file, replacing `events`.
+     *
+     * @throws const char* if the file could not be read, or is not a
+     *         valid MIDI file
+     */
+    void read(const fs::path& path);
+
+    /// Parse the contents of a file, see <read>
+    void parse(const std::vector<uint8_t>& data);
+
+    /// The time of the last event
+    double length() const {
+      return events.empty() ? 0 : events.back().time;
+    }
+  };
+
+} // top1
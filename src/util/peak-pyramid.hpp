@@ -0,0 +1,183 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include <gsl/span>
+
+#include "util/audio.hpp"
+
+namespace top1::audio {
+
+  /**
+   * Min/max peaks of multichannel audio, at several zoom levels.
+   *
+   * The lowest level has a peak per <BaseRatio> frames, and each level
+   * above it merges <Factor> peaks of the one below. A view of any length
+   * is drawn from the level closest to its resolution, so drawing it costs
+   * in proportion to the number of pixels, not the number of frames.
+   *
+   * Peaks are stored as 8 bit integers, which is plenty for drawing.
+   * The methods can be called from different threads.
+   */
+  template<int nChannels>
+  class PeakPyramid {
+  public:
+
+    using Frame = AudioFrame<nChannels, float>;
+
+    struct Peak {
+      int8_t min = 0;
+      int8_t max = 0;
+
+      void merge(Peak p) {
+        min = std::min(min, p.min);
+        max = std::max(max, p.max);
+      }
+    };
+
+    /// Frames per peak on the lowest level
+    static constexpr int BaseRatio = 256;
+    /// Peaks per peak on the level above
+    static constexpr int Factor = 4;
+    static constexpr int Levels = 6;
+
+    /// Frames per peak on `level`
+    static constexpr int ratio(int level) {
+      int r = BaseRatio;
+      for (int i = 0; i < level; i++) r *= Factor;
+      return r;
+    }
+
+    /**
+     * Set the peaks of `n` frames starting at `first`.
+     *
+     * @first a multiple of <BaseRatio>
+     * @n a multiple of <BaseRatio>, unless the frames are the last ones
+     */
+    void update(int first, const Frame* frames, int n) {
+      std::lock_guard lock (mutex);
+      int firstPeak = first / BaseRatio;
+      int nPeaks = (n + BaseRatio - 1) / BaseRatio;
+      auto& base = levels[0];
+      if (std::size_t(firstPeak + nPeaks) * nChannels > base.size()) {
+        base.resize((firstPeak + nPeaks) * nChannels);
+      }
+      for (int p = 0; p < nPeaks; p++) {
+        float lo[nChannels], hi[nChannels];
+        std::fill_n(lo, nChannels, 0.f);
+        std::fill_n(hi, nChannels, 0.f);
+        int end = std::min(n, (p + 1) * BaseRatio);
+        for (int i = p * BaseRatio; i < end; i++) {
+          for (int c = 0; c < nChannels; c++) {
+            lo[c] = std::min(lo[c], frames[i][c]);
+            hi[c] = std::max(hi[c], frames[i][c]);
+          }
+        }
+        for (int c = 0; c < nChannels; c++) {
+          base[(firstPeak + p) * nChannels + c] = {quantize(lo[c]), quantize(hi[c])};
+        }
+      }
+      updateLevels(firstPeak, firstPeak + nPeaks);
+    }
+
+    /// Forget the peaks after `length` frames
+    void truncate(int length) {
+      std::lock_guard lock (mutex);
+      for (int l = 0; l < Levels; l++) {
+        std::size_t size = (length + ratio(l) - 1) / ratio(l) * nChannels;
+        if (levels[l].size() > size) levels[l].resize(size);
+      }
+    }
+
+    void clear() {
+      std::lock_guard lock (mutex);
+      for (auto&& level : levels) level.clear();
+    }
+
+    /// The peaks of the lowest level, interleaved by channel
+    std::vector<Peak> baseLevel() const {
+      std::lock_guard lock (mutex);
+      return levels[0];
+    }
+
+    /// Replace all peaks, building the higher levels from `base`
+    void setBaseLevel(std::vector<Peak> base) {
+      std::lock_guard lock (mutex);
+      levels[0] = std::move(base);
+      for (int l = 1; l < Levels; l++) levels[l].clear();
+      updateLevels(0, levels[0].size() / nChannels);
+    }
+
+    /**
+     * Get the peaks of `channel` over `range`, split evenly into
+     * `out.size()` parts, such as the pixels of a view.
+     *
+     * Parts outside the stored peaks are silent.
+     */
+    void query(int channel, Section<int> range, gsl::span<Peak> out) const {
+      std::lock_guard lock (mutex);
+      if (out.size() == 0) return;
+      double perPart = double(range.size()) / out.size();
+      int level = 0;
+      while (level + 1 < Levels && ratio(level + 1) <= perPart) level++;
+      auto&& peaks = levels[level];
+      int nPeaks = peaks.size() / nChannels;
+      int r = ratio(level);
+
+      for (int i = 0; i < int(out.size()); i++) {
+        int from = range.in + std::floor(i * perPart);
+        int to = range.in + std::floor((i + 1) * perPart);
+        int first = std::max(from, 0) / r;
+        int last = std::min((std::max(to, 0) + r - 1) / r, nPeaks);
+        Peak peak;
+        if (from >= 0 || to > 0) {
+          for (int p = first; p < std::max(last, first + 1) && p < nPeaks; p++) {
+            peak.merge(peaks[p * nChannels + channel]);
+          }
+        }
+        out[i] = peak;
+      }
+    }
+
+    static int8_t quantize(float f) {
+      return std::lround(std::clamp(f, -1.f, 1.f) * 127);
+    }
+
+    static float toFloat(int8_t i) {
+      return i / 127.f;
+    }
+
+  private:
+
+    mutable std::mutex mutex;
+    std::vector<Peak> levels[Levels];
+
+    /// Merge the peaks `[first, last)` of the lowest level into the levels
+    /// above it
+    void updateLevels(int first, int last) {
+      for (int l = 1; l < Levels; l++) {
+        auto&& below = levels[l - 1];
+        auto&& level = levels[l];
+        int nBelow = below.size() / nChannels;
+        first /= Factor;
+        last = (last + Factor - 1) / Factor;
+        if (std::size_t(last) * nChannels > level.size()) {
+          level.resize(last * nChannels);
+        }
+        for (int p = first; p < last; p++) {
+          for (int c = 0; c < nChannels; c++) {
+            Peak peak;
+            for (int b = p * Factor; b < std::min((p + 1) * Factor, nBelow); b++) {
+              peak.merge(below[b * nChannels + c]);
+            }
+            level[p * nChannels + c] = peak;
+          }
+        }
+      }
+    }
+  };
+
+} // top1::audio
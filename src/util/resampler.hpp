@@ -0,0 +1,207 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <gsl/span>
+
+#include "util/audio.hpp"
+
+namespace top1::audio {
+
+  /**
+   * A streaming resampler, for playing audio at variable speed.
+   *
+   * The input is pulled from a callback, which is asked for exactly the
+   * frames needed to produce the output. The read position is kept as a
+   * fraction between calls, so the input is consumed at the exact speed.
+   *
+   * The last few input frames are kept in the work buffer between calls, as
+   * history for the interpolation. This also means the input is read
+   * ahead of what is heard, by the number of frames given by <ahead>.
+   */
+  template<int nChannels = 4, typename SampleType = float>
+  class Resampler {
+  public:
+
+    using Frame = AudioFrame<nChannels, SampleType>;
+
+    enum class Interpolation {
+      Linear = 0,
+      Cubic = 1,
+      /// Hann windowed sinc. Lowpasses at the input nyquist when speed > 1
+      Sinc = 2,
+    };
+
+    /// Half the number of taps used by <Interpolation::Sinc>
+    static constexpr int HalfWidth = 8;
+    /// Input frames kept before the read position
+    static constexpr int History = HalfWidth - 1;
+    /// Input frames read after the read position
+    static constexpr int Lookahead = HalfWidth;
+    /// The fastest the input can be read
+    static constexpr float MaxSpeed = HalfWidth;
+
+    Interpolation interpolation = Interpolation::Cubic;
+
+    /**
+     * Produce `out.size()` frames, reading the input `speed` times as fast.
+     *
+     * @param work Storage for the input. It must be the same buffer on every
+     *        call, until <reset> is called. To read at full speed it needs
+     *        room for `out.size() * speed + History + Lookahead + 1` frames,
+     *        otherwise the speed is lowered to fit.
+     * @param read Invocable with a `gsl::span<Frame>`. Fills it with the
+     *        next frames of the input.
+     */
+    template<typename ReadF>
+    void process(gsl::span<Frame> out, float speed, gsl::span<Frame> work,
+                 ReadF&& read)
+    {
+      if (out.size() == 0) return;
+      if (!primed) {
+        std::fill(work.begin(), work.begin() + History, Frame{});
+        filled = History;
+        pos = History;
+        primed = true;
+      }
+
+      int n = out.size();
+      speed = std::clamp<float>(speed, 0, MaxSpeed);
+      // The frames [0, need) must be in the work buffer
+      auto needed = [&] { return int(pos + (n - 1) * double(speed)) + Lookahead + 1; };
+      if (needed() > int(work.size())) {
+        speed = (int(work.size()) - Lookahead - 1 - pos) / std::max(n - 1, 1);
+        speed = std::max(speed, 0.f);
+      }
+      int need = needed();
+      if (need > filled) {
+        read(work.subspan(filled, need - filled));
+        filled = need;
+      }
+
+      switch (interpolation) {
+      case Interpolation::Linear:
+        run(out, speed, work, [] (const Frame* f, float x, auto&& acc) {
+            acc(f[0], 1 - x);
+            acc(f[1], x);
+          });
+        break;
+      case Interpolation::Cubic:
+        run(out, speed, work, [] (const Frame* f, float x, auto&& acc) {
+            // Catmull-Rom
+            float x2 = x * x;
+            float x3 = x2 * x;
+            acc(f[-1], 0.5f * (-x3 + 2 * x2 - x));
+            acc(f[0],  0.5f * (3 * x3 - 5 * x2 + 2));
+            acc(f[1],  0.5f * (-3 * x3 + 4 * x2 + x));
+            acc(f[2],  0.5f * (x3 - x2));
+          });
+        break;
+      case Interpolation::Sinc:
+        runSinc(out, speed, work);
+        break;
+      }
+
+      // Drop the frames that are no longer needed as history
+      pos += n * double(speed);
+      int shift = std::min(int(pos) - History, filled);
+      std::copy(work.begin() + shift, work.begin() + filled, work.begin());
+      filled -= shift;
+      pos -= shift;
+    }
+
+    /// Forget the history. Call this when the input is discontinuous.
+    /// The history is silence, so the first frames fade in.
+    void reset() {
+      primed = false;
+    }
+
+    /**
+     * Start over, with the input before the read position as history.
+     *
+     * Use this to start resampling in the middle of the input without a
+     * dropout.
+     * @param work The work buffer passed to <process>
+     * @param readHistory Invocable with a `gsl::span<Frame>`. Fills it with
+     *        the <History> frames right before the next frame of the input.
+     */
+    template<typename ReadF>
+    void reset(gsl::span<Frame> work, ReadF&& readHistory) {
+      readHistory(work.first(History));
+      filled = History;
+      pos = History;
+      primed = true;
+    }
+
+    /// The number of input frames read past the frame that is heard next.
+    ///
+    /// Moving the input back by this much after <process>, and forward again
+    /// before the next, keeps the input position in line with the output.
+    int ahead() const {
+      return primed ? filled - int(pos) : 0;
+    }
+
+  private:
+
+    /// Read position, relative to the start of the work buffer
+    double pos = History;
+    /// The number of frames in the work buffer
+    int filled = 0;
+    bool primed = false;
+
+    /**
+     * @kernel Invocable with `(const Frame* f, float x, acc)`, where `f`
+     *         points to the frame before the read position, `x` is the
+     *         fraction past it, and `acc(frame, weight)` adds a tap.
+     */
+    template<typename Kernel>
+    void run(gsl::span<Frame> out, float speed, gsl::span<Frame> work,
+             Kernel&& kernel)
+    {
+      for (int i = 0; i < int(out.size()); i++) {
+        double x = pos + i * double(speed);
+        int i0 = x;
+        SampleType acc[nChannels] = {0};
+        kernel(work.data() + i0, float(x - i0), [&] (const Frame& f, float w) {
+            for (int c = 0; c < nChannels; c++) acc[c] += w * f[c];
+          });
+        for (int c = 0; c < nChannels; c++) out[i][c] = acc[c];
+      }
+    }
+
+    void runSinc(gsl::span<Frame> out, float speed, gsl::span<Frame> work) {
+      // Lower the cutoff to avoid aliasing when reading faster
+      const float cutoff = std::min(1.f, 1 / std::max(speed, 1e-3f));
+      // The sines are stepped by rotation, one frame at a time
+      const float sincStep = M_PI * cutoff;
+      const float sinS = std::sin(sincStep), cosS = std::cos(sincStep);
+      const float winStep = M_PI / HalfWidth;
+      const float sinW = std::sin(winStep), cosW = std::cos(winStep);
+
+      run(out, speed, work, [&] (const Frame* f, float x, auto&& acc) {
+          float d = x + HalfWidth - 1; // distance to the first tap
+          float sinA = std::sin(sincStep * d), cosA = std::cos(sincStep * d);
+          float sinB = std::sin(winStep * d), cosB = std::cos(winStep * d);
+          float weights[2 * HalfWidth];
+          float sum = 0;
+          for (int k = 0; k < 2 * HalfWidth; k++) {
+            float sinc = std::abs(d) < 1e-4f ? 1 : sinA / (sincStep * d);
+            float win = std::abs(d) < HalfWidth ? 0.5f * (1 + cosB) : 0;
+            weights[k] = sinc * win;
+            sum += weights[k];
+            d -= 1;
+            float s = sinA * cosS - cosA * sinS;
+            cosA = cosA * cosS + sinA * sinS;
+            sinA = s;
+            s = sinB * cosW - cosB * sinW;
+            cosB = cosB * cosW + sinB * sinW;
+            sinB = s;
+          }
+          for (int k = 0; k < 2 * HalfWidth; k++) {
+            acc(f[k - HalfWidth + 1], weights[k] / sum);
+          }
+        });
+    }
+  };
+
+} // top1::audio
@@ -0,0 +1,201 @@
+#include "sample-convert.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace top1::audio {
+
+  constexpr float Int16Scale = 32768.f;
+  constexpr float Int24Scale = 8388608.f;
+  constexpr float Int32Scale = 2147483648.f;
+  /// The largest float below 2^31, so the scaled value fits in an int32
+  constexpr float Int32Max = 2147483520.f;
+
+#if !defined(__SSE2__) && defined(__ARM_NEON)
+  /// Round to nearest, ties to even, like SSE and std::lrint
+  static inline int32x4_t round_to_int(float32x4_t x) {
+#if defined(__aarch64__)
+    return vcvtnq_s32_f32(x);
+#else
+    // vcvtq truncates, so round with the part it cut off. Adding 0.5 first
+    // would be inexact for samples above 2^23
+    const float32x4_t half = vdupq_n_f32(0.5f);
+    const float32x4_t minusHalf = vdupq_n_f32(-0.5f);
+    int32x4_t r = vcvtq_s32_f32(x);
+    float32x4_t cut = vsubq_f32(x, vcvtq_f32_s32(r));
+    // On a tie, only odd values move
+    uint32x4_t odd = vtstq_s32(r, vdupq_n_s32(1));
+    uint32x4_t up = vorrq_u32(vcgtq_f32(cut, half),
+                              vandq_u32(vceqq_f32(cut, half), odd));
+    uint32x4_t down = vorrq_u32(vcltq_f32(cut, minusHalf),
+                                vandq_u32(vceqq_f32(cut, minusHalf), odd));
+    // The masks are -1 where true
+    r = vsubq_s32(r, vreinterpretq_s32_u32(up));
+    return vaddq_s32(r, vreinterpretq_s32_u32(down));
+#endif
+  }
+#endif
+
+  void int16_to_float(const std::int16_t* in, float* out, int n) {
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128 scale = _mm_set1_ps(1 / Int16Scale);
+    for (; i + 8 <= n; i += 8) {
+      __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+      // Sign extend by putting each sample in the upper half, and shifting
+      __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+      __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+      _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+      _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 8 <= n; i += 8) {
+      int16x8_t x = vld1q_s16(in + i);
+      float32x4_t lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(x)));
+      float32x4_t hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(x)));
+      vst1q_f32(out + i, vmulq_n_f32(lo, 1 / Int16Scale));
+      vst1q_f32(out + i + 4, vmulq_n_f32(hi, 1 / Int16Scale));
+    }
+#endif
+    for (; i < n; i++) {
+      out[i] = in[i] / Int16Scale;
+    }
+  }
+
+  void int32_to_float(const std::int32_t* in, float* out, int n) {
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128 scale = _mm_set1_ps(1 / Int32Scale);
+    for (; i + 4 <= n; i += 4) {
+      __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+      _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(x), scale));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 4 <= n; i += 4) {
+      float32x4_t x = vcvtq_f32_s32(vld1q_s32(in + i));
+      vst1q_f32(out + i, vmulq_n_f32(x, 1 / Int32Scale));
+    }
+#endif
+    for (; i < n; i++) {
+      out[i] = in[i] / Int32Scale;
+    }
+  }
+
+  void float_to_int16(const float* in, std::int16_t* out, int n) {
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128 scale = _mm_set1_ps(Int16Scale);
+    const __m128 min = _mm_set1_ps(-Int16Scale);
+    const __m128 max = _mm_set1_ps(Int16Scale - 1);
+    auto convert = [&] (const float* p) {
+      __m128 x = _mm_mul_ps(_mm_loadu_ps(p), scale);
+      // Rounds to nearest
+      return _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(x, min), max));
+    };
+    for (; i + 8 <= n; i += 8) {
+      __m128i x = _mm_packs_epi32(convert(in + i), convert(in + i + 4));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), x);
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 8 <= n; i += 8) {
+      float32x4_t lo = vmulq_n_f32(vld1q_f32(in + i), Int16Scale);
+      float32x4_t hi = vmulq_n_f32(vld1q_f32(in + i + 4), Int16Scale);
+      // Saturates to the int16 range
+      int16x8_t x = vcombine_s16(vqmovn_s32(round_to_int(lo)),
+                                 vqmovn_s32(round_to_int(hi)));
+      vst1q_s16(out + i, x);
+    }
+#endif
+    for (; i < n; i++) {
+      float x = std::clamp(in[i] * Int16Scale, -Int16Scale, Int16Scale - 1);
+      out[i] = std::lrint(x);
+    }
+  }
+
+  /// Scale by `scale`, round to nearest, clamp to [-scale, max] and shift
+  /// left by `shift`, so the result fills the upper bits of an int32
+  static void float_to_scaled_int(const float* in, std::int32_t* out, int n,
+                                  float scale, float max, int shift) {
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128 vscale = _mm_set1_ps(scale);
+    const __m128 vmin = _mm_set1_ps(-scale);
+    const __m128 vmax = _mm_set1_ps(max);
+    const __m128i vshift = _mm_cvtsi32_si128(shift);
+    for (; i + 4 <= n; i += 4) {
+      __m128 x = _mm_mul_ps(_mm_loadu_ps(in + i), vscale);
+      x = _mm_min_ps(_mm_max_ps(x, vmin), vmax);
+      // Rounds to nearest
+      __m128i r = _mm_sll_epi32(_mm_cvtps_epi32(x), vshift);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), r);
+    }
+#elif defined(__ARM_NEON)
+    const float32x4_t vmin = vdupq_n_f32(-scale);
+    const float32x4_t vmax = vdupq_n_f32(max);
+    const int32x4_t vshift = vdupq_n_s32(shift);
+    for (; i + 4 <= n; i += 4) {
+      float32x4_t x = vmulq_n_f32(vld1q_f32(in + i), scale);
+      x = vminq_f32(vmaxq_f32(x, vmin), vmax);
+      vst1q_s32(out + i, vshlq_s32(round_to_int(x), vshift));
+    }
+#endif
+    for (; i < n; i++) {
+      float x = std::clamp(in[i] * scale, -scale, max);
+      out[i] = std::int32_t(std::uint32_t(std::lrint(x)) << shift);
+    }
+  }
+
+  void float_to_int32(const float* in, std::int32_t* out, int n) {
+    float_to_scaled_int(in, out, n, Int32Scale, Int32Max, 0);
+  }
+
+  void float_to_int24(const float* in, std::int32_t* out, int n) {
+    float_to_scaled_int(in, out, n, Int24Scale, Int24Scale - 1, 8);
+  }
+
+  void unpack_int24(const std::byte* in, std::int32_t* out, int n, bool bigEndian) {
+    const auto* b = reinterpret_cast<const std::uint8_t*>(in);
+    if (bigEndian) {
+      for (int i = 0; i < n; i++, b += 3) {
+        out[i] = std::int32_t(std::uint32_t(b[0]) << 24 | b[1] << 16 | b[2] << 8);
+      }
+    } else {
+      for (int i = 0; i < n; i++, b += 3) {
+        out[i] = std::int32_t(std::uint32_t(b[2]) << 24 | b[1] << 16 | b[0] << 8);
+      }
+    }
+  }
+
+  void pack_int24(const std::int32_t* in, std::byte* out, int n, bool bigEndian) {
+    auto* b = reinterpret_cast<std::uint8_t*>(out);
+    for (int i = 0; i < n; i++, b += 3) {
+      // Round the low byte away, saturating at the top
+      auto x = in[i] > 0x7FFFFF7F ? 0x7FFFFF00u : std::uint32_t(in[i]) + 0x80;
+      std::uint8_t hi = x >> 24, mid = x >> 16, lo = x >> 8;
+      b[0] = bigEndian ? hi : lo;
+      b[1] = mid;
+      b[2] = bigEndian ? lo : hi;
+    }
+  }
+
+  void swap_bytes(std::int16_t* data, int n) {
+    for (int i = 0; i < n; i++) {
+      auto x = std::uint16_t(data[i]);
+      data[i] = std::int16_t(x << 8 | x >> 8);
+    }
+  }
+
+  void swap_bytes(std::int32_t* data, int n) {
+    for (int i = 0; i < n; i++) {
+      auto x = std::uint32_t(data[i]);
+      data[i] = std::int32_t(x << 24 | (x & 0xFF00) << 8 | (x >> 8 & 0xFF00) | x >> 24);
+    }
+  }
+
+} // top1::audio
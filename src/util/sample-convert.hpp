@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace top1::audio {
+
+  /*
+   * Conversion kernels between float samples in [-1, 1] and integer PCM.
+   *
+   * The 16, 24 and 32 bit conversions are vectorized with SSE2 or NEON where
+   * available, and fall back to plain loops elsewhere. Encoding rounds to
+   * the nearest integer, with ties to even on every path, and clamps
+   * samples outside [-1, 1].
+   *
+   * None of these allocate, so they may run on the audio thread.
+   */
+
+  void int16_to_float(const std::int16_t* in, float* out, int n);
+  void int32_to_float(const std::int32_t* in, float* out, int n);
+
+  void float_to_int16(const float* in, std::int16_t* out, int n);
+  void float_to_int32(const float* in, std::int32_t* out, int n);
+  /// Like <float_to_int32>, but rounded to 24 bits, with the low byte zero.
+  /// Rounding to int32 first and packing would round twice
+  void float_to_int24(const float* in, std::int32_t* out, int n);
+
+  /// Unpack 24 bit samples into the upper bytes of 32 bit ones
+  void unpack_int24(const std::byte* in, std::int32_t* out, int n, bool bigEndian);
+  /// Pack the upper bytes of 32 bit samples into 24 bit ones, rounding the
+  /// low byte to nearest
+  void pack_int24(const std::int32_t* in, std::byte* out, int n, bool bigEndian);
+
+  /// Reverse the byte order of each sample, in place
+  void swap_bytes(std::int16_t* data, int n);
+  /// Reverse the byte order of each sample, in place
+  void swap_bytes(std::int32_t* data, int n);
+
+} // top1::audio
@@ -0,0 +1,91 @@
+#include "sample-loader.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <plog/Log.h>
+
+#include "util/resampler.hpp"
+#include "util/soundfile.hpp"
+
+namespace top1::audio {
+
+  void downmix(const float* in, float* out, int nFrames, int nChannels) {
+    if (nChannels == 1) {
+      std::copy_n(in, nFrames, out);
+      return;
+    }
+    const float scale = 1.f / nChannels;
+    // Frame `i` is read from `i * nChannels`, so this is safe in place
+    for (int i = 0; i < nFrames; i++) {
+      float sum = 0;
+      for (int c = 0; c < nChannels; c++) {
+        sum += in[i * nChannels + c];
+      }
+      out[i] = sum * scale;
+    }
+  }
+
+  std::vector<float> convert_samplerate(gsl::span<const float> in, int from, int to) {
+    if (from == to || from <= 0 || to <= 0 || in.empty()) {
+      return {in.begin(), in.end()};
+    }
+    using Resampler = audio::Resampler<1, float>;
+    using Frame = Resampler::Frame;
+    constexpr int BlockSize = 1024;
+
+    const double speed = double(from) / to;
+    std::vector<float> out(std::size_t(std::ceil(in.size() / speed)));
+
+    Resampler resampler;
+    resampler.interpolation = Resampler::Interpolation::Sinc;
+    std::vector<Frame> work(int(std::ceil(BlockSize * speed))
+                            + Resampler::History + Resampler::Lookahead + 2);
+    std::vector<Frame> block(BlockSize);
+
+    std::size_t read = 0;
+    auto pull = [&] (gsl::span<Frame> frames) {
+      for (auto&& f : frames) {
+        f[0] = read < std::size_t(in.size()) ? in[read] : 0.f;
+        read++;
+      }
+    };
+    for (std::size_t done = 0; done < out.size(); done += BlockSize) {
+      int n = std::min<std::size_t>(BlockSize, out.size() - done);
+      resampler.process({block.data(), n}, speed, work, pull);
+      std::transform(block.begin(), block.begin() + n, out.begin() + done,
+        [] (const Frame& f) { return f[0]; });
+    }
+    return out;
+  }
+
+  std::vector<float> load_mono(const fs::path& path, int samplerate,
+                               std::size_t maxFrames) {
+    SoundFile sf;
+    sf.open(path);
+    const int channels = std::max(sf.info.channels, 1);
+    const int rate = sf.info.samplerate > 0 ? sf.info.samplerate : samplerate;
+
+    std::size_t frames = sf.length() / channels;
+    // The resampler reads a few frames past each output frame
+    double needed = std::ceil(maxFrames * double(rate) / samplerate)
+      + Resampler<1, float>::Lookahead;
+    frames = std::min<std::size_t>(frames, needed);
+
+    std::vector<float> mono(frames);
+    constexpr int BlockFrames = 4096;
+    std::vector<float> block(BlockFrames * channels);
+    for (std::size_t done = 0; done < frames; done += BlockFrames) {
+      int n = std::min<std::size_t>(BlockFrames, frames - done);
+      sf.read_samples(block.data(), n * channels);
+      downmix(block.data(), mono.data() + done, n, channels);
+    }
+
+    if (rate != samplerate) {
+      LOGD << "Converting sample from " << rate << " to " << samplerate << " Hz";
+      mono = convert_samplerate(mono, rate, samplerate);
+    }
+    if (mono.size() > maxFrames) mono.resize(maxFrames);
+    return mono;
+  }
+
+} // top1::audio
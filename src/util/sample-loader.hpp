@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <gsl/span>
+
+#include "filesystem.hpp"
+
+namespace top1::audio {
+
+  /*
+   * Loading of samples for the samplers.
+   *
+   * The samplers keep their samples as mono audio at the samplerate of the
+   * audio system, so the audio thread can play them back frame by frame.
+   * Files with more channels are mixed down, and files at other samplerates
+   * are converted with the windowed sinc of <Resampler>, once, when they are
+   * loaded.
+   *
+   * These read and convert the whole sample, so call them from any thread
+   * but the audio thread.
+   */
+
+  /// Mix interleaved frames of `nChannels` channels down to one, by
+  /// averaging them. `out` may be the same as `in`.
+  void downmix(const float* in, float* out, int nFrames, int nChannels);
+
+  /// Convert mono audio from `from` Hz to `to` Hz.
+  ///
+  /// The output has `in.size() * to / from` frames, rounded up. Converting
+  /// down by more than <Resampler::MaxSpeed> is not supported.
+  std::vector<float> convert_samplerate(gsl::span<const float> in, int from, int to);
+
+  /// Read a sound file as mono audio at `samplerate`.
+  ///
+  /// At most `maxFrames` frames of the converted audio are returned, and
+  /// only the part of the file needed for those is read.
+  std::vector<float> load_mono(const fs::path& path, int samplerate,
+                               std::size_t maxFrames);
+
+} // top1::audio
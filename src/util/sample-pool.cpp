@@ -0,0 +1,113 @@
+#include "sample-pool.hpp"
+
+#include <chrono>
+#include <plog/Log.h>
+
+#include "util/sample-loader.hpp"
+
+namespace top1::audio {
+
+  /// Whether only the pool holds the sample. Samples that are still being
+  /// loaded are in use by the thread loading them.
+  static bool unused(const std::shared_future<SamplePool::Handle>& sample) {
+    using namespace std::chrono_literals;
+    return sample.wait_for(0s) == std::future_status::ready
+      && sample.get().use_count() == 1;
+  }
+
+  SamplePool::SamplePool(std::size_t budget) : maxBytes (budget) {}
+
+  SamplePool::Handle SamplePool::get(const fs::path& path, int samplerate,
+                                     std::size_t maxFrames) {
+    Key key {path.string(), samplerate, maxFrames};
+    std::promise<Handle> promise;
+    std::shared_future<Handle> future;
+    bool load = false;
+    {
+      std::lock_guard lock (mutex);
+      auto [it, inserted] = entries.try_emplace(key);
+      if (inserted) {
+        it->second.sample = promise.get_future().share();
+        load = true;
+      }
+      it->second.lastUse = ++useCount;
+      future = it->second.sample;
+      evict(&key);
+    }
+
+    if (load) {
+      auto sample = std::make_shared<Sample>();
+      try {
+        sample->frames = load_mono(path, samplerate, maxFrames);
+        sample->samplerate = samplerate;
+        sample->path = path;
+      } catch (...) {
+        {
+          std::lock_guard lock (mutex);
+          entries.erase(key);
+        }
+        // Passed on to everyone waiting for the sample
+        promise.set_exception(std::current_exception());
+        return future.get();
+      }
+      LOGD << "Loaded " << path << " into the sample pool";
+      std::lock_guard lock (mutex);
+      entries[key].bytes = sample->bytes();
+      promise.set_value(std::move(sample));
+      evict(&key);
+    }
+    return future.get();
+  }
+
+  void SamplePool::setBudget(std::size_t bytes) {
+    std::lock_guard lock (mutex);
+    maxBytes = bytes;
+    evict(nullptr);
+  }
+
+  std::size_t SamplePool::budget() const {
+    std::lock_guard lock (mutex);
+    return maxBytes;
+  }
+
+  std::size_t SamplePool::size() const {
+    std::lock_guard lock (mutex);
+    std::size_t total = 0;
+    for (auto&& [key, entry] : entries) total += entry.bytes;
+    return total;
+  }
+
+  void SamplePool::clear() {
+    std::lock_guard lock (mutex);
+    for (auto it = entries.begin(); it != entries.end();) {
+      if (unused(it->second.sample)) it = entries.erase(it);
+      else ++it;
+    }
+  }
+
+  void SamplePool::evict(const Key* keep) {
+    auto droppable = [&] (auto&& entry) {
+      return (keep == nullptr || entry.first < *keep || *keep < entry.first)
+        && unused(entry.second.sample);
+    };
+    std::size_t unusedBytes = 0;
+    for (auto&& [key, entry] : entries) {
+      if (unused(entry.sample)) unusedBytes += entry.bytes;
+    }
+    while (unusedBytes > maxBytes) {
+      auto oldest = entries.end();
+      for (auto it = entries.begin(); it != entries.end(); ++it) {
+        if (droppable(*it)
+            && (oldest == entries.end()
+                || it->second.lastUse < oldest->second.lastUse)) {
+          oldest = it;
+        }
+      }
+      if (oldest == entries.end()) break;
+      LOGD << "Dropping " << oldest->first.path << " from the sample pool";
+      unusedBytes -= oldest->second.bytes;
+      entries.erase(oldest);
+    }
+  }
+
+} // top1::audio
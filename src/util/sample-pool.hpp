@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "filesystem.hpp"
+
+/// The default memory budget of the sample pool, in MiB.
+/// Set with the cmake option of the same name
+#ifndef TOP1_SAMPLE_POOL_BUDGET
+#define TOP1_SAMPLE_POOL_BUDGET 256
+#endif
+
+namespace top1::audio {
+
+  /**
+   * Samples loaded for the samplers, shared by path.
+   *
+   * Each file is decoded once with <load_mono>, and every module and voice
+   * that asks for it after that gets the same immutable buffer. The pool
+   * keeps samples around after the last user lets go of them, so switching
+   * presets back and forth does not decode again. When the samples exceed
+   * the memory budget, the least recently used of the unused ones are
+   * dropped. Samples in use are never dropped, and don't count towards the
+   * budget, since dropping them would not free anything.
+   *
+   * All members are safe to call from any thread but the audio thread.
+   */
+  class SamplePool {
+  public:
+
+    /// A decoded sample. It is never changed once it is in the pool
+    struct Sample {
+      /// Mono, at <samplerate>
+      std::vector<float> frames;
+      int samplerate = 0;
+      fs::path path;
+
+      std::size_t bytes() const {
+        return frames.size() * sizeof(float);
+      }
+    };
+
+    using Handle = std::shared_ptr<const Sample>;
+
+    /// A pool with the budget set at build time
+    SamplePool() : SamplePool(std::size_t(TOP1_SAMPLE_POOL_BUDGET) << 20) {}
+
+    /// @budget The bytes of unused samples to keep
+    explicit SamplePool(std::size_t budget);
+
+    SamplePool(const SamplePool&) = delete;
+    SamplePool& operator=(const SamplePool&) = delete;
+
+    /**
+     * The sample at `path`, as mono at `samplerate`, and at most `maxFrames`
+     * frames long.
+     *
+     * Decodes the file unless the pool has it already. If another thread is
+     * decoding the same file, this waits for it instead.
+     *
+     * Errors of the decoder are passed on, and nothing is kept in the pool.
+     */
+    Handle get(const fs::path& path, int samplerate, std::size_t maxFrames);
+
+    void setBudget(std::size_t bytes);
+    std::size_t budget() const;
+
+    /// The bytes held by the samples in the pool, used or not
+    std::size_t size() const;
+
+    /// Drop all unused samples
+    void clear();
+
+  private:
+
+    struct Key {
+      std::string path;
+      int samplerate;
+      std::size_t maxFrames;
+
+      bool operator<(const Key& rhs) const {
+        return std::tie(path, samplerate, maxFrames)
+          < std::tie(rhs.path, rhs.samplerate, rhs.maxFrames);
+      }
+    };
+
+    struct Entry {
+      std::shared_future<Handle> sample;
+      /// The <useCount> of the last <get>
+      std::uint64_t lastUse = 0;
+      std::size_t bytes = 0;
+    };
+
+    mutable std::mutex mutex;
+    std::map<Key, Entry> entries;
+    std::size_t maxBytes;
+    std::uint64_t useCount = 0;
+
+    /// Drop unused samples, least recently used first, until the rest fit
+    /// in the budget. `keep` is not dropped, so a sample that was just
+    /// loaded reaches the caller. Call with the mutex locked.
+    void evict(const Key* keep);
+  };
+
+} // top1::audio
@@ -0,0 +1,78 @@
+#include "sample-slot.hpp"
+
+#include <chrono>
+#include <thread>
+#include <plog/Log.h>
+
+#include "util/bytefile.hpp"
+
+namespace top1::audio {
+
+  void SampleSlot::swap(Handle next) {
+    using namespace std::chrono_literals;
+    std::lock_guard lock (mutex);
+    const Sample* old = published.exchange(next.get());
+    // The audio thread acquires the new sample from now on, so this ends
+    // with the period that uses the old one
+    while (old != nullptr && inUse.load() == old) {
+      std::this_thread::sleep_for(1ms);
+    }
+    swaps++;
+    // The old sample is freed here, or in the pool, off the audio thread
+    owner = std::move(next);
+  }
+
+  SampleSlot::Handle SampleSlot::current() const {
+    std::lock_guard lock (mutex);
+    return owner;
+  }
+
+  void SampleSlot::load(SamplePool& pool, fs::path path, int samplerate,
+                        std::size_t maxFrames) {
+    std::lock_guard lock (loadMutex);
+    request = Request{&pool, std::move(path), samplerate, maxFrames};
+    // The running load takes the request when it is done
+    if (loading) return;
+    loading = true;
+    // The previous loader has returned, so this does not wait for long
+    loader = std::async(std::launch::async, [this] { runLoads(); });
+  }
+
+  void SampleSlot::wait() {
+    std::unique_lock lock (loadMutex);
+    loadDone.wait(lock, [&] { return !loading; });
+  }
+
+  void SampleSlot::runLoads() {
+    std::unique_lock lock (loadMutex);
+    while (request) {
+      Request r = std::move(*request);
+      request.reset();
+      lock.unlock();
+
+      Handle next;
+      bool ok = true;
+      if (!r.path.empty()) {
+        try {
+          next = r.pool->get(r.path, r.samplerate, r.maxFrames);
+          if (next->frames.empty()) LOGD << "Empty sample file " << r.path;
+        } catch (ByteFile::Error& e) {
+          LOGE << "Could not load " << r.path << ": " << e.what();
+          ok = false;
+        } catch (const char* e) {
+          LOGE << "Could not load " << r.path << ": " << e;
+          ok = false;
+        } catch (...) {
+          LOGE << "Could not load " << r.path;
+          ok = false;
+        }
+      }
+      if (ok) swap(std::move(next));
+
+      lock.lock();
+    }
+    loading = false;
+    loadDone.notify_all();
+  }
+
+} // top1::audio
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <optional>
+
+#include "filesystem.hpp"
+#include "util/sample-pool.hpp"
+
+namespace top1::audio {
+
+  /**
+   * The sample a sampler plays, replaced while the audio thread plays it.
+   *
+   * A new sample is published with an atomic pointer swap, so the audio
+   * thread never waits for a load, and never sees a half loaded sample.
+   * While the audio thread plays a sample, it marks it as in use. <swap>
+   * waits for the audio thread to let go of the old sample before dropping
+   * it, so the audio thread never frees a sample either.
+   *
+   * One thread may call <acquire> and <release>, and any others may call
+   * the rest.
+   *
+   * Samples are loaded with <load>, on a background thread. The loads run
+   * one at a time, in order, and a load asked for while another runs
+   * replaces any that has not started yet, so only the latest one is done.
+   */
+  class SampleSlot {
+  public:
+
+    using Sample = SamplePool::Sample;
+    using Handle = SamplePool::Handle;
+
+    SampleSlot() = default;
+    SampleSlot(const SampleSlot&) = delete;
+    SampleSlot& operator=(const SampleSlot&) = delete;
+
+    /* Audio thread */
+
+    /// The current sample, or `nullptr`. It stays valid until <release>.
+    ///
+    /// Lock-free. It only retries if a swap happens at the same moment.
+    const Sample* acquire() {
+      const Sample* s = published.load();
+      while (true) {
+        inUse.store(s);
+        const Sample* now = published.load();
+        if (now == s) return s;
+        s = now;
+      }
+    }
+
+    /// Let go of the sample returned by <acquire>
+    void release() {
+      inUse.store(nullptr);
+    }
+
+    /// Counts the swaps. Read it before <acquire>, and the sample is at
+    /// least as new as the count
+    unsigned swapCount() const {
+      return swaps.load();
+    }
+
+    /* Other threads */
+
+    /// Publish `next`, and drop the previous sample once the audio thread is
+    /// done with it. Blocks for at most one period of the audio thread.
+    void swap(Handle next);
+
+    /// The current sample. Holding on to it keeps it loaded
+    Handle current() const;
+
+    /**
+     * Load `path` from `pool` on a background thread, and swap it in.
+     *
+     * Returns right away. If the file can not be loaded, the error is
+     * logged, and the current sample is kept.
+     * @path The sound file, or an empty path to swap in no sample
+     */
+    void load(SamplePool& pool, fs::path path, int samplerate,
+              std::size_t maxFrames);
+
+    /// Wait for the loads asked for so far
+    void wait();
+
+  private:
+
+    struct Request {
+      SamplePool* pool;
+      fs::path path;
+      int samplerate;
+      std::size_t maxFrames;
+    };
+
+    /// Run the requests until there are none left
+    void runLoads();
+
+    std::atomic<const Sample*> published {nullptr};
+    std::atomic<const Sample*> inUse {nullptr};
+
+    std::atomic<unsigned> swaps {0};
+
+    /// Owns <published>
+    Handle owner;
+    mutable std::mutex mutex;
+
+    /// Guards the rest
+    std::mutex loadMutex;
+    std::condition_variable loadDone;
+    /// The next load to run
+    std::optional<Request> request;
+    bool loading = false;
+    /// Runs <runLoads>. Declared last, so it is waited for before the rest
+    /// is destroyed
+    std::future<void> loader;
+  };
+
+} // top1::audio
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <chrono>
+
+#ifdef __linux__
+#include <cerrno>
+#include <ctime>
+#include <semaphore.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#endif
+
+namespace top1 {
+
+  /**
+   * A counting semaphore, used to wake a thread from the audio thread.
+   *
+   * On Linux <post> takes no lock. It is an atomic increment, and a futex
+   * wake only if a thread is waiting, so the audio thread can call it every
+   * period. Elsewhere it falls back to a mutex and condition variable.
+   */
+  class Semaphore {
+  public:
+
+    explicit Semaphore(unsigned count = 0) {
+#ifdef __linux__
+      sem_init(&sem, 0, count);
+#else
+      this->count = count;
+#endif
+    }
+
+    ~Semaphore() {
+#ifdef __linux__
+      sem_destroy(&sem);
+#endif
+    }
+
+    Semaphore(const Semaphore&) = delete;
+    Semaphore& operator=(const Semaphore&) = delete;
+
+    void post() {
+#ifdef __linux__
+      sem_post(&sem);
+#else
+      {
+        std::lock_guard lock (mutex);
+        count++;
+      }
+      cond.notify_one();
+#endif
+    }
+
+    /// Take one count, if there is one
+    bool try_wait() {
+#ifdef __linux__
+      return sem_trywait(&sem) == 0;
+#else
+      std::lock_guard lock (mutex);
+      if (count == 0) return false;
+      count--;
+      return true;
+#endif
+    }
+
+    /// Wait for a count, and take it.
+    /// @return false if none was posted within `timeout`
+    template<typename Rep, typename Period>
+    bool wait_for(std::chrono::duration<Rep, Period> timeout) {
+#ifdef __linux__
+      auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(timeout);
+      timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      long long total = ts.tv_nsec + ns.count();
+      ts.tv_sec += total / 1000000000;
+      ts.tv_nsec = total % 1000000000;
+      while (sem_timedwait(&sem, &ts) != 0) {
+        if (errno != EINTR) return false;
+      }
+      return true;
+#else
+      std::unique_lock lock (mutex);
+      if (!cond.wait_for(lock, timeout, [&] { return count > 0; })) return false;
+      count--;
+      return true;
+#endif
+    }
+
+  private:
+#ifdef __linux__
+    sem_t sem;
+#else
+    unsigned count;
+    std::mutex mutex;
+    std::condition_variable cond;
+#endif
+  };
+
+} // top1
@@ -1,10 +1,31 @@
 #include "util/soundfile.hpp"
+
+#include <cmath>
 #include <plog/Log.h>
 
+#include "util/sample-convert.hpp"
+
 namespace top1 {
 
   using Chunk = ByteFile::Chunk;
   using Position = SoundFile::Position;
+  using Format = SoundFile::Info::Format;
+
+  /// Read a big-endian unsigned integer
+  template<std::size_t N>
+  static auto from_big_endian(bytes<N> b) {
+    std::reverse(b.begin(), b.end());
+    return b.template as_u<N>();
+  }
+
+  /// Store an unsigned integer big-endian
+  template<std::size_t N>
+  static bytes<N> to_big_endian(int_n_bytes_u_t<N> n) {
+    bytes<N> b;
+    b.template as_u<N>() = n;
+    std::reverse(b.begin(), b.end());
+    return b;
+  }
 
   struct Header : Chunk {
     Header() = default;
@@ -33,6 +54,10 @@ namespace top1 {
     WAVE_fmt() : Chunk("fmt ") {}
     WAVE_fmt(Chunk& o) : Chunk(o) {}
 
+    static constexpr int PCM = 1;
+    static constexpr int Float = 3;
+    static constexpr int Extensible = 0xFFFE;
+
     bytes<2> audioFormat = 3;
     bytes<2> numChannels;
     bytes<4> sampleRate;
@@ -50,26 +75,50 @@ namespace top1 {
       file.read_bytes(blockAlign).unwrap_ok();
       file.read_bytes(bitsPerSample).unwrap_ok();
 
-      if (audioFormat.as_u() != 3) {
-        throw "Unsupported audio format. \
-               Currently only float is supported";
+      if (audioFormat.as_u() == Extensible) {
+        // The format is the start of the sub format GUID
+        bytes<2> extSize;
+        bytes<2> validBits;
+        bytes<4> channelMask;
+        file.read_bytes(extSize).unwrap_ok();
+        file.read_bytes(validBits).unwrap_ok();
+        file.read_bytes(channelMask).unwrap_ok();
+        file.read_bytes(audioFormat).unwrap_ok();
       }
 
       sf.info.channels = numChannels.as_u();
       sf.info.samplerate = sampleRate.as_u();
 
-      if (bitsPerSample.as_u() != 32) {
-        throw "Unsupported sample size. \
-              Currently only 32bit float is supported";
+      switch (audioFormat.as_u()) {
+      case PCM:
+        switch (bitsPerSample.as_u()) {
+        case 16: sf.info.format = Format::Int16; break;
+        case 24: sf.info.format = Format::Int24; break;
+        case 32: sf.info.format = Format::Int32; break;
+        default:
+          throw "Unsupported sample size. \
+                 Only 16, 24 and 32 bit PCM is supported";
+        }
+        break;
+      case Float:
+        if (bitsPerSample.as_u() != 32) {
+          throw "Unsupported sample size. \
+                 Only 32 bit float is supported";
+        }
+        sf.info.format = Format::Float32;
+        break;
+      default:
+        throw "Unsupported audio format. \
+               Only PCM and float are supported";
       }
     }
 
     void write_fields(ByteFile& file) override {
       auto& sf = (SoundFile&)file;
-      audioFormat.as_u() = 3;
+      audioFormat.as_u() = sf.info.format == Format::Float32 ? Float : PCM;
       numChannels.as_u() = sf.info.channels;
       sampleRate.as_u() = sf.info.samplerate;
-      bitsPerSample.as_u() = sf.sample_size * 8;
+      bitsPerSample.as_u() = sf.info.sample_bytes() * 8;
       byteRate.as_u() =
         sampleRate.as_u() * numChannels.as_u() * bitsPerSample.as_u() / 8;
       blockAlign.as_u() = numChannels.as_u() * bitsPerSample.as_u() / 8;
@@ -90,6 +139,7 @@ namespace top1 {
     void read_fields(ByteFile& file) override {
       auto& sf = (SoundFile&)file;
       sf.audioOffset = offset + 8;
+      sf.audioSize = size.as_u();
     }
     void write_fields(ByteFile& file) override {
       auto& sf = (SoundFile&)file;
@@ -97,6 +147,107 @@ namespace top1 {
     }
   };
 
+  /// The samplerate is an 80 bit IEEE 754 extended float
+  struct AIFF_COMM : Chunk {
+    AIFF_COMM() : Chunk("COMM") {}
+    AIFF_COMM(Chunk& o) : Chunk(o) {}
+
+    bytes<2> numChannels;
+    bytes<4> numSampleFrames;
+    bytes<2> sampleSize;
+    bytes<10> sampleRate;
+
+    static double from_extended(const bytes<10>& b) {
+      auto* u = reinterpret_cast<const std::uint8_t*>(b.begin());
+      int exponent = ((u[0] & 0x7F) << 8 | u[1]) - 16383;
+      std::uint64_t mantissa = 0;
+      for (int i = 2; i < 10; i++) {
+        mantissa = mantissa << 8 | u[i];
+      }
+      double value = std::ldexp(double(mantissa), exponent - 63);
+      return (u[0] & 0x80) ? -value : value;
+    }
+
+    static bytes<10> to_extended(std::uint32_t value) {
+      bytes<10> b;
+      auto* u = reinterpret_cast<std::uint8_t*>(b.begin());
+      std::fill(u, u + 10, 0);
+      if (value == 0) return b;
+      int exponent = 31;
+      while (!(value & (1u << exponent))) exponent--;
+      std::uint64_t mantissa = std::uint64_t(value) << (63 - exponent);
+      exponent += 16383;
+      u[0] = exponent >> 8;
+      u[1] = exponent & 0xFF;
+      for (int i = 9; i >= 2; i--, mantissa >>= 8) {
+        u[i] = mantissa & 0xFF;
+      }
+      return b;
+    }
+
+    void read_fields(ByteFile& file) override {
+      auto& sf = (SoundFile&)file;
+
+      file.read_bytes(numChannels).unwrap_ok();
+      file.read_bytes(numSampleFrames).unwrap_ok();
+      file.read_bytes(sampleSize).unwrap_ok();
+      file.read_bytes(sampleRate).unwrap_ok();
+
+      sf.info.channels = from_big_endian(numChannels);
+      sf.info.samplerate = std::lround(from_extended(sampleRate));
+
+      switch (from_big_endian(sampleSize)) {
+      case 16: sf.info.format = Format::Int16; break;
+      case 24: sf.info.format = Format::Int24; break;
+      case 32: sf.info.format = Format::Int32; break;
+      default:
+        throw "Unsupported sample size. \
+               Only 16, 24 and 32 bit AIFF is supported";
+      }
+    }
+
+    void write_fields(ByteFile& file) override {
+      auto& sf = (SoundFile&)file;
+      if (sf.info.format == Format::Float32) {
+        throw "AIFF files can not hold float samples";
+      }
+      int frameBytes = sf.info.sample_bytes() * sf.info.channels;
+      numChannels = to_big_endian<2>(sf.info.channels);
+      numSampleFrames = to_big_endian<4>(sf.audioSize / frameBytes);
+      sampleSize = to_big_endian<2>(sf.info.sample_bytes() * 8);
+      sampleRate = to_extended(sf.info.samplerate);
+
+      file.write_bytes(numChannels);
+      file.write_bytes(numSampleFrames);
+      file.write_bytes(sampleSize);
+      file.write_bytes(sampleRate);
+    }
+  };
+
+  /// The audio data of an AIFF file, after an offset and a block size
+  struct AIFF_SSND : Chunk {
+    AIFF_SSND() : Chunk("SSND") {}
+    AIFF_SSND(Chunk& c) : Chunk(c) {}
+
+    bytes<4> dataOffset = {0, 0, 0, 0};
+    bytes<4> blockSize = {0, 0, 0, 0};
+
+    void read_fields(ByteFile& file) override {
+      auto& sf = (SoundFile&)file;
+      file.read_bytes(dataOffset).unwrap_ok();
+      file.read_bytes(blockSize).unwrap_ok();
+      std::uint32_t skip = from_big_endian(dataOffset);
+      sf.audioOffset = offset + 16 + skip;
+      sf.audioSize = size.as_u() - 8 - skip;
+    }
+    void write_fields(ByteFile& file) override {
+      auto& sf = (SoundFile&)file;
+      file.write_bytes(dataOffset);
+      file.write_bytes(blockSize);
+      sf.audioOffset = offset + 16;
+    }
+  };
+
   /*
    * SoundFile Implementation
    */
@@ -104,6 +255,11 @@ namespace top1 {
   SoundFile::SoundFile() {}
 
   void SoundFile::read_file() {
+    // AIFF chunk sizes are big-endian, so check before reading any
+    bytes<4> id = {0, 0, 0, 0};
+    read_at(0, id.begin(), 4);
+    bigEndianChunks = id == "FORM";
+
     ByteFile::seek(0);
     Header header;
     header.read(*this);
@@ -118,71 +274,210 @@ namespace top1 {
       throw Error::UnrecognizedFileType;
     }
 
-    switch (info.type) {
-    case Info::Type::WAVE:
-      LOGD << "Reading Wave file: ";
-      LOGD << path.c_str();
-      LOGD << "-------------------";
-
-      for (auto&& chunk : header.chunks) {
+    bool aiff = info.type == Info::Type::AIFF;
+    LOGD << "Reading " << (aiff ? "AIFF" : "Wave") << " file: ";
+    LOGD << path.c_str();
+    LOGD << "-------------------";
+
+    for (auto&& chunk : header.chunks) {
+      if (aiff) {
+        if (chunk->id == "COMM")
+          chunk = std::make_unique<AIFF_COMM>(*chunk);
+        if (chunk->id == "SSND")
+          chunk = std::make_unique<AIFF_SSND>(*chunk);
+      } else {
         if (chunk->id == "fmt ")
           chunk = std::make_unique<WAVE_fmt>(*chunk);
         if (chunk->id == "data")
           chunk = std::make_unique<WAVE_data>(*chunk);
-        replace_custom_chunk(chunk);
-
-        // re-read the chunk as the new type
-        chunk->seek_to(*this);
-        chunk->read(*this);
+      }
+      replace_custom_chunk(chunk);
 
-        LOGD << " Chunk:  " << std::string((char*)chunk->id.data, 4);
-        LOGD << " Offset: " << chunk->offset;
-        LOGD << " Size:   " << chunk->size.as_u();
-        LOGD << "-------------------";
-      } break;
+      // re-read the chunk as the new type
+      chunk->seek_to(*this);
+      chunk->read(*this);
 
-      LOGD << "Done reading file! ";
+      LOGD << " Chunk:  " << std::string((char*)chunk->id.data, 4);
+      LOGD << " Offset: " << chunk->offset;
+      LOGD << " Size:   " << chunk->size.as_u();
       LOGD << "-------------------";
-    case Info::Type::AIFF:
-      throw "Unsupported file type. Currently only wav is supported";
     }
     seek(0);
   }
 
+  void SoundFile::move_audio(Position offset) {
+    LOGD << "Moving the audio data by " << offset - audioOffset << " bytes";
+    std::vector<std::byte> buf(1 << 20);
+    Position size = audioSize;
+    // Copy from the end when moving towards it, so nothing is overwritten
+    // before it is copied
+    bool back = offset > audioOffset;
+    for (Position done = 0; done < size;) {
+      Position n = std::min<Position>(buf.size(), size - done);
+      Position from = back ? size - done - n : done;
+      n = read_at(audioOffset + from, buf.data(), n);
+      if (n <= 0) break;
+      write_at(offset + from, buf.data(), n);
+      done += n;
+    }
+    audioOffset = offset;
+  }
+
   void SoundFile::write_file() {
+    bool aiff = info.type == Info::Type::AIFF;
+    bigEndianChunks = aiff;
     ByteFile::seek(0);
     Header header;
+    std::vector<std::unique_ptr<Chunk>> trailing;
 
-    switch (info.type) {
-    case Info::Type::WAVE:
-      LOGD << "Writing Wave file: ";
-      LOGD << path.c_str();
-      LOGD << "-------------------";
+    LOGD << "Writing " << (aiff ? "AIFF" : "Wave") << " file: ";
+    LOGD << path.c_str();
+    LOGD << "-------------------";
 
-      header.id = "RIFF";
-      header.format = "WAVE";
+    header.id = aiff ? "FORM" : "RIFF";
+    header.format = aiff ? "AIFF" : "WAVE";
+    if (aiff) {
+      header.chunks.push_back(std::make_unique<AIFF_COMM>());
+    } else {
       header.chunks.push_back(std::make_unique<WAVE_fmt>());
-      add_custom_chunks(header.chunks);
-      header.chunks.push_back(std::make_unique<WAVE_data>());
-      header.chunks.back()->size = ByteFile::size() - audioOffset;
-      header.write(*this);
+    }
+    add_custom_chunks(header.chunks);
+    add_trailing_chunks(trailing);
+    header.write(*this);
+
+    {
+      // The audio data stays where it is, if possible. If the chunks before
+      // it have shrunk, fill the gap.
+      Position dataHeader = aiff ? 16 : 8;
+      Position gap = audioOffset - dataHeader - ByteFile::position();
+      if (audioSize > 0 && gap < 0) {
+        throw "The chunks before the audio data have grown into it";
+      }
+      if (audioSize > 0 && gap > 0 && gap < 8) {
+        // Too small for the header of a JUNK chunk. Move the audio data to
+        // make room for one, which is slow for long files
+        move_audio(audioOffset + 8 - gap);
+        gap = 8;
+      }
+      if (audioSize > 0 && gap != 0) {
+        Chunk junk("JUNK");
+        junk.size.as_u() = gap - 8;
+        junk.write(*this);
+        junk.seek_past(*this);
+      }
+      if (aiff) {
+        AIFF_SSND data;
+        data.size.as_u() = audioSize + 8;
+        data.write(*this);
+      } else {
+        WAVE_data data;
+        data.size.as_u() = audioSize;
+        data.write(*this);
+      }
+    }
 
-      LOGD << "Wrote " << header.chunks.size() << " chunks";
-      LOGE_IF(!fstream.good()) << "fstream errored";
-      LOGD << "-------------------";
-      break;
-    case Info::Type::AIFF:
-      throw "Unsupported type. Currently only wav is supported";
+    ByteFile::seek(audioOffset + audioSize);
+    for (auto&& chunk : trailing) {
+      chunk->write(*this);
+    }
+
+    // The RIFF or FORM size covers everything
+    header.size.as_u() = ByteFile::position() - 8;
+    ByteFile::seek(4);
+    ByteFile::write_bytes(aiff ? to_big_endian<4>(header.size.as_u()) : header.size);
+
+    LOGD << "Wrote " << header.chunks.size() + trailing.size() << " chunks";
+    LOGD << "-------------------";
+  }
+
+  void SoundFile::read_converted(Sample* out, int n) {
+    constexpr int BatchSamples = BatchSize / 4;
+    alignas(64) std::array<std::byte, BatchSamples * 4> raw;
+    alignas(16) std::array<std::int32_t, BatchSamples> ints;
+    bool swap = info.type == Info::Type::AIFF;
+    int bps = info.sample_bytes();
+
+    while (n > 0) {
+      int batch = std::min(n, BatchSamples);
+      std::streamsize got = read_at(pos, raw.data(), batch * bps);
+      ByteFile::seek(got, std::ios::cur);
+      int samples = got / bps;
+
+      switch (info.format) {
+      case Format::Int16: {
+        auto* data = reinterpret_cast<std::int16_t*>(raw.data());
+        if (swap) audio::swap_bytes(data, samples);
+        audio::int16_to_float(data, out, samples);
+        break;
+      }
+      case Format::Int24:
+        audio::unpack_int24(raw.data(), ints.data(), samples, swap);
+        audio::int32_to_float(ints.data(), out, samples);
+        break;
+      case Format::Int32: {
+        auto* data = reinterpret_cast<std::int32_t*>(raw.data());
+        if (swap) audio::swap_bytes(data, samples);
+        audio::int32_to_float(data, out, samples);
+        break;
+      }
+      case Format::Float32:
+        // Only big-endian floats get here, and AIFF has none
+        throw "Unsupported sample format";
+      }
+
+      if (samples < batch) {
+        std::fill(out + samples, out + n, 0);
+        return;
+      }
+      out += batch;
+      n -= batch;
+    }
+  }
+
+  void SoundFile::write_converted(const Sample* in, int n) {
+    constexpr int BatchSamples = BatchSize / 4;
+    alignas(64) std::array<std::byte, BatchSamples * 4> raw;
+    alignas(16) std::array<std::int32_t, BatchSamples> ints;
+    bool swap = info.type == Info::Type::AIFF;
+    int bps = info.sample_bytes();
+
+    while (n > 0) {
+      int batch = std::min(n, BatchSamples);
+
+      switch (info.format) {
+      case Format::Int16: {
+        auto* data = reinterpret_cast<std::int16_t*>(raw.data());
+        audio::float_to_int16(in, data, batch);
+        if (swap) audio::swap_bytes(data, batch);
+        break;
+      }
+      case Format::Int24:
+        audio::float_to_int24(in, ints.data(), batch);
+        audio::pack_int24(ints.data(), raw.data(), batch, swap);
+        break;
+      case Format::Int32: {
+        auto* data = reinterpret_cast<std::int32_t*>(raw.data());
+        audio::float_to_int32(in, data, batch);
+        if (swap) audio::swap_bytes(data, batch);
+        break;
+      }
+      case Format::Float32:
+        throw "Unsupported sample format";
+      }
+
+      ByteFile::write_bytes(raw.data(), batch * bps);
+      in += batch;
+      n -= batch;
     }
   }
 
   Position SoundFile::seek(Position p) {
-    return (ByteFile::seek(audioOffset + p * sample_size)
-      - audioOffset) / sample_size;
+    Position bps = info.sample_bytes();
+    return (ByteFile::seek(audioOffset + p * bps) - audioOffset) / bps;
   }
 
   Position SoundFile::position() {
-    Position r = (ByteFile::position() - audioOffset) / sample_size;
+    Position r = (ByteFile::position() - audioOffset) / info.sample_bytes();
     if (r < 0) {
       seek(0);
       return 0;
@@ -191,6 +486,6 @@ namespace top1 {
   }
 
   Position SoundFile::length() {
-    return (ByteFile::size() - audioOffset) / sample_size;
+    return audioSize / info.sample_bytes();
   }
 }
@@ -9,9 +9,11 @@ namespace top1 {
 
   class SoundFile : public ByteFile {
     public:
-    using Position = int;
+    /// Samples in the file. 64 bit, like the byte offsets
+    using Position = ByteFile::Position;
     using Sample = float;
     using Chunk = ByteFile::Chunk;
+    /// The size of a <Sample> in memory, and of a 32 bit float in a file
     constexpr static std::size_t sample_size = 4;
 
     enum class Error {
@@ -22,10 +24,34 @@ namespace top1 {
       enum class Type {
         WAVE,
         AIFF,
-      } type;
+      } type = Type::WAVE;
+
+      /// The encoding of the samples in the file. AIFF files can not hold
+      /// floats
+      enum class Format {
+        Float32,
+        Int16,
+        Int24,
+        Int32,
+      } format = Format::Float32;
 
       int channels = 1;
       int samplerate = 44100;
+
+      /// The size of one sample in the file
+      int sample_bytes() const {
+        switch (format) {
+        case Format::Int16: return 2;
+        case Format::Int24: return 3;
+        default: return 4;
+        }
+      }
+
+      /// Whether the samples are stored just like <Sample>s in memory, so
+      /// they need no conversion
+      bool is_native() const {
+        return format == Format::Float32 && type == Type::WAVE;
+      }
     } info;
 
     SoundFile();
@@ -69,6 +95,13 @@ namespace top1 {
     /// It should push back any custom metadata chunks to `v`
     virtual void add_custom_chunks(std::vector<std::unique_ptr<Chunk>>& v) {}
 
+    /// When extending <SoundFile>, override this function.
+    ///
+    /// It should push back any custom metadata chunks to `v`, that are to
+    /// be written after the audio data. Use this for chunks that change
+    /// size, as the chunks before the audio data can not grow.
+    virtual void add_trailing_chunks(std::vector<std::unique_ptr<Chunk>>& v) {}
+
     /// When extending <SoundFile>, override this function.
     ///
     /// It should check the id of `ptr`, and if it matches,
@@ -81,18 +114,29 @@ namespace top1 {
     friend struct WAVE_fmt;
     friend struct WAVE_data;
 
-    ByteFile::Position audioOffset;
+    friend struct AIFF_COMM;
+    friend struct AIFF_SSND;
 
-    Sample bytes_to_sample(bytes<sample_size> bytes) {
-      return bytes.cast<Sample>();
-    }
+    ByteFile::Position audioOffset = 0;
+    /// The size of the audio data, in bytes
+    ByteFile::Position audioSize = 0;
 
-    bytes<sample_size> sample_to_bytes(Sample sample) {
-      bytes<sample_size> bytes;
-      bytes.cast<Sample>() = sample;
-      return bytes;
+    /// Move the audio data to start at `offset` in the file
+    void move_audio(ByteFile::Position offset);
+
+    /// Extend `audioSize` to the current position, if past it
+    void update_audio_size() {
+      audioSize = std::max<ByteFile::Position>(audioSize,
+        pos - audioOffset);
     }
 
+    /// Read `n` samples that are not <Info::is_native>, and convert them.
+    /// Fills with zeros past the end
+    void read_converted(Sample* out, int n);
+
+    /// Convert `n` samples to the format of the file, and write them
+    void write_converted(const Sample* in, int n);
+
   };
 
   /*
@@ -102,42 +146,35 @@ namespace top1 {
   template<typename OutIter, typename>
     void SoundFile::read_samples(OutIter f, OutIter l) {
     if constexpr (std::is_pointer_v<OutIter>) {
-        auto r = ByteFile::read_bytes(reinterpret_cast<std::byte*>(f),
-          reinterpret_cast<std::byte*>(l));
-        r.if_err([&] (auto&& e) {
-            std::generate(e, l, [] { return 0; });
-          });
-      } else {
-      bytes<sample_size> buf;
-      uint i = 0;
-      for (auto iter = f; iter != l; iter++, i++) {
-        if (ByteFile::read_bytes(buf).is_err()) {
-          std::generate(iter, l, [] { return 0; });
-          break;
-        }
-        *iter = bytes_to_sample(buf);
-      }
+      read_samples(f, l - f);
+    } else {
+      read_samples(f, std::distance(f, l));
     }
   }
 
   template<typename OutIter, typename>
     void SoundFile::read_samples(OutIter&& iter, int n) {
-    if constexpr (std::is_pointer_v<OutIter>) {
-        ByteFile::read_bytes(reinterpret_cast<std::byte*>(iter),
-          n * sample_size).if_err(
-            [&] (auto&& e) {
-              std::generate_n(iter + e, n - e, [] { return 0; });
-            });
-      } else {
-      bytes<sample_size> buf;
-      uint i = 0;
-      for (auto cur = iter; i < n; iter++, i++) {
-        auto r = ByteFile::read_bytes(buf);
-        if (r.is_err()) {
-          std::generate_n(cur, n - r.unwrap_err(), [] { return 0; });
-          break;
-        }
-        *cur = bytes_to_sample(buf);
+    if constexpr (std::is_pointer_v<std::decay_t<OutIter>>) {
+      if (!info.is_native()) {
+        read_converted(iter, n);
+        return;
+      }
+      ByteFile::read_bytes(reinterpret_cast<std::byte*>(iter),
+        n * sample_size).if_err(
+          [&] (auto&& e) {
+            // `e` is the number of bytes read
+            int read = e / sample_size;
+            std::fill_n(iter + read, n - read, 0);
+          });
+    } else {
+      // Read through a buffer, one batch at a time
+      std::array<Sample, BatchSize / sample_size> buf;
+      auto out = iter;
+      while (n > 0) {
+        int batch = std::min<int>(n, buf.size());
+        read_samples(buf.data(), batch);
+        out = std::copy_n(buf.begin(), batch, out);
+        n -= batch;
       }
     }
   }
@@ -145,23 +182,33 @@ namespace top1 {
   template<typename InIter, typename>
   void SoundFile::write_samples(InIter f, InIter l) {
     if constexpr (std::is_pointer_v<InIter>) {
-      ByteFile::write_bytes(reinterpret_cast<std::byte*>(f),
-                            reinterpret_cast<std::byte*>(l));
+      write_samples(f, l - f);
     } else {
-      std::for_each(f, l, [&] (Sample s) {
-          ByteFile::write_bytes(sample_to_bytes(s));
-        });
+      write_samples(f, std::distance(f, l));
     }
   }
 
   template<typename InIter, typename>
   void SoundFile::write_samples(InIter&& i, int n) {
-    if constexpr (std::is_pointer_v<InIter>) {
-      ByteFile::write_bytes(reinterpret_cast<std::byte*>(i), n);
+    if constexpr (std::is_pointer_v<std::decay_t<InIter>>) {
+      if (info.is_native()) {
+        ByteFile::write_bytes(reinterpret_cast<const std::byte*>(i), n * sample_size);
+      } else {
+        write_converted(i, n);
+      }
     } else {
-      for_each_n(std::forward<InIter>(i), n, [&] (Sample s) {
-          ByteFile::write_bytes(sample_to_bytes(s));
-        });
+      // Write through a buffer, one batch at a time
+      std::array<Sample, BatchSize / sample_size> buf;
+      auto in = i;
+      while (n > 0) {
+        int batch = std::min<int>(n, buf.size());
+        for (int j = 0; j < batch; j++, in++) {
+          buf[j] = *in;
+        }
+        write_samples(buf.data(), batch);
+        n -= batch;
+      }
     }
+    update_audio_size();
   }
 }
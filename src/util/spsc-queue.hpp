@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <optional>
+
+namespace top1 {
+
+  /**
+   * A fixed capacity, wait-free, single-producer/single-consumer queue.
+   *
+   * One thread may push, and one other thread may pop. Nothing is allocated
+   * after construction, so either end is safe to use from the audio thread.
+   *
+   * @T The element type. Must be default constructible and copyable.
+   * @Capacity The maximum number of elements in the queue. Must be a power
+   *           of two.
+   */
+  template<typename T, std::size_t Capacity>
+  class SPSCQueue {
+    static_assert((Capacity & (Capacity - 1)) == 0,
+      "Capacity must be a power of two");
+
+    static constexpr std::size_t mask = Capacity - 1;
+
+    std::array<T, Capacity> data;
+    /// Next index to read. Only written by the consumer
+    std::atomic<std::size_t> head {0};
+    /// Next index to write. Only written by the producer
+    std::atomic<std::size_t> tail {0};
+
+  public:
+
+    SPSCQueue() = default;
+    SPSCQueue(const SPSCQueue&) = delete;
+    SPSCQueue& operator=(const SPSCQueue&) = delete;
+
+    /// Producer side. Returns false if the queue is full
+    bool push(const T& el) {
+      std::size_t t = tail.load(std::memory_order_relaxed);
+      if (t - head.load(std::memory_order_acquire) == Capacity) return false;
+      data[t & mask] = el;
+      tail.store(t + 1, std::memory_order_release);
+      return true;
+    }
+
+    /// Consumer side. Returns an empty optional if the queue is empty
+    std::optional<T> pop() {
+      std::size_t h = head.load(std::memory_order_relaxed);
+      if (h == tail.load(std::memory_order_acquire)) return std::nullopt;
+      T el = data[h & mask];
+      head.store(h + 1, std::memory_order_release);
+      return el;
+    }
+
+    /// Consumer side. The element that would be popped next, if any
+    std::optional<T> peek() const {
+      std::size_t h = head.load(std::memory_order_relaxed);
+      if (h == tail.load(std::memory_order_acquire)) return std::nullopt;
+      return data[h & mask];
+    }
+
+    bool empty() const {
+      return head.load(std::memory_order_acquire)
+        == tail.load(std::memory_order_acquire);
+    }
+
+    std::size_t size() const {
+      return tail.load(std::memory_order_acquire)
+        - head.load(std::memory_order_acquire);
+    }
+
+    static constexpr std::size_t capacity() {
+      return Capacity;
+    }
+  };
+
+} // top1
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "util/audio.hpp"
+
+/// The number of tracks on the tape. Set with the cmake option of the same name
+#ifndef TOP1_TAPE_TRACKS
+#define TOP1_TAPE_TRACKS 4
+#endif
+
+/// The default size of the tape ring buffer, in frames.
+/// Set with the cmake option of the same name
+#ifndef TOP1_TAPE_RING_SIZE
+#define TOP1_TAPE_RING_SIZE (1U << 18)
+#endif
+
+/// Whether the tape is stored compressed, see TapeFile::compression.
+/// Set with the cmake option of the same name
+#ifndef TOP1_TAPE_COMPRESSION
+#define TOP1_TAPE_COMPRESSION 0
+#endif
+
+/// Whether the tape audio is memory mapped, see TapeFile::map_audio.
+/// Set with the cmake option of the same name
+#ifndef TOP1_TAPE_MMAP
+#define TOP1_TAPE_MMAP 1
+#endif
+
+namespace top1 {
+
+  constexpr int nTapeTracks = TOP1_TAPE_TRACKS;
+
+  static_assert(nTapeTracks > 0, "The tape needs at least one track");
+
+  /// A frame of audio on all tape tracks
+  using TapeFrame = audio::AudioFrame<nTapeTracks, float>;
+
+} // top1
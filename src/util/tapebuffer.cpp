@@ -3,6 +3,8 @@
 #include <cmath>
 #include <algorithm>
 #include <mutex>
+#include <chrono>
+#include <deque>
 #include "core/globals.hpp"
 #include "util/tapefile.hpp"
 
@@ -12,201 +14,496 @@ namespace top1 {
   public:
 
     const static int MinReadSize = 2048;
+    const static int MinWriteSize = 4096;
 
     TapeBuffer& tb;
+    const fs::path path;
     TapeFile file;
-    std::recursive_mutex mutex;
 
     // Keep some space in the middle to avoid overlap fights
-    int desLength = tb.buffer.Size / 2 - 2 * sizeof(TapeBuffer::AudioFrame);
+    int desLength = tb.buffer.size / 2 - 2 * sizeof(TapeBuffer::AudioFrame);
 
-    const static uint FrameBufSize = TapeBuffer::RingBuffer::Size / 2;
-    top1::DynArray<TapeBuffer::AudioFrame> framebuf {FrameBufSize};
+    /// The most frames a lift or drop moves between refills of the buffer
+    const static int ClipboardStep = 1 << 14;
+    top1::DynArray<TapeBuffer::AudioFrame> framebuf {ClipboardStep};
     std::thread thread;
 
-    TapeDiskThread(TapeBuffer& tb)
-      : tb (tb), thread (&TapeDiskThread::main, this) {}
+    /// Recorded sections taken from `tb.buffer.written`, not yet on disk.
+    std::vector<TapeBuffer::TapeSlice> notWritten;
+
+    /// The sections the <TapeBuffer::Prefetch> buffers should hold
+    TapeBuffer::TapeSlice prefetchWanted[2];
+    /// Whether the prefetched frames were recorded over since they were read
+    bool prefetchStale[2] = {false, false};
+
+    /// The longest the block map of the file goes unwritten while it
+    /// changes, e.g. while recording past the end of the tape
+    constexpr static auto MapWriteInterval = std::chrono::seconds(1);
+    std::chrono::steady_clock::time_point mapWritten;
+
+    /// An edit that can be undone, with the slices from before it
+    struct Edit {
+      Track track;
+      TapeBuffer::TapeSliceSet slices;
+    };
+    /// Oldest first. There is a saved version in `file` for each edit
+    std::deque<Edit> journal;
+
+    /// @param synchronous Do the work in <step>, called by the audio
+    ///        thread, instead of starting a thread
+    TapeDiskThread(TapeBuffer& tb, fs::path path, bool synchronous)
+      : tb (tb), path (std::move(path)) {
+      if (synchronous) {
+        open();
+      } else {
+        thread = std::thread(&TapeDiskThread::main, this);
+      }
+    }
 
     ~TapeDiskThread() {
-      thread.join();
+      if (thread.joinable()) {
+        thread.join();
+      } else {
+        close();
+      }
+    }
+
+    /**
+     * Do the work there is to do now: write, read and handle requests.
+     * @return whether there is more to do right away
+     */
+    bool step() {
+      makeSliceRoom();
+      // Batch up small writes, unless the recording has stopped
+      if (!collectWritten() || notWrittenSize() > MinWriteSize) {
+        writeNewAudio();
+      }
+      maybeReadAllAudio();
+      maybePrefetchLoop();
+
+      // Keep going until the job is done
+      if (stepClipboardJob()) return true;
+      maybeUndo();
+      return false;
     }
 
   private:
 
+    /// Make room for more slices, before the audio thread runs out
+    void makeSliceRoom() {
+      std::size_t most = 0;
+      for (auto&& ts : tb.trackSlices) {
+        most = std::max(most, ts.makeRoom());
+      }
+      // The tracks are copied into these, so they need room for any of them
+      tb.editSlices.makeRoom(most);
+      tb.restoredSlices.makeRoom(most);
+      tb.clipboard.slices.makeRoom(most);
+    }
+
     void readSlices() {
       Track::foreach([&](Track t) {
-          auto&& slices = file.slices[t.idx];
           auto&& trackSlices = tb.trackSlices[t.idx];
-          std::for_each(slices.array.begin(), slices.array.begin()+slices.count,
-            [&] (auto&& slice) {
-              trackSlices.addSlice({(int)slice.in, (int)slice.out});
-            });
-          tb.trackSlices[t.idx].changed = false;
+          for (auto&& slice : file.slices(t.idx)) {
+            trackSlices.addSlice({(int)slice.in, (int)slice.out});
+          }
+          trackSlices.changed = false;
         });
     }
 
     void writeNewSlices() {
       Track::foreach([&](Track t) {
-          auto &tsc = file.slices[t.idx];
+          auto &tsc = file.slices(t.idx);
           auto &ts  = tb.trackSlices[t.idx];
-          for_both(ts.begin(), ts.end(), tsc.array.begin(), tsc.array.end(),
-            [](auto&& src, auto& dst) {
-              dst = {(uint32_t)src.in, (uint32_t)src.out};
-            });
-          tsc.count = ts.size();
+          tsc.clear();
+          for (auto&& slice : ts) {
+            tsc.push_back({(uint32_t)slice.in, (uint32_t)slice.out});
+          }
           ts.changed = false;
         });
     }
 
+    /// Take the recorded sections from the audio thread.
+    /// @return whether there were any
+    bool collectWritten() {
+      bool any = false;
+      while (auto section = tb.buffer.written.pop()) {
+        any = true;
+        if (section->size() == 0) {
+          // The sections before this belong to the last edit
+          flushNotWritten();
+          startEdit(tb.editTrack, tb.editSlices);
+          tb.editPending.store(false, std::memory_order_release);
+          continue;
+        }
+        for (int i = 0; i < 2; i++) {
+          auto&& want = prefetchWanted[i];
+          if (section->in < want.out && section->out > want.in) {
+            tb.prefetch[i].loaded.store({});
+            prefetchStale[i] = true;
+          }
+        }
+        auto&& last = notWritten.empty() ? *section : notWritten.back();
+        if (!notWritten.empty()
+          && section->in <= last.out && section->out >= last.in) {
+          last = {std::min(last.in, section->in), std::max(last.out, section->out)};
+        } else {
+          notWritten.push_back(*section);
+        }
+      }
+      return any;
+    }
+
+    int notWrittenSize() const {
+      int sum = 0;
+      for (auto&& s : notWritten) sum += s.size();
+      return sum;
+    }
+
     void writeNewAudio() {
-      int startIdx = tb.buffer.notWritten.in;
-      int startTime = tb.buffer.posAt0 + startIdx;
-      if (startTime < 0) {
-        startIdx = tb.buffer.notWritten.in -= startTime;
-        startTime = tb.buffer.posAt0 + tb.buffer.notWritten.in;
-      }
-      file.seek(startTime);
-      file.write_samples(tb.buffer.data.data() + tb.buffer.wrapIdx(startIdx),
-        tb.buffer.notWritten.size());
-      tb.buffer.notWritten.in = tb.buffer.notWritten.out = tb.buffer.playIdx;
-    }
-
-    void readAudioFW() {
-      uint startIdx = tb.buffer.playIdx + tb.buffer.lengthFW; 
-      file.seek(tb.buffer.posAt0 + startIdx);
-      uint nframes = desLength - tb.buffer.lengthFW;
-      framebuf.clear();
-      file.read_samples(framebuf.data(), nframes);
-      std::copy_n(framebuf.begin(), nframes, tb.buffer.begin() + startIdx);
-      tb.buffer.lengthFW += nframes;
-      int overflow = tb.buffer.lengthFW + tb.buffer.lengthBW - TapeBuffer::RingBuffer::Size;
-      if (overflow > 0) {
-        tb.buffer.lengthBW -= overflow;
-      }
-    }
-
-    void readAudioBW() {
-      uint nframes = desLength - tb.buffer.lengthBW;
-      int startIdx = tb.buffer.playIdx - tb.buffer.lengthBW - nframes; 
-      file.seek(tb.buffer.posAt0 + startIdx);
-      framebuf.clear();
-      file.read_samples(framebuf.data(), nframes);
-      std::copy_n(framebuf.begin(), nframes, tb.buffer.begin() + startIdx);
-      tb.buffer.lengthBW += nframes;
-      int overflow = tb.buffer.lengthFW + tb.buffer.lengthBW - TapeBuffer::RingBuffer::Size;
-      if (overflow > 0) {
-        tb.buffer.lengthFW -= overflow;
+      collectWritten();
+      flushNotWritten();
+    }
+
+    void flushNotWritten() {
+      for (auto section : notWritten) {
+        section.in = std::max(section.in, 0);
+        tb.buffer.forChunks(section,
+          [&] (TapeTime t, TapeBuffer::AudioFrame* frames, int n) {
+            file.seek_frame(t);
+            file.write_frames(frames, n);
+          });
+      }
+      notWritten.clear();
+      if (std::chrono::steady_clock::now() - mapWritten > MapWriteInterval) {
+        writeBlockMap();
+      }
+    }
+
+    /// Write the block map to the file, if it has changed, so the audio
+    /// recorded to new blocks survives a crash
+    void writeBlockMap() {
+      if (!file.block_map_changed()) return;
+      file.flush();
+      mapWritten = std::chrono::steady_clock::now();
+    }
+
+    /// Publish a new loaded section.
+    ///
+    /// When shrinking, call this before overwriting the frames, and when
+    /// growing, call it after the new frames are in place.
+    void setLoaded(TapeBuffer::TapeSlice loaded) {
+      tb.buffer.loaded.store(loaded);
+      std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    void readAudio(TapeBuffer::TapeSlice newData) {
+      // Recorded frames have to be on disk before they can be overwritten
+      writeNewAudio();
+      tb.buffer.forChunks(newData,
+        [&] (TapeTime t, TapeBuffer::AudioFrame* frames, int n) {
+          file.seek_frame(t);
+          file.read_frames(frames, n);
+        });
+    }
+
+    void readAudioFW(TapeTime pos, TapeBuffer::TapeSlice& loaded) {
+      TapeBuffer::TapeSlice newData = {loaded.out, pos + desLength};
+      // Make room in the other end
+      loaded.in = std::max<int>(loaded.in, newData.out - tb.buffer.size);
+      setLoaded(loaded);
+      readAudio(newData);
+      loaded.out = newData.out;
+      setLoaded(loaded);
+      file.will_need(newData.out, desLength);
+    }
+
+    void readAudioBW(TapeTime pos, TapeBuffer::TapeSlice& loaded) {
+      TapeBuffer::TapeSlice newData = {std::max(pos - desLength, 0), loaded.in};
+      if (newData.size() <= 0) return;
+      // Make room in the other end
+      loaded.out = std::min<int>(loaded.out, newData.in + tb.buffer.size);
+      setLoaded(loaded);
+      readAudio(newData);
+      loaded.in = newData.in;
+      setLoaded(loaded);
+      file.will_need(newData.in - desLength, desLength);
+    }
+
+    /// Copy prefetched frames around `pos` to the ring buffer, if there are any.
+    ///
+    /// The ring buffer must be empty.
+    void fillFromPrefetch(TapeTime pos, TapeBuffer::TapeSlice& loaded) {
+      for (auto&& pf : tb.prefetch) {
+        TapeBuffer::TapeSlice section = pf.loaded.load();
+        if (section.in <= pos && pos < section.out) {
+          writeNewAudio();
+          tb.buffer.forChunks(section,
+            [&] (TapeTime t, TapeBuffer::AudioFrame* frames, int n) {
+              std::copy_n(pf.data.data() + (t - section.in), n, frames);
+            });
+          loaded = section;
+          setLoaded(loaded);
+          return;
+        }
       }
     }
 
     void maybeReadAllAudio() {
-      if (tb.buffer.lengthFW < desLength - MinReadSize) {
-        readAudioFW();
-      }
-      if (tb.buffer.lengthBW < desLength - MinReadSize) {
-        readAudioBW(); 
-      }
-    }
-
-    void maybeLiftToClipboard() {
-      if (tb.clipboard.fromSlice.size() > 0) {
-        LOGD << "Lifting " << tb.clipboard.fromSlice.size() << " frames from "
-             << tb.clipboard.fromSlice.in;
-        std::unique_lock<std::mutex> clipboardLock (tb.clipboard.lock);
-        TapeBuffer::TapeSlice readSlice = {
-          tb.clipboard.fromSlice.in,
-          tb.clipboard.fromSlice.in
-        };
-        tb.clipboard.data.clear();
-        framebuf.clear();
-        while(readSlice.out < tb.clipboard.fromSlice.out) {
-          readSlice.out = std::min<int>(readSlice.in + FrameBufSize,
-                                        tb.clipboard.fromSlice.out);
-          file.seek(readSlice.in);
-          file.read_samples(framebuf.data(), readSlice.size());
-          for (int i = 0; i < readSlice.size(); i++) {
-            tb.clipboard.data.push_back(framebuf[i][tb.clipboard.fromTrack.idx]);
-            framebuf[i][tb.clipboard.fromTrack.idx] = 0;
-          }
-          file.seek(readSlice.in);
-          file.write_samples(framebuf.data(), readSlice.size());
-          readSlice.in = readSlice.out;
+      TapeTime pos = tb.playPoint;
+      TapeBuffer::TapeSlice loaded = tb.buffer.loaded.load();
+      if (!loaded.contains(pos)) {
+        // The playPoint has jumped. Start over from there
+        loaded = {pos, pos};
+        setLoaded(loaded);
+        fillFromPrefetch(pos, loaded);
+      }
+      if (loaded.out - pos < desLength - MinReadSize) {
+        readAudioFW(pos, loaded);
+      }
+      if (pos - loaded.in < desLength - MinReadSize) {
+        readAudioBW(pos, loaded);
+      }
+    }
+
+    /// Discard the loaded data, and load it again from disk
+    void reloadAllAudio() {
+      for (auto&& stale : prefetchStale) stale = true;
+      maybePrefetchLoop();
+      TapeTime pos = tb.playPoint;
+      setLoaded({pos, pos});
+      maybeReadAllAudio();
+    }
+
+    /// Read the frames after the loop in point, and before the loop out
+    /// point, into the prefetch buffers, if the loop has changed.
+    void maybePrefetchLoop() {
+      TapeBuffer::TapeSlice loop = tb.loop.load();
+      TapeBuffer::TapeSlice wanted[2] = {};
+      if (loop.size() > 0) {
+        // When going backwards, the jump is to loop.out, and that frame
+        // is read first
+        int size = tb.prefetch[0].size;
+        wanted[0] = {loop.in, loop.in + size};
+        wanted[1] = {std::max(loop.out + 1 - size, 0), loop.out + 1};
+      }
+      for (int i = 0; i < 2; i++) {
+        auto&& pf = tb.prefetch[i];
+        if (wanted[i].in == prefetchWanted[i].in
+          && wanted[i].out == prefetchWanted[i].out
+          && !prefetchStale[i]) continue;
+
+        pf.loaded.store({});
+        std::atomic_thread_fence(std::memory_order_release);
+        prefetchWanted[i] = wanted[i];
+        prefetchStale[i] = false;
+        if (wanted[i].size() <= 0) continue;
+
+        // Recorded frames have to be read back from disk
+        writeNewAudio();
+        file.seek_frame(wanted[i].in);
+        file.read_frames(pf.data.data(), wanted[i].size());
+        pf.loaded.store(wanted[i]);
+      }
+    }
+
+    /**
+     * Take `section` out of the ring buffer, so the audio thread leaves it
+     * alone while it is changed on disk.
+     *
+     * `loaded` is shrunk to the side of `section` the playPoint is on, and
+     * the frames recorded so far are flushed.
+     * @return `loaded` from before, to put back with <patchBuffers>
+     */
+    TapeBuffer::TapeSlice takeOut(TapeBuffer::TapeSlice section) {
+      TapeBuffer::TapeSlice loaded = tb.buffer.loaded.load();
+      if (section.in < loaded.out && section.out > loaded.in) {
+        TapeTime pos = tb.playPoint;
+        if (pos < section.in) {
+          setLoaded({loaded.in, section.in});
+        } else {
+          setLoaded({std::max(section.out, loaded.in),
+                     std::max(section.out, loaded.out)});
         }
-        tb.buffer.lengthFW = tb.buffer.lengthBW = 0;
-        maybeReadAllAudio();
-        tb.clipboard.fromSlice = {0,0};
-      }
-    }
-
-    void maybeDropFromClipboard() {
-      if (tb.clipboard.toTime >= 0 && !tb.clipboard.data.empty()) {
-        std::unique_lock clipboardLock (tb.clipboard.lock);
-        LOGD << "Dropping "   << tb.clipboard.data.size()
-             << " frames at " << tb.clipboard.toTime;
-        TapeBuffer::TapeSlice writeSlice = {
-          tb.clipboard.toTime,
-          tb.clipboard.toTime
-        };
-        while(true) {
-          uint startIdx = writeSlice.in - tb.clipboard.toTime;
-          writeSlice.out = writeSlice.in + std::min<int>(
-            FrameBufSize, tb.clipboard.data.size() - startIdx);
-
-          if ((ulong)writeSlice.size() > tb.clipboard.data.size()) break;
-          if (writeSlice.size() == 0) break;
-
-          framebuf.clear();
-          file.seek(writeSlice.in);
-          file.read_samples(framebuf.data(), writeSlice.size());
-          int i;
-          for (i = 0; i < writeSlice.size(); i++) {
-            framebuf[i][tb.clipboard.toTrack.idx] = tb.clipboard.data[startIdx + i];
-          }
-          LOGD << i;
-          file.seek(writeSlice.in);
-          file.write_samples(framebuf.data(), writeSlice.size());
-          writeSlice.in = writeSlice.out;
+      }
+      // Recorded frames have to be on disk before they are read back, and
+      // before the track is patched under them
+      writeNewAudio();
+      return loaded;
+    }
+
+    /// Overwrite a track in the ring buffer with the frames in `framebuf`,
+    /// which hold `section` as it is now on disk, and put back `loaded` from
+    /// <takeOut>. The prefetch buffers are read again.
+    void patchBuffers(TapeBuffer::TapeSlice section, uint track,
+                      TapeBuffer::TapeSlice loaded) {
+      TapeBuffer::TapeSlice overlap = {std::max(section.in, loaded.in),
+                                       std::min(section.out, loaded.out)};
+      if (overlap.size() > 0) {
+        tb.buffer.forChunks(overlap,
+          [&] (TapeTime t, TapeBuffer::AudioFrame* frames, int n) {
+            auto src = framebuf.data() + (t - section.in);
+            for (int i = 0; i < n; i++) frames[i][track] = src[i][track];
+          });
+        // Nothing else was written to the frames taken out, so all of them
+        // are good again
+        setLoaded(loaded);
+      }
+      for (int i = 0; i < 2; i++) {
+        auto&& want = prefetchWanted[i];
+        if (section.in < want.out && section.out > want.in) {
+          tb.prefetch[i].loaded.store({});
+          prefetchStale[i] = true;
         }
-        tb.buffer.lengthFW = tb.buffer.lengthBW = 0;
-        maybeReadAllAudio();
-        tb.clipboard.toTime = -1;
       }
     }
 
-    void main() {
+    /// Save a version of the tape to undo to.
+    ///
+    /// Everything recorded up to now must be on disk.
+    void startEdit(Track track, const TapeBuffer::TapeSliceSet& slices) {
+      file.push_version();
+      journal.push_back({track, slices});
+      if (journal.size() > TapeBuffer::UndoLevels) {
+        file.drop_oldest_version();
+        journal.pop_front();
+      }
+      writeBlockMap();
+    }
 
-      // TODO: figure out why this is needed for GDB to not crash
-      std::this_thread::sleep_for(std::chrono::milliseconds(100));
-      tb.movePlaypointAbs(0);
+    /// Undo the requested edits, unless a lift or drop is running.
+    ///
+    /// The restored slices are handed to the audio thread, one undo at a
+    /// time. Further undos wait until it has taken them.
+    void maybeUndo() {
+      using Job = TapeBuffer::Clipboard::Job;
+      if (tb.undoRequests == 0) return;
+      if (tb.clipboard.job.load(std::memory_order_acquire) != Job::None) return;
+      if (tb.restorePending.load(std::memory_order_acquire)) return;
+
+      // The whole tape may change under the loaded frames. Take them from
+      // the audio thread before the recordings to them are flushed, so
+      // nothing from before the undo is written after it.
+      TapeTime pos = tb.playPoint;
+      setLoaded({pos, pos});
+      for (auto&& pf : tb.prefetch) pf.loaded.store({});
+      writeNewAudio();
+      while (tb.undoRequests > 0) {
+        if (tb.restorePending.load(std::memory_order_acquire)) break;
+        tb.undoRequests--;
+        if (journal.empty() || !file.pop_version()) {
+          LOGD << "Nothing to undo";
+          continue;
+        }
+        Edit edit = std::move(journal.back());
+        journal.pop_back();
+        tb.restoredSlices = edit.slices;
+        tb.restoredTrack = edit.track;
+        tb.restorePending.store(true, std::memory_order_release);
+      }
+      writeBlockMap();
+      reloadAllAudio();
+    }
+
+    /// Do the next step of the running lift or drop, if any.
+    /// @return whether there is more to do
+    bool stepClipboardJob() {
+      using Job = TapeBuffer::Clipboard::Job;
+      auto&& cb = tb.clipboard;
+      Job job = cb.job.load(std::memory_order_acquire);
+      if (job == Job::None) return false;
+
+      int done = cb.progress;
+      if (done == 0) {
+        writeNewAudio();
+        startEdit(cb.track, cb.slices);
+        if (job == Job::Lift) {
+          // Only allocates if the slice is longer than the reserved space
+          cb.data.resize(cb.section.size());
+        }
+      }
 
-      // FIXME: Hardcoded
+      TapeBuffer::TapeSlice step = {
+        cb.section.in + done,
+        cb.section.in + std::min<int>(done + ClipboardStep, cb.section.size())
+      };
+      uint track = cb.track.idx;
+      TapeBuffer::TapeSlice loaded = takeOut(step);
+      file.seek_frame(step.in);
+      file.read_frames(framebuf.data(), step.size());
+      float* clip = cb.data.data() + done;
+      for (int i = 0; i < step.size(); i++) {
+        if (job == Job::Lift) {
+          clip[i] = framebuf[i][track];
+          framebuf[i][track] = 0;
+        } else {
+          framebuf[i][track] = clip[i];
+        }
+      }
+      file.seek_frame(step.in);
+      file.write_frames(framebuf.data(), step.size());
+      patchBuffers(step, track, loaded);
+
+      done += step.size();
+      cb.progress = done;
+      if (done < cb.section.size()) return true;
+
+      LOGD << (job == Job::Lift ? "Lifted " : "Dropped ") << done
+           << " frames at " << cb.section.in;
+      writeBlockMap();
+      cb.job.store(Job::None, std::memory_order_release);
+      return false;
+    }
+
+    void open() {
       try {
-        file.open("data/tape.wav");
+        file.open(path);
         file.info.samplerate = Globals::samplerate;
-      } catch (ByteFile::Error){
+      } catch (ByteFile::Error& e) {
+        LOGF << "Could not open the tape file: " << e.what();
         Globals::exit();
+        return;
+      } catch (const char* e) {
+        LOGF << "Could not open the tape file: " << e;
+        Globals::exit();
+        return;
+      }
+
+      if (TOP1_TAPE_MMAP) {
+        try {
+          file.map_audio();
+        } catch (ByteFile::Error& e) {
+          LOGE << "Could not map the tape file, reading it unmapped: "
+               << e.what();
+        }
       }
 
       readSlices();
+    }
 
-      while(Globals::running()) {
-        std::unique_lock lock (mutex);
+    void close() {
+      writeNewAudio();
+      writeNewSlices();
+      file.put_in_order();
+      file.unmap_audio();
+      file.close();
+    }
 
-        if (tb.buffer.notWritten.size() > 4096) {
-          writeNewAudio();
-        }
-        maybeReadAllAudio();
+    void main() {
 
-        maybeLiftToClipboard();
-        maybeDropFromClipboard();
+      // TODO: figure out why this is needed for GDB to not crash
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
 
-        tb.clipboard.done.notify_all();
+      open();
 
-        tb.readData.wait(lock);
+      while(Globals::running()) {
+        if (step()) continue;
+        // Wake up regularly anyway, in case a wake up was missed
+        tb.diskWake.wait_for(std::chrono::milliseconds(10));
+        tb.diskWakePosted.store(false);
       }
 
-      writeNewSlices();
-      file.close();
+      close();
     }
 
     };
@@ -215,237 +512,478 @@ namespace top1 {
     /*  TapeBuffer Implementation              */
     /*******************************************/
 
-  TapeBuffer::TapeBuffer() : playPoint (0), newCuts (false) {}
+  /// Round up to a power of two
+  static uint ceilPow2(uint n) {
+    uint p = 1;
+    while (p < n) p <<= 1;
+    return p;
+  }
+
+  TapeBuffer::TapeBuffer(uint ringSize)
+    : playPoint (0),
+      buffer (ceilPow2(std::max(ringSize, 1U << 14))) {}
 
   TapeBuffer::~TapeBuffer() {}
 
-  void TapeBuffer::init() {
-    diskThread = std::make_unique<TapeDiskThread>(*this);
+  void TapeBuffer::init(fs::path path, bool synchronous) {
+    diskThread = std::make_unique<TapeDiskThread>(*this, std::move(path),
+                                                  synchronous);
+    this->synchronous = synchronous;
+  }
+
+  void TapeBuffer::syncDisk() {
+    if (!synchronous || !diskThread || !Globals::running()) return;
+    while (diskThread->step());
   }
 
   void TapeBuffer::exit() {
-    readData.notify_all();
+    diskWake.post();
     diskThread.reset();
   }
 
   // Disk handling:
 
-    void TapeBuffer::threadRoutine() {
-    }
-
     void TapeBuffer::movePlaypointRel(int time) {
       movePlaypointAbs(playPoint + time);
     }
 
+    void TapeBuffer::wakeDiskThread() {
+      if (!diskWakePosted.exchange(true)) {
+        diskWake.post();
+      }
+    }
+
     void TapeBuffer::movePlaypointAbs(int newPos) {
-      std::unique_lock lock{diskThread->mutex};
       if (newPos < 0) {
         newPos = 0;
       }
-      uint oldPos = playPoint;
-      int diff = newPos - oldPos;
-      if (diff <= buffer.lengthFW && diff >= -buffer.lengthBW) {
-        // The new position is within the loaded section, so keep that data
-        // TODO: This should probably also happen if the new position is just
-        //   slightly outside the section.
-        //   That could be fixed with setting negative FW/BW lenghts
-        // NOTE: Section::overlaps has the correct algorithm for this
-        buffer.playIdx = buffer.wrapIdx(newPos - buffer.posAt0);
-        buffer.lengthBW += diff;
-        buffer.lengthFW -= diff;
-      } else {
-        // just discard the data
-        buffer.lengthBW = 0;
-        buffer.lengthFW = 0;
+      playPoint = newPos;
+      wakeDiskThread();
+    }
+
+    void TapeBuffer::markWritten(TapeSlice section) {
+      wakeDiskThread();
+      if (!buffer.written.push(section)) {
+        // The disk thread is hopelessly behind
+        lostFrames += section.size();
+      }
+    }
+
+    std::size_t TapeBuffer::readPrefetchFW(gsl::span<AudioFrame> out) {
+      TapeTime pos = playPoint;
+      for (auto&& pf : prefetch) {
+        TapeSlice loaded = pf.loaded.load();
+        if (!(loaded.in <= pos && pos < loaded.out)) continue;
+        int n = std::min<int>(loaded.out - pos, out.size());
+        std::copy_n(pf.data.data() + (pos - loaded.in), n, out.begin());
+        std::fill(out.begin() + n, out.end(), AudioFrame{});
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        loaded = pf.loaded.load();
+        if (!(loaded.in <= pos && pos + n <= loaded.out)) {
+          std::fill(out.begin(), out.end(), AudioFrame{});
+        }
+        movePlaypointRel(n);
+        return n;
       }
-      uint newTime = newPos - buffer.playIdx;
-      if (newTime != buffer.posAt0) {
-        buffer.notWritten.in += buffer.posAt0 - newTime;
-        buffer.notWritten.out += buffer.posAt0 - newTime;
-        buffer.posAt0 = newTime;
+      return 0;
+    }
+
+    std::size_t TapeBuffer::readPrefetchBW(gsl::span<AudioFrame> out) {
+      TapeTime pos = playPoint;
+      for (auto&& pf : prefetch) {
+        TapeSlice loaded = pf.loaded.load();
+        if (!(loaded.in <= pos && pos < loaded.out)) continue;
+        int n = std::min<int>(pos - loaded.in + 1, out.size());
+        auto first = pf.data.data() + (pos - loaded.in - n + 1);
+        std::reverse_copy(first, first + n, out.begin());
+        std::fill(out.begin() + n, out.end(), AudioFrame{});
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        loaded = pf.loaded.load();
+        if (!(loaded.in <= pos - n + 1 && pos < loaded.out)) {
+          std::fill(out.begin(), out.end(), AudioFrame{});
+        }
+        movePlaypointRel(-n);
+        return n;
       }
-      playPoint = newPos;
-      readData.notify_all();
+      return 0;
     }
 
     // Fancy wrapper methods!
-    std::vector<TapeBuffer::AudioFrame> TapeBuffer::readFW(uint nframes) {
-      uint n = std::min<int>(nframes, buffer.lengthFW);
+    std::size_t TapeBuffer::readFW(gsl::span<AudioFrame> out) {
+      TapeTime pos = playPoint;
+      TapeSlice loaded = buffer.loaded.load();
+      int n = 0;
+      if (loaded.in <= pos) {
+        n = std::clamp<int>(loaded.out - pos, 0, out.size());
+      }
+      if (n == 0) {
+        // Just after a jump, before the disk thread has caught up
+        if (auto read = readPrefetchFW(out); read > 0) return read;
+      }
 
-      std::vector<AudioFrame> ret;
+      buffer.forChunks({pos, pos + n}, [&] (TapeTime t, AudioFrame* frames, int c) {
+          std::copy_n(frames, c, out.begin() + (t - pos));
+        });
+      std::fill(out.begin() + n, out.end(), AudioFrame{});
 
-      for (uint i = 0; i < n; i++) {
-        ret.push_back(buffer[buffer.playIdx + i]);
+      // Discard any frames the disk thread took back while they were copied
+      std::atomic_thread_fence(std::memory_order_acquire);
+      loaded = buffer.loaded.load();
+      for (int i = 0; i < n; i++) {
+        if (!(loaded.in <= pos + i && pos + i < loaded.out)) out[i] = AudioFrame{};
       }
 
       movePlaypointRel(n);
 
-      return ret;
+      return n;
     }
 
-    std::vector<TapeBuffer::AudioFrame> TapeBuffer::readBW(uint nframes) {
-      uint n = std::min<int>(nframes, buffer.lengthBW);
+    std::size_t TapeBuffer::readBW(gsl::span<AudioFrame> out) {
+      TapeTime pos = playPoint;
+      TapeSlice loaded = buffer.loaded.load();
+      int n = 0;
+      if (pos < loaded.out) {
+        n = std::clamp<int>(pos - loaded.in + 1, 0, out.size());
+      }
+      if (n == 0) {
+        // Just after a jump, before the disk thread has caught up
+        if (auto read = readPrefetchBW(out); read > 0) return read;
+      }
 
-      std::vector<AudioFrame> ret;
+      // out[i] is the frame at pos - i
+      buffer.forChunks({pos - n + 1, pos + 1}, [&] (TapeTime t, AudioFrame* frames, int c) {
+          std::reverse_copy(frames, frames + c, out.begin() + (pos - (t + c - 1)));
+        });
+      std::fill(out.begin() + n, out.end(), AudioFrame{});
 
-      for (uint i = 0; i < n; i++) {
-        ret.push_back(buffer[buffer.playIdx - i]);
+      // Discard any frames the disk thread took back while they were copied
+      std::atomic_thread_fence(std::memory_order_acquire);
+      loaded = buffer.loaded.load();
+      for (int i = 0; i < n; i++) {
+        if (!(loaded.in <= pos - i && pos - i < loaded.out)) out[i] = AudioFrame{};
       }
 
       movePlaypointRel(-n);
 
-      return ret;
+      return n;
     }
 
-    uint TapeBuffer::writeFW(std::vector<AudioFrame> data,
-                             uint offset,
-                             std::function<AudioFrame(AudioFrame, AudioFrame)> writeFunc)
+    /// The write kernels, one per <TapeBuffer::WriteMode>
+    template<TapeBuffer::WriteMode Mode, int Dir>
+    static void writeFrames(TapeBuffer::AudioFrame* frames, const float* data,
+                            int n, uint track, float gain, float gainStep)
     {
-      std::unique_lock lock{diskThread->mutex};
-      int n = std::min<int>(data.size(), buffer.Size - buffer.lengthFW);
+      using WM = TapeBuffer::WriteMode;
+      for (int i = 0; i < n; i++) {
+        float& o = frames[i][track];
+        if constexpr (Mode == WM::Overwrite) {
+          o = data[Dir * i];
+        } else if constexpr (Mode == WM::Overdub) {
+          o += data[Dir * i];
+        } else if constexpr (Mode == WM::Erase) {
+          o = 0;
+        } else if constexpr (Mode == WM::Crossfade) {
+          float g = gain + gainStep * i;
+          o += g * (data[Dir * i] - o);
+        }
+      }
+    }
+
+    template<int Dir>
+    bool TapeBuffer::writeLoaded(const float* data,
+                                 TapeSlice region,
+                                 Track track,
+                                 WriteMode mode,
+                                 float gain,
+                                 float gainStep)
+    {
+      TapeSlice loaded = buffer.loaded.load();
+      if (region.in < loaded.in || region.out > loaded.out) return false;
+
+      auto kernel = [mode] {
+        switch (mode) {
+        case WriteMode::Overwrite: return writeFrames<WriteMode::Overwrite, Dir>;
+        case WriteMode::Overdub:   return writeFrames<WriteMode::Overdub, Dir>;
+        case WriteMode::Erase:     return writeFrames<WriteMode::Erase, Dir>;
+        case WriteMode::Crossfade: return writeFrames<WriteMode::Crossfade, Dir>;
+        }
+        return writeFrames<WriteMode::Overdub, Dir>;
+      }();
+
+      buffer.forChunks(region, [&] (TapeTime t, AudioFrame* frames, int c) {
+          // Index in `data` of the frame at `t`
+          int idx = Dir > 0 ? t - region.in : region.out - 1 - t;
+          kernel(frames, data + idx, c, track.idx,
+                 gain + gainStep * idx, gainStep * Dir);
+        });
 
-      int beginPos = buffer.playIdx - n - offset;
+      markWritten(region);
+      return true;
+    }
 
-      for (int i = 0; i < n; i++) {
-        buffer[beginPos + i] = writeFunc(buffer[beginPos + i], data[i]);
+    int TapeBuffer::PendingWrites::alloc(int n) {
+      if (count == 0) dataEnd = 0;
+      int dataBegin = count > 0 ? front().at : 0;
+      int at = -1;
+      if (count == 0 || dataEnd > dataBegin) {
+        // The data in use is [dataBegin, dataEnd)
+        if (dataEnd + n <= Capacity) at = dataEnd;
+        else if (n < dataBegin) at = 0;
+      } else if (dataEnd + n < dataBegin) {
+        // The data in use wraps around, and [dataEnd, dataBegin) is free
+        at = dataEnd;
       }
+      if (at >= 0) dataEnd = at + n;
+      return at;
+    }
 
-      if (buffer.notWritten) {
-        buffer.notWritten.in =
-          std::min<int>(buffer.notWritten.in, beginPos);
-        buffer.notWritten.out =
-          std::max<int>(buffer.notWritten.out, buffer.playIdx);
-      } else {
-        buffer.notWritten.in = beginPos;
-        buffer.notWritten.out = buffer.playIdx;
+    template<int Dir>
+    std::size_t TapeBuffer::write(gsl::span<const float> data,
+                                  TapeSlice region,
+                                  Track track,
+                                  WriteMode mode,
+                                  float gain,
+                                  float gainStep)
+    {
+      if (region.in < 0) {
+        // Skip the frames before the start of the tape
+        int skip = std::min<int>(-region.in, data.size());
+        if (Dir > 0) {
+          data = data.subspan(skip);
+          gain += gainStep * skip;
+        } else {
+          data = data.first(data.size() - skip);
+        }
+        region.in = 0;
       }
+      if (data.size() == 0) return 0;
 
-      buffer.lengthBW =
-        std::max<int>(data.size(), buffer.lengthBW);
-      buffer.lengthFW =
-        std::min<int>(buffer.lengthFW, buffer.Size - buffer.lengthBW);
+      // Earlier writes have to be done first
+      flushPendingWrites();
+      if (pending.count == 0
+        && writeLoaded<Dir>(data.data(), region, track, mode, gain, gainStep)) {
+        return 0;
+      }
 
-      return data.size() - n;
+      int at = pending.count < PendingWrites::MaxWrites
+        ? pending.alloc(data.size()) : -1;
+      if (at < 0) {
+        lostFrames += data.size();
+        return data.size();
+      }
+      std::copy(data.begin(), data.end(), pending.data.begin() + at);
+      pending.writes[(pending.first + pending.count) % PendingWrites::MaxWrites]
+        = {region, Dir, track, mode, gain, gainStep, at};
+      pending.count++;
+      wakeDiskThread();
+      return 0;
     }
 
-    uint TapeBuffer::writeBW(std::vector<AudioFrame> data,
-                           uint offset,
-                           std::function<AudioFrame(AudioFrame, AudioFrame)> writeFunc)
-  {
-    std::unique_lock<std::recursive_mutex> lock (diskThread->mutex);
-    int n = std::min<int>(data.size(), buffer.Size - buffer.lengthBW);
+    void TapeBuffer::flushPending() {
+      TapeTime pos = playPoint;
+      // The disk thread loads up to half the buffer on each side of the
+      // playPoint. Further away, the frames are not loaded until the tape is
+      // back there, and by then the recording is stale.
+      int reach = buffer.size / 4;
+      while (pending.count > 0) {
+        auto&& w = pending.front();
+        const float* data = pending.data.data() + w.at;
+        if (w.region.out < pos - reach || w.region.in > pos + reach) {
+          lostFrames += w.region.size();
+        } else if (w.dir > 0) {
+          if (!writeLoaded<1>(data, w.region, w.track, w.mode, w.gain, w.gainStep)) break;
+        } else {
+          if (!writeLoaded<-1>(data, w.region, w.track, w.mode, w.gain, w.gainStep)) break;
+        }
+        pending.pop();
+      }
+    }
 
-    int endPos = buffer.playIdx + n + offset;
+    /// The change of the crossfade gain per frame, so it goes from `fade.in`
+    /// on the first of `n` frames to `fade.out` on the last
+    static float fadeStep(audio::Section<float> fade, int n) {
+      return n > 1 ? (fade.out - fade.in) / (n - 1) : 0;
+    }
 
-    for (int i = 0; i < n; i++) {
-      buffer[endPos - i]= writeFunc(buffer[endPos - i], data[i]);
+    std::size_t TapeBuffer::writeFW(gsl::span<const float> data,
+                                    Track track,
+                                    WriteMode mode,
+                                    uint offset,
+                                    audio::Section<float> fade)
+    {
+      TapeTime end = playPoint - offset;
+      float gainStep = fadeStep(fade, data.size());
+      return write<1>(data, {end - (int) data.size(), end}, track, mode,
+                      fade.in, gainStep);
     }
 
-    if (buffer.notWritten) {
-      buffer.notWritten.in =
-        std::min<int>(buffer.notWritten.in, buffer.playIdx);
-      buffer.notWritten.out =
-        std::max<int>(buffer.notWritten.out, endPos);
-    } else {
-      buffer.notWritten.in = buffer.playIdx;
-      buffer.notWritten.out = endPos;
+    std::size_t TapeBuffer::writeBW(gsl::span<const float> data,
+                                    Track track,
+                                    WriteMode mode,
+                                    uint offset,
+                                    audio::Section<float> fade)
+    {
+      TapeTime begin = playPoint + offset;
+      float gainStep = fadeStep(fade, data.size());
+      return write<-1>(data, {begin, begin + (int) data.size()}, track, mode,
+                       fade.in, gainStep);
     }
 
-    buffer.lengthFW =
-      std::max<int>(data.size(), buffer.lengthFW);
-    buffer.lengthBW =
-      std::min<int>(buffer.lengthBW, buffer.Size - buffer.lengthFW);
+  void TapeBuffer::goTo(TapeTime pos) {
+    movePlaypointAbs(pos);
+  }
 
-    return data.size() - n;
+  void TapeBuffer::requestGoTo(TapeTime pos) {
+    requestedPos = std::max(pos, 0);
+    wakeDiskThread();
   }
 
-  void TapeBuffer::goTo(TapeTime pos) {
-    movePlaypointAbs(pos);
+  void TapeBuffer::setLoop(TapeSlice newLoop) {
+    TapeSlice old = loop.load();
+    if (old.in == newLoop.in && old.out == newLoop.out) return;
+    loop.store(newLoop);
+    wakeDiskThread();
+  }
+
+  void TapeBuffer::applyPendingJump() {
+    TapeTime pos = requestedPos.exchange(-1);
+    if (pos >= 0) {
+      movePlaypointAbs(pos);
+    }
   }
 
   // Cuts & Slices
+  TapeBuffer::TapeSliceSet::TapeSliceSet(const TapeSliceSet& other)
+    : slices (other.slices), changed (other.changed) {
+    publishSize();
+  }
+
+  TapeBuffer::TapeSliceSet&
+  TapeBuffer::TapeSliceSet::operator=(const TapeSliceSet& other) {
+    if (&other == this) return *this;
+    takeRoom();
+    // Within the capacity, this copies without allocating
+    slices.assign(other.slices.begin(), other.slices.end());
+    changed = other.changed;
+    publishSize();
+    return *this;
+  }
+
+  void TapeBuffer::TapeSliceSet::takeRoom() {
+    if (!spareReady.load(std::memory_order_acquire)) return;
+    // The set may have grown past the spare room by allocating
+    if (spare.capacity() > slices.capacity()) {
+      spare.assign(slices.begin(), slices.end());
+      slices.swap(spare);
+      publishSize();
+    }
+    spareReady.store(false, std::memory_order_release);
+  }
+
+  void TapeBuffer::TapeSliceSet::publishSize() {
+    count.store(slices.size(), std::memory_order_relaxed);
+    room.store(slices.capacity(), std::memory_order_relaxed);
+  }
+
+  std::size_t TapeBuffer::TapeSliceSet::makeRoom(std::size_t atLeast) {
+    if (spareReady.load(std::memory_order_acquire)) return spareRoom;
+    std::size_t have = room.load(std::memory_order_relaxed);
+    if (count.load(std::memory_order_relaxed) <= have / 2 && atLeast <= have) {
+      // Free the slices left behind by <takeRoom>
+      if (spare.capacity() > 0) std::vector<TapeSlice>().swap(spare);
+      return have;
+    }
+    std::vector<TapeSlice> fresh;
+    fresh.reserve(std::max(2 * have, atLeast));
+    spare.swap(fresh);
+    spareRoom = spare.capacity();
+    spareReady.store(true, std::memory_order_release);
+    return spareRoom;
+  }
+
+  TapeBuffer::TapeSliceSet::const_iterator
+  TapeBuffer::TapeSliceSet::firstEndingAfter(TapeTime time) const {
+    // Slices never overlap, so they are sorted by `out` as well
+    return std::lower_bound(slices.begin(), slices.end(), time,
+      [] (const TapeSlice& s, TapeTime t) { return s.out < t; });
+  }
+
+  TapeBuffer::TapeSliceSet::iterator
+  TapeBuffer::TapeSliceSet::firstEndingAfter(TapeTime time) {
+    return std::lower_bound(slices.begin(), slices.end(), time,
+      [] (const TapeSlice& s, TapeTime t) { return s.out < t; });
+  }
+
   std::vector<TapeBuffer::TapeSlice>
   TapeBuffer::TapeSliceSet::slicesIn(audio::Section<TapeTime> area) const {
-    std::vector<TapeBuffer::TapeSlice> xs;
-    if (slices.size() == 0) {
-      return xs;
-    }
-    auto it = slices.upper_bound(area);
-    if (it != slices.begin()) --it;
-    if (it == slices.end()) it = slices.begin();
-    if (!it->overlaps(area)) it++;
-    for (; it != slices.end(); it++) {
-      if (area.overlaps(*it)) {
-        xs.push_back(*it);
-      } else {
-        break;
-      }
-    }
-    return xs;
+    auto first = firstEndingAfter(area.in);
+    auto last = first;
+    while (last != slices.end() && last->in <= area.out) last++;
+    return {first, last};
   }
 
   bool TapeBuffer::TapeSliceSet::inSlice(TapeTime time) const {
-    if (slices.size() == 0) return false;
-    auto it = slices.upper_bound({time, time});
-    if (it != slices.begin()) {
-      it--;
-    }
-    if (it->contains(time)) {
-      return true;
-    } else {
-      it++;
-      return it->contains(time);
-    }
+    auto it = firstEndingAfter(time);
+    return it != slices.end() && it->in <= time;
   }
 
   TapeBuffer::TapeSlice TapeBuffer::TapeSliceSet::current(TapeTime time) const {
-    auto it = slices.upper_bound({time, time});
-    if (it != slices.begin()) {
-      it--;
-    }
-    if (it->contains(time)) {
+    auto it = firstEndingAfter(time);
+    if (it != slices.end() && it->in <= time) {
       return *it;
-    } else {
-      it++;
-      if (it->contains(time))
-        return *it;
-      return {0, 0};
     }
+    return {0, 0};
   }
 
   void TapeBuffer::TapeSliceSet::erase(TapeBuffer::TapeSlice slice) {
     if (slice.size() < 1) return;
-    for (auto &s : slicesIn(slice)) {
-      switch (slice.overlaps(s)) {
-      case audio::Section<>::None:
-        break;
-      case audio::Section<>::Contains:
-        slices.erase(s);
-        break;
-      case audio::Section<>::Contained:
-        slices.erase(s);
-        if (s.in != slice.in)
-          slices.emplace(s.in, slice.in - 1);
-        if (s.out != slice.out)
-          slices.emplace(slice.out + 1, s.out);
-        break;
-      case audio::Section<>::ContainsIn:
-        slices.erase(s);
-        slices.emplace(slice.out + 1, s.out);
-        break;
-      case audio::Section<>::ContainsOut:
-        slices.erase(s);
-        slices.emplace(s.in, slice.in - 1);
-        break;
-      }
+    takeRoom();
+    auto first = firstEndingAfter(slice.in);
+    auto last = first;
+    while (last != slices.end() && last->in <= slice.out) last++;
+    if (first == last) return;
+
+    // Keep what sticks out on either side
+    TapeSlice rest[2];
+    int nRest = 0;
+    if (first->in < slice.in) {
+      rest[nRest++] = {first->in, slice.in - 1};
     }
+    if ((last - 1)->out > slice.out) {
+      rest[nRest++] = {slice.out + 1, (last - 1)->out};
+    }
+    auto pos = slices.erase(first, last);
+    slices.insert(pos, rest, rest + nRest);
+    publishSize();
     changed = true;
   }
 
   void TapeBuffer::TapeSliceSet::addSlice(TapeBuffer::TapeSlice slice) {
-    erase(slice);
-    slices.emplace(slice.in, slice.out);
     changed = true;
+    takeRoom();
+    auto it = firstEndingAfter(slice.in);
+    if (it != slices.end()) {
+      // The slice being recorded grows by a little every period.
+      // Extend it in place, if nothing else is in the way
+      auto next = std::next(it);
+      if (it->in == slice.in && slice.out >= it->out
+        && (next == slices.end() || next->in > slice.out)) {
+        it->out = slice.out;
+        return;
+      }
+      if (it->out == slice.out && slice.in <= it->in
+        && (it == slices.begin() || std::prev(it)->out < slice.in)) {
+        it->in = slice.in;
+        return;
+      }
+    }
+    erase(slice);
+    auto pos = std::upper_bound(slices.begin(), slices.end(), slice,
+      [] (const TapeSlice& a, const TapeSlice& b) { return a.in < b.in; });
+    slices.insert(pos, slice);
+    publishSize();
   }
 
   void TapeBuffer::TapeSliceSet::cut(TapeTime time) {
@@ -459,32 +997,114 @@ namespace top1 {
     addSlice({std::min(s1.in, s2.in), std::max(s1.out, s2.out)});
   }
 
-      void TapeBuffer::lift(Track track) {
-        TapeSliceSet &tss = trackSlices[track.idx];
-        if (!tss.inSlice(position())) {
-          LOGD << "No slice to lift";
-          return;
-        }
-        TapeSlice slice = tss.current(position());
-        std::unique_lock<std::mutex> lock(clipboard.lock);
-        clipboard.fromTrack = track;
-        clipboard.fromSlice = slice;
-        readData.notify_all();
-        clipboard.done.wait(lock);
-        tss.erase(slice);
-      }
-
-      void TapeBuffer::drop(Track track) {
-        std::unique_lock<std::mutex> lock(clipboard.lock);
-        clipboard.toTrack = track;
-        clipboard.toTime = position();
-        TapeSlice slice = {
-          clipboard.toTime,
-          clipboard.toTime + (int)clipboard.data.size()
-        };
-        readData.notify_all();
-        clipboard.done.wait(lock);
-    trackSlices[track.idx].addSlice(slice);
+  bool TapeBuffer::startJob(Clipboard::Job job, Track track, TapeSlice section) {
+    if (clipboard.job.load(std::memory_order_acquire) != Clipboard::Job::None) {
+      return false;
+    }
+    clipboard.track = track;
+    clipboard.section = section;
+    clipboard.slices = trackSlices[track.idx];
+    clipboard.progress = 0;
+    clipboard.length = section.size();
+    clipboard.job.store(job, std::memory_order_release);
+    wakeDiskThread();
+    return true;
+  }
+
+  bool TapeBuffer::requestJob(Clipboard::Job job, Track track) {
+    if (clipboard.job.load(std::memory_order_acquire) != Clipboard::Job::None
+      || requestedJob.load(std::memory_order_acquire) != Clipboard::Job::None) {
+      LOGD << "Lift or drop already running";
+      return false;
+    }
+    requestedTrack = track;
+    requestedJob.store(job, std::memory_order_release);
+    return true;
+  }
+
+  bool TapeBuffer::lift(Track track) {
+    return requestJob(Clipboard::Job::Lift, track);
+  }
+
+  bool TapeBuffer::drop(Track track) {
+    return requestJob(Clipboard::Job::Drop, track);
+  }
+
+  void TapeBuffer::applyPendingJob() {
+    Clipboard::Job job = requestedJob.load(std::memory_order_acquire);
+    if (job == Clipboard::Job::None) return;
+    Track track = requestedTrack;
+    requestedJob.store(Clipboard::Job::None, std::memory_order_release);
+
+    TapeSliceSet &tss = trackSlices[track.idx];
+    TapeSlice slice;
+    if (job == Clipboard::Job::Lift) {
+      if (!tss.inSlice(position())) return;
+      slice = tss.current(position());
+    } else {
+      // No job is running, so the disk thread is done with the data
+      if (clipboard.data.empty()) return;
+      slice = {position(), position() + (int) clipboard.data.size()};
+    }
+    if (!startJob(job, track, slice)) return;
+    if (job == Clipboard::Job::Lift) {
+      tss.erase(slice);
+    } else {
+      tss.addSlice(slice);
+    }
+  }
+
+  void TapeBuffer::cut(Track track) {
+    requestedCut.store(track.idx, std::memory_order_release);
+  }
+
+  void TapeBuffer::applyPendingCut() {
+    int idx = requestedCut.exchange(-1, std::memory_order_acq_rel);
+    if (idx >= 0) {
+      trackSlices[idx].cut(position());
+      wakeDiskThread();
+    }
+  }
+
+  void TapeBuffer::beginEdit(Track track) {
+    if (editPending.load(std::memory_order_acquire)) return;
+    editSlices = trackSlices[track.idx];
+    editTrack = track;
+    editPending = true;
+    if (!buffer.written.push({})) {
+      editPending = false;
+    }
+    wakeDiskThread();
+  }
+
+  void TapeBuffer::applyPendingUndo() {
+    if (!restorePending.load(std::memory_order_acquire)) return;
+    trackSlices[restoredTrack.idx] = restoredSlices;
+    trackSlices[restoredTrack.idx].changed = true;
+    restorePending.store(false, std::memory_order_release);
+    wakeDiskThread();
+  }
+
+  void TapeBuffer::undo() {
+    undoRequests++;
+    wakeDiskThread();
+  }
+
+  float TapeBuffer::clipboardProgress() const {
+    if (clipboard.job.load(std::memory_order_acquire) == Clipboard::Job::None) {
+      return 1;
+    }
+    // The two may be from different jobs, if one ends and the next starts
+    float length = std::max(clipboard.length.load(), 1);
+    return std::min(clipboard.progress / length, 1.f);
+  }
+
+  void TapeBuffer::peaks(Track track, TapeSlice range, gsl::span<Peak> out) const {
+    if (!diskThread) {
+      std::fill(out.begin(), out.end(), Peak{});
+      return;
+    }
+    diskThread->file.peaks().query(track.idx, range, out);
   }
 
   std::string TapeBuffer::timeStr() {
@@ -4,16 +4,21 @@
 #include <atomic>
 #include <vector>
 #include <array>
-#include <set>
 #include <iterator>
+#include <optional>
 #include <thread>
-#include <condition_variable>
-#include <functional>
+#include <mutex>
+#include <gsl/span>
 #include <fmt/format.h>
 #include <plog/Log.h>
 
+#include "filesystem.hpp"
 #include "util/dyn-array.hpp"
 #include "util/audio.hpp"
+#include "util/tape-config.hpp"
+#include "util/spsc-queue.hpp"
+#include "util/semaphore.hpp"
+#include "util/peak-pyramid.hpp"
 
 namespace top1 {
 
@@ -30,11 +35,40 @@ namespace top1 {
     template<typename T,
              typename = std::enable_if_t<std::is_invocable_v<T, Track>>>
     inline static void foreach(T f) {
-      for (uint i = 0; i < 4; i++) f(makeIdx(i));
+      for (uint i = 0; i < nTapeTracks; i++) f(makeIdx(i));
     }
 
     static Track makeIdx(uint idx) { return Track(idx); }
     static Track makeName(uint name) { return Track(name-1); }
+
+    /**
+     * The tracks are grouped in banks of four, one for each track key,
+     * and each mixer knob. Only one bank is in use at a time.
+     */
+    static constexpr uint BankSize = 4;
+
+    uint bank() const { return idx / BankSize; }
+
+    /// Track `n` of `bank`, if there is such a track
+    static std::optional<Track> inBank(uint bank, uint n,
+                                       uint nTracks = nTapeTracks) {
+      uint idx = bank * BankSize + n;
+      if (n >= BankSize || idx >= nTracks) return std::nullopt;
+      return Track(idx);
+    }
+
+    /**
+     * The track to select when track key `key` (from 0) is pressed.
+     *
+     * Selects that track in the current bank, or with `shift`, the track in
+     * the same place in bank `key`. Stays on this track if there is no
+     * such track.
+     */
+    Track select(uint key, bool shift, uint nTracks = nTapeTracks) const {
+      auto next = shift ? inBank(key, idx % BankSize, nTracks)
+                        : inBank(bank(), key, nTracks);
+      return next.value_or(*this);
+    }
   private:
     explicit Track(uint idx) : idx (idx) {}
   };
@@ -49,17 +83,77 @@ namespace top1 {
   class TapeBuffer {
   public:
     using TapeSlice = audio::Section<TapeTime>;
-    using AudioFrame = audio::AudioFrame<4, float>;
-    class CompareTapeSlice {
-    public:
-      bool operator()(const TapeSlice &e1, const TapeSlice &e2) const {return e1.in < e2.in;}
+    using AudioFrame = TapeFrame;
+    /**
+     * How recorded data is combined with what is already on the tape.
+     *
+     * Each mode has its own write kernel, chosen once per call, so the
+     * per frame operation is inlined.
+     */
+    enum class WriteMode {
+      /// Replace the track
+      Overwrite,
+      /// Add to the track
+      Overdub,
+      /// Silence the track. Only the size of the data is used
+      Erase,
+      /// Fade from the track to the data, by a gain that goes linearly
+      /// from `fade.in` on the first frame of the data to `fade.out` on the
+      /// last. Used to punch in and out without clicks.
+      Crossfade,
     };
 
+    /**
+     * The slices on a track.
+     *
+     * Stored as a flat vector, sorted and without overlaps. Lookups are
+     * binary searches, and space for <ReservedSlices> is reserved up front, so
+     * recording (which extends the same slice every period) does not
+     * allocate.
+     *
+     * Once the set is half full, the disk thread makes room for twice as many
+     * slices in <makeRoom>, and the thread that changes the set takes it
+     * before the next change. Copying a set into another copies only the
+     * slices, so it does not allocate if the target has room for them.
+     */
     class TapeSliceSet {
-      std::set<TapeSlice, CompareTapeSlice> slices;
+      std::vector<TapeSlice> slices;
+
+      /// Room for more slices, made by <makeRoom>
+      std::vector<TapeSlice> spare;
+      /// Set by the disk thread when `spare` is ready, and back by <takeRoom>
+      std::atomic<bool> spareReady {false};
+      /// The capacity of `spare`. Only used by the disk thread
+      std::size_t spareRoom = 0;
+      /// The size and capacity of `slices`, for the disk thread
+      std::atomic<std::size_t> count {0};
+      std::atomic<std::size_t> room {0};
+
+      using iterator = std::vector<TapeSlice>::iterator;
+      using const_iterator = std::vector<TapeSlice>::const_iterator;
+
+      /// The first slice that ends at or after `time`
+      const_iterator firstEndingAfter(TapeTime time) const;
+      iterator firstEndingAfter(TapeTime time);
+
+      /// Move the slices into the room made by <makeRoom>, if it is ready.
+      /// Called by every change, so it never allocates
+      void takeRoom();
+      /// Update `count` and `room`
+      void publishSize();
     public:
+      /// Space reserved up front. More slices can be added, but that
+      /// allocates, unless the disk thread has made room for them.
+      static constexpr std::size_t ReservedSlices = 2048;
+
       bool changed = false;
-      TapeSliceSet() {}
+      TapeSliceSet() {
+        slices.reserve(ReservedSlices);
+        publishSize();
+      }
+      TapeSliceSet(const TapeSliceSet& other);
+      TapeSliceSet& operator=(const TapeSliceSet& other);
+
       std::vector<TapeSlice> slicesIn(audio::Section<TapeTime> area) const;
 
       bool inSlice(TapeTime time) const;
@@ -71,167 +165,551 @@ namespace top1 {
       void cut(TapeTime time);
       void glue(TapeSlice s1, TapeSlice s2);
 
+      /**
+       * Make room for twice as many slices, if the set is more than half
+       * full, or for `atLeast` slices.
+       *
+       * Allocates, so only call this from the disk thread. It may run
+       * while another thread changes the set.
+       * @return the room the set has, once it is taken
+       */
+      std::size_t makeRoom(std::size_t atLeast = 0);
+
       // Iteration
       auto begin() { return slices.begin(); }
       auto end() { return slices.end(); }
       auto size() { return slices.size(); }
+      auto capacity() { return slices.capacity(); }
     };
   protected:
     friend class TapeDiskThread;
     std::unique_ptr<TapeDiskThread> diskThread;
+    /// See <init>
+    bool synchronous = false;
 
-    /** The current position on the tape, counted in frames from the beginning*/
-    std::atomic_uint playPoint;
+    /**
+     * The current position on the tape, counted in frames from the beginning.
+     *
+     * Only written by the audio thread.
+     */
+    std::atomic<TapeTime> playPoint;
 
-    std::condition_variable_any readData;
+    /// A jump requested by <requestGoTo>, or -1
+    std::atomic<TapeTime> requestedPos {-1};
 
-    std::atomic_bool newCuts;
+    /// Posted when the disk thread has something to do
+    Semaphore diskWake;
+    /// Set while `diskWake` is posted, so it is posted at most once
+    /// per wake up of the disk thread
+    std::atomic<bool> diskWakePosted {false};
 
-    void threadRoutine();
+    /// Wake the disk thread. Takes no locks, so the audio thread may call it
+    void wakeDiskThread();
 
     void movePlaypointRel(int time);
 
     void movePlaypointAbs(int pos);
 
-    struct {
+    /**
+     * Push a section of recorded frames to be written to disk.
+     *
+     * If `buffer.written` is full, the section is dropped and counted in
+     * <lostFrames>. It can not be held back for later, as the disk thread
+     * only keeps frames it knows are recorded, and would reuse them.
+     */
+    void markWritten(TapeSlice written);
+
+    /// Read from the <Prefetch> buffers, if they hold the playPoint
+    std::size_t readPrefetchFW(gsl::span<AudioFrame> out);
+    std::size_t readPrefetchBW(gsl::span<AudioFrame> out);
+
+    /**
+     * Recordings to frames that are not in the buffer yet.
+     *
+     * Right after a jump, or while the disk thread is behind, the frames
+     * being recorded to may not be loaded. The data is kept here, and written
+     * in order once the disk thread has loaded the frames. Nothing is
+     * allocated after construction. Only used by the audio thread.
+     */
+    struct PendingWrites {
+      /// The most frames of data held at once
+      static constexpr int Capacity = 1 << 16;
+      /// The most writes held at once
+      static constexpr int MaxWrites = 64;
+
+      struct Write {
+        TapeSlice region;
+        int dir;
+        Track track;
+        WriteMode mode;
+        /// The gain of the first frame of data, and the change per frame
+        float gain;
+        float gainStep;
+        /// The index of the data in `data`
+        int at;
+      };
+
+      DynArray<float> data {Capacity};
+      std::array<Write, MaxWrites> writes;
+      /// The oldest write, and the number of writes
+      int first = 0;
+      int count = 0;
+      /// One past the data of the newest write
+      int dataEnd = 0;
+
+      Write& front() { return writes[first]; }
+      void pop() {
+        first = (first + 1) % MaxWrites;
+        count--;
+      }
+
+      /// Find room for `n` frames of data after the newest write.
+      /// @return the index of the room, or -1 if there is none
+      int alloc(int n);
+    } pending;
+
+    /**
+     * Write `data` to `region` if all of it is in the buffer.
+     *
+     * @Dir 1 to write `data` forwards, -1 to write it in reverse
+     * @return false if the frames are not all loaded, and nothing was written
+     */
+    template<int Dir>
+    bool writeLoaded(const float* data, TapeSlice region, Track track,
+                     WriteMode mode, float gain, float gainStep);
+
+    /**
+     * Write `data` to `region`, or keep it in `pending` until the frames
+     * are loaded.
+     *
+     * @return the number of frames that were neither written nor kept
+     */
+    template<int Dir>
+    std::size_t write(gsl::span<const float> data, TapeSlice region,
+                      Track track, WriteMode mode, float gain, float gainStep);
+
+    /// Write the pending writes whose frames are loaded now, and drop those
+    /// that are too far away from the playPoint to ever be loaded.
+    void flushPending();
+
+    /**
+     * Lifting and dropping, done in the background by the disk thread.
+     *
+     * The audio thread only starts a job, and the disk thread works on it
+     * a step at a time between refilling the ring buffer, so neither the UI
+     * nor the playback has to wait for it. Only one job runs at a time.
+     */
+    struct Clipboard {
+      enum class Job {
+        None,
+        Lift,
+        Drop,
+      };
+
+      /// Frames reserved up front. Longer slices can be lifted, but that
+      /// allocates (on the disk thread)
+      static constexpr std::size_t ReservedFrames = 1 << 22;
+
+      /// The frames of the last lifted slice.
+      /// Only touched by the disk thread while a job is running
       std::vector<float> data;
-      Track fromTrack;
-      TapeSlice fromSlice = {-1, -2};
-      Track toTrack;
-      TapeTime toTime = -1;
-      std::mutex lock;
-      std::condition_variable done;
+
+      /// The track and section of the running job
+      Track track;
+      TapeSlice section;
+      /// The slices on the track, from before the job started
+      TapeSliceSet slices;
+
+      /// Set by the audio thread to start a job, and back to `None` by the
+      /// disk thread when it is done
+      std::atomic<Job> job {Job::None};
+      /// The number of frames the running job has processed
+      std::atomic<int> progress {0};
+      /// The size of `section`, for the UI
+      std::atomic<int> length {0};
+
+      Clipboard() {
+        data.reserve(ReservedFrames);
+      }
     } clipboard;
 
+    /// A lift or drop requested by <lift> or <drop>, started by
+    /// <applyPendingJob>
+    std::atomic<Clipboard::Job> requestedJob {Clipboard::Job::None};
+    /// Only written while `requestedJob` is `None`
+    Track requestedTrack;
+
+    /// Request a clipboard job, unless one is running or requested already
+    bool requestJob(Clipboard::Job job, Track track);
+
+    /// Start a clipboard job, unless one is running already
+    bool startJob(Clipboard::Job job, Track track, TapeSlice section);
+
+    /// The slices on the track of the edit started by <beginEdit>,
+    /// from before it started
+    TapeSliceSet editSlices;
+    Track editTrack;
+    /// Set until the disk thread has taken `editSlices`
+    std::atomic<bool> editPending {false};
+
+    /// The index of the track of a cut requested by <cut>, or -1
+    std::atomic<int> requestedCut {-1};
+
+    /// Undos requested, but not yet done
+    std::atomic<int> undoRequests {0};
+
+    /// The slices restored by an undo, put in place by <applyPendingUndo>.
+    /// Only touched by the disk thread while `restorePending` is false
+    TapeSliceSet restoredSlices;
+    Track restoredTrack;
+    /// Set until the audio thread has taken `restoredSlices`
+    std::atomic<bool> restorePending {false};
+
   public:
 
+    /// Recorded frames that were lost, because the disk thread fell too far
+    /// behind. Can be read from any thread.
+    std::atomic<std::size_t> lostFrames {0};
+
+    /**
+     * A <TapeSlice> that can be read and written atomically.
+     *
+     * Both ends are packed into a single 64 bit word, so a reader
+     * never sees one end of an old section and the other end of a new one.
+     */
+    class AtomicSlice {
+      std::atomic<uint64_t> packed {0};
+
+      static uint64_t pack(TapeSlice s) {
+        return (uint64_t(uint32_t(s.in)) << 32) | uint32_t(s.out);
+      }
+
+      static TapeSlice unpack(uint64_t p) {
+        return {TapeTime(int32_t(p >> 32)), TapeTime(int32_t(p))};
+      }
+
+    public:
+      static_assert(std::atomic<uint64_t>::is_always_lock_free);
+
+      TapeSlice load(std::memory_order o = std::memory_order_seq_cst) const {
+        return unpack(packed.load(o));
+      }
+
+      void store(TapeSlice s, std::memory_order o = std::memory_order_seq_cst) {
+        packed.store(pack(s), o);
+      }
+    };
+
+    /**
+     * The ring buffer holding the tape around the playPoint.
+     *
+     * Frames are indexed directly by their tape time, wrapped to the buffer
+     * size, so no offset has to be shared between the threads.
+     *
+     * The audio thread and the <TapeDiskThread> communicate through
+     * `loaded` and `written` only, and never lock:
+     *
+     *  - The disk thread is the only writer of `loaded`. Before it
+     *    overwrites any frames, it shrinks `loaded` to exclude them, and only
+     *    after they are read from disk does it extend `loaded` to include the
+     *    new ones. It never touches frames close to the playPoint.
+     *  - The audio thread only reads and records inside `loaded`. After
+     *    reading it checks `loaded` again, and discards any frames that were
+     *    taken from it in the meantime.
+     *  - Recorded sections are passed to the disk thread through `written`,
+     *    and the disk thread flushes them before it shrinks `loaded`.
+     */
     struct RingBuffer {
-      const static uint Size = 1U << 18; // must be power of two
-      const static uint mask = Size - 1;
-      struct iterator {
-        AudioFrame* data;
-        uint index;
-
-        bool operator==(const iterator& r) {
-          return data == r.data && index == r.index;
-        }
-        bool operator!=(const iterator& r) {
-          return data != r.data || index != r.index;
-        }
-        iterator& operator++() {
-          index = (index + 1) & mask;
-          return *this;
-        }
-        iterator& operator--() {
-          index = (index - 1) & mask;
-          return *this;
-        }
-        iterator operator+(int i) {
-          return {data, (index + i) & mask};
+      /// A power of two
+      const uint size;
+      const uint mask;
+
+      DynArray<AudioFrame> data;
+
+      /// The section of the tape currently in the buffer
+      AtomicSlice loaded;
+      /// Recorded sections that are not yet written to disk.
+      /// An empty section marks the start of an edit, see <beginEdit>.
+      /// Holds a few seconds of periods, even on many tracks at once
+      SPSCQueue<TapeSlice, 4096> written;
+
+      RingBuffer(uint size) : size (size), mask (size - 1), data (size) {}
+
+      AudioFrame& operator[](TapeTime t) {return data[wrapIdx(t)];}
+      uint wrapIdx(int index) const {return index & mask;}
+
+      /**
+       * Invoke `f` on the contiguous chunks of the buffer storing the
+       * frames of `section`. There are at most two.
+       *
+       * @f Invocable with `(TapeTime time, AudioFrame* frames, int n)`
+       */
+      template<typename F>
+      void forChunks(TapeSlice section, F&& f) {
+        TapeTime t = section.in;
+        while (t < section.out) {
+          int n = std::min<int>(section.out - t, size - wrapIdx(t));
+          f(t, data.data() + wrapIdx(t), n);
+          t += n;
         }
-        iterator operator-(int i) {
-          return {data, (index - i) & mask};
-        }
-        int operator-(const iterator& r) {
-          return r.index - index;
-        }
-        AudioFrame& operator*() {
-          return data[index];
-        }
-      };
+      }
+    } buffer;
 
-      std::array<AudioFrame, Size> data;
-      audio::Section<int> notWritten;
-      std::atomic_int lengthFW {0};
-      std::atomic_int lengthBW {0};
-      std::atomic_uint playIdx {0};
-      std::atomic_uint posAt0  {0};
+    /**
+     * Frames around a loop point, read from disk ahead of the jump there.
+     *
+     * When the loop is longer than the ring buffer, the loop point is not
+     * in the buffer when the playPoint wraps around. The frames are then
+     * read from here, until the disk thread has copied them to the ring
+     * buffer. `loaded` follows the same protocol as in <RingBuffer>.
+     */
+    struct Prefetch {
+      /// A quarter of the ring buffer size
+      const uint size;
 
-      AudioFrame& operator[](int i) {return data[wrapIdx(i)];}
-      uint wrapIdx(int index) {return index & mask;}
+      DynArray<AudioFrame> data;
 
-      iterator begin() { return {data.data(), 0}; }
-      iterator end() { return {data.data(), Size - 1}; }
-    } buffer;
+      /// The section of the tape in `data`, starting at `data[0]`
+      AtomicSlice loaded;
 
-    TapeSliceSet trackSlices[4] = {{}, {}, {}, {}};
+      Prefetch(uint size) : size (size), data (size) {}
+    };
 
-    TapeBuffer();
+    /// Prefetched frames after the loop in, and before the loop out point
+    Prefetch prefetch[2] = {{buffer.size / 4}, {buffer.size / 4}};
+
+    /// The current loop, or an empty section if not looping
+    AtomicSlice loop;
+
+    std::array<TapeSliceSet, nTapeTracks> trackSlices;
+
+    /**
+     * @ringSize The size of the ring buffer in frames. Rounded up to a power
+     *           of two. A bigger buffer tolerates slower disks.
+     */
+    explicit TapeBuffer(uint ringSize = TOP1_TAPE_RING_SIZE);
     TapeBuffer(TapeBuffer&) = delete;
     TapeBuffer(TapeBuffer&&) = delete;
     ~TapeBuffer();
 
-    void init();
+    /**
+     * Open the tape, and start the disk thread.
+     *
+     * @path The tape file. Created if it does not exist
+     * @synchronous Start no thread. The audio thread does the disk work in
+     *              <syncDisk>, so what is read does not depend on timing.
+     *              For offline rendering only, as it blocks on the disk.
+     */
+    void init(fs::path path, bool synchronous = false);
     void exit();
 
+    /**
+     * Read and write what this period needs, if the tape is synchronous.
+     *
+     * Only call this from the audio thread, at the start of a period, after
+     * the jumps and the loop are set.
+     */
+    void syncDisk();
+
     /**
      * Reads forwards along the tape, moving the playPoint.
-     * @param nframes number of frames to read.
-     * @return a vector of length nframes with the data.
+     *
+     * Frames are copied straight from the ring buffer into `out`, in at
+     * most two contiguous chunks. Nothing is allocated, so this is safe to
+     * call from the audio thread.
+     * @param out where to put the data. Its size is the number of frames
+     *        to read. If fewer frames are loaded, the rest is zeroed.
+     * @return the number of frames actually read from the buffer.
      */
-    std::vector<AudioFrame> readFW(uint nframes);
+    std::size_t readFW(gsl::span<AudioFrame> out);
 
     /**
      * Reads backwards along the tape, moving the playPoint.
-     * @param nframes number of frames to read.
-     * @return a vector of length nframes with the data. The data will be in the
-     *        read order, meaning reverse.
+     *
+     * Like <readFW>, but the data will be in the read order,
+     * meaning reverse.
+     * @param out where to put the data. Its size is the number of frames
+     *        to read. If fewer frames are loaded, the rest is zeroed.
+     * @return the number of frames actually read from the buffer.
      */
-    std::vector<AudioFrame> readBW(uint nframes);
+    std::size_t readBW(gsl::span<AudioFrame> out);
 
     /**
-     * Write data to the tape.
+     * Write data to a track on the tape.
+     *
+     * If the frames are not in the buffer yet, the data is kept and written
+     * once the disk thread has loaded them. Writes are always done in order.
+     * Nothing is allocated, so this is safe to call from the audio thread.
+     * Frames before the start of the tape are skipped.
      * @param data the data to write.
+     * @param track the track to write to. Other tracks are left as they are.
+     * @param mode how to combine the data with the tape.
      * @param offset the end of the data will be at playPoint - offset
-     * @param writeFunc the function used to write the data. Run for each frame,
-     *   recieves the original and the new data as arguments.
-     * @return the amount of unwritten frames
+     * @param fade the gain ramp used by <WriteMode::Crossfade>
+     * @return the amount of frames that were lost, because there was no room
+     *         to keep them. They are counted in <lostFrames> too.
      */
-    uint writeFW(
-                 std::vector<AudioFrame> data,
-                 uint offset = 0,
-                 std::function<AudioFrame(AudioFrame, AudioFrame)> writeFunc
-                 = [](AudioFrame, AudioFrame n) { return n; });
+    std::size_t writeFW(gsl::span<const float> data,
+                        Track track,
+                        WriteMode mode = WriteMode::Overdub,
+                        uint offset = 0,
+                        audio::Section<float> fade = {0, 1});
 
     /**
-     * Write data to the tape.
-     * @param data the data to write. Will be written in reverse order.
+     * Write data to a track on the tape.
+     *
+     * Like <writeFW>, but the data will be written in reverse order.
      * @param offset the end of the data will be at playPoint + offset
-     * @param writeFunc the function used to write the data. Run for each frame,
-     *   recieves the original and the new data as arguments.
-     * @return the amount of unwritten frames
+     * @return the amount of frames that were lost
      */
-    uint writeBW(
-                 std::vector<AudioFrame> data,
-                 uint offset = 0,
-                 std::function<AudioFrame(AudioFrame, AudioFrame)> writeFunc
-                 = [](AudioFrame, AudioFrame n) { return n; });
+    std::size_t writeBW(gsl::span<const float> data,
+                        Track track,
+                        WriteMode mode = WriteMode::Overdub,
+                        uint offset = 0,
+                        audio::Section<float> fade = {0, 1});
 
     /**
-     * Jumps to another position in the tape
+     * Jumps to another position in the tape.
+     *
+     * Only call this from the audio thread. Other threads should use
+     * <requestGoTo>.
      * @tapePos position to jump to
      */
     void goTo(TapeTime tapePos);
 
-    TapeTime position() {
+    /**
+     * Requests a jump to another position in the tape.
+     *
+     * Can be called from any thread. The jump is performed by the audio
+     * thread, in <applyPendingJump>.
+     * @tapePos position to jump to
+     */
+    void requestGoTo(TapeTime tapePos);
+
+    /**
+     * Perform a jump requested with <requestGoTo>, if any.
+     *
+     * Only call this from the audio thread, at the start of a period.
+     */
+    void applyPendingJump();
+
+    /**
+     * Put the slices restored by an undo in place, if there are any.
+     *
+     * The slices are only changed on the audio thread, which records into
+     * them. Only call this from the audio thread, once per period. Nothing is
+     * allocated, see <TapeSliceSet>.
+     */
+    void applyPendingUndo();
+
+    /**
+     * Start the lift or drop requested by <lift> or <drop>, if any.
+     *
+     * The slices are only changed on the audio thread, which records into
+     * them. Only call this from the audio thread, once per period. Nothing is
+     * allocated, see <TapeSliceSet>.
+     */
+    void applyPendingJob();
+
+    /**
+     * Perform the cut requested by <cut>, if any.
+     *
+     * Like <applyPendingJob>, only call this from the audio thread, once per
+     * period.
+     */
+    void applyPendingCut();
+
+    /**
+     * Write the recordings that waited for their frames to be loaded.
+     *
+     * Only call this from the audio thread, once per period.
+     */
+    void flushPendingWrites() {
+      if (pending.count > 0) flushPending();
+    }
+
+    TapeTime position() const {
       return playPoint;
     }
 
-    void lift(Track track);
-    void drop(Track track);
+    /**
+     * Set the loop, so the frames at its ends can be prefetched.
+     *
+     * Can be called from any thread.
+     * @loop The loop section, or an empty section to turn looping off.
+     */
+    void setLoop(TapeSlice loop);
 
-    std::string timeStr();
+    /**
+     * Split the current slice on a track in two, at the playPoint.
+     *
+     * Can be called from any thread. The audio thread does the cut in
+     * <applyPendingCut>.
+     */
+    void cut(Track track);
 
-  };
-}
+    /**
+     * Move the current slice on a track to the clipboard.
+     *
+     * Can be called from any thread. The audio thread removes the slice in
+     * <applyPendingJob>, if there is one at the playPoint by then, while
+     * the audio is moved in the background.
+     * @return false if a lift or drop is running or requested already
+     */
+    bool lift(Track track);
 
-namespace std {
+    /**
+     * Insert the clipboard on a track, at the playPoint.
+     *
+     * Like <lift>, the slice is added by the audio thread, and the audio is
+     * written in the background. Nothing happens if the clipboard is empty.
+     * @return false if a lift or drop is running or requested already
+     */
+    bool drop(Track track);
+
+    /// The number of edits that can be undone
+    static constexpr int UndoLevels = 16;
+
+    /**
+     * Start a new edit, which can be undone on its own.
+     *
+     * Call this from the audio thread, before the first write of a
+     * recording pass. Lifts and drops are edits of their own.
+     * If the disk thread has not yet caught up with the last edit, the two
+     * are merged. Writes still waiting for their frames to be loaded
+     * become part of the new edit.
+     */
+    void beginEdit(Track track);
+
+    /**
+     * Undo the last edit.
+     *
+     * Can be called from any thread. The disk thread restores the saved
+     * version of the tape file, which only changes its block map, so an
+     * undo takes no longer for long edits. See <TapeFile::push_version>.
+     */
+    void undo();
+
+    /**
+     * How far the running lift or drop has come, from 0 to 1.
+     *
+     * 1 when nothing is running.
+     */
+    float clipboardProgress() const;
+
+    using Peak = audio::PeakPyramid<nTapeTracks>::Peak;
+
+    /**
+     * The min/max peaks of `track` over `range`, split evenly into
+     * `out.size()` parts, e.g. one per pixel.
+     *
+     * Costs in proportion to `out.size()`, however long the range is.
+     * Recorded audio shows up once the disk thread has written it. This
+     * locks, so do not call it from the audio thread.
+     */
+    void peaks(Track track, TapeSlice range, gsl::span<Peak> out) const;
+
+    std::string timeStr();
 
-  template<>
-  struct iterator_traits<top1::TapeBuffer::RingBuffer::iterator> {
-    using difference_type = int;
-    using value_type = top1::TapeBuffer::AudioFrame;
-    using pointer = top1::TapeBuffer::AudioFrame*;
-    using reference = top1::TapeBuffer::AudioFrame&;
   };
 }
@@ -1,10 +1,23 @@
 #include "tapefile.hpp"
 
+#include <cstring>
+#include <numeric>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <plog/Log.h>
+
 namespace top1 {
 
   using Chunk = ByteFile::Chunk;
   using SliceData = TapeFile::SliceData;
+  using Position = TapeFile::Position;
 
+  /// The slices of a track.
+  ///
+  /// Version 1 has a fixed array of 2048 slices, and no chunk header.
+  /// From version 2, it is a normal chunk with only the used slices, and
+  /// the slices are not read until they are needed.
   struct TRCKChunk : Chunk {
     uint16_t index = 0;
     TRCKChunk(uint16_t idx) : Chunk("TRCK"), index (idx) {}
@@ -12,50 +25,872 @@ namespace top1 {
 
     void write_fields(ByteFile& f) override {
       auto& tf = dynamic_cast<TapeFile&>(f);
+      auto& slices = tf.slices(index);
       f.write_bytes(bytes<2>::from_u(index));
-      f.write_bytes(bytes<2>::from_u(tf.slices[index].count));
-      f.write_bytes((std::byte*) tf.slices[index].array.data(),
-        2048 * sizeof(SliceData));
+      f.write_bytes(bytes<2>::from_u(0));
+      f.write_bytes(bytes<4>::from_u(slices.size()));
+      f.write_bytes((std::byte*) slices.data(),
+        slices.size() * sizeof(SliceData));
     }
 
     void read_fields(ByteFile& f) override {
+      auto& tf = dynamic_cast<TapeFile&>(f);
+      bytes<2> temp;
+      bytes<4> count;
+      f.read_bytes(temp).unwrap_ok();
+      index = temp.as_u();
+      f.read_bytes(temp).unwrap_ok();
+      f.read_bytes(count).unwrap_ok();
+      if (index >= TapeFile::nTracks) return;
+      tf.sliceLists[index].clear();
+      tf.unreadSlices[index] = {f.position(), count.as_u()};
+    }
+
+    void read_fields_v1(ByteFile& f) {
       auto& tf = dynamic_cast<TapeFile&>(f);
       bytes<2> temp;
       f.read_bytes(temp).unwrap_ok();
       index = temp.as_u();
       f.read_bytes(temp).unwrap_ok();
-      tf.slices.at(index).count = temp.as_u();
-      f.read_bytes((std::byte*) tf.slices.at(index).array.data(),
-        2048 * sizeof(SliceData)).unwrap_ok();
+      if (index >= TapeFile::nTracks) {
+        f.seek(2048 * sizeof(SliceData), std::ios::cur);
+        return;
+      }
+      auto& slices = tf.sliceLists[index];
+      slices.resize(std::min<std::size_t>(temp.as_u(), 2048));
+      f.read_bytes((std::byte*) slices.data(),
+        slices.size() * sizeof(SliceData)).unwrap_ok();
+      f.seek((2048 - slices.size()) * sizeof(SliceData), std::ios::cur);
     }
   };
 
   struct TAPEChunk : Chunk {
     TAPEChunk(const Chunk& c) : Chunk(c) {}
     TAPEChunk() : Chunk("TAPE") {}
-    bytes<4> version = {1,0,0,0};
-
-    TRCKChunk tracks[4] = {{0}, {1}, {2}, {3}};
+    bytes<4> version = {2,0,0,0};
 
     void write_fields(ByteFile& f) override {
       f.write_bytes(version);
-      for (auto&& trck : tracks) {
-        trck.write_fields(f);
+      for (uint16_t i = 0; i < TapeFile::nTracks; i++) {
+        TRCKChunk(i).write(f);
       }
     }
 
     void read_fields(ByteFile& f) override {
       f.read_bytes(version).unwrap_ok();
-      for (auto&& trck : tracks) {
-        trck.read_fields(f);
+      if (version.data[0] == std::byte(1)) {
+        for (uint16_t i = 0; i < 4; i++) {
+          TRCKChunk(i).read_fields_v1(f);
+        }
+        return;
+      }
+      f.for_chunks_in_range(offset + 12, offset + 8 + size.as_u(),
+        [&] (Chunk& c) {
+          if (c.id != "TRCK") return;
+          TRCKChunk trck (c);
+          trck.read(f);
+        });
+    }
+  };
+
+  /*
+   * Block compression
+   *
+   * An encoded block starts with one <Coding> byte per track, followed by
+   * the data of each track in turn. The total is padded to whole samples.
+   */
+
+  enum class Coding : uint8_t {
+    /// All zero. No data
+    Silent,
+    /// The samples as they are
+    Raw,
+    /// Each sample XORed with the one before it. Similar samples share
+    /// the sign, exponent and top of the mantissa, so the high bytes of the
+    /// result are zero. A nibble per sample says how many of the low bytes
+    /// are stored, followed by those bytes.
+    Xor,
+  };
+
+  constexpr std::size_t rawTrackBytes = TapeFile::BlockSize * sizeof(float);
+
+  const std::size_t TapeFile::max_encoded_size =
+    nTracks + nTracks * (rawTrackBytes + BlockSize / 2) + sizeof(float);
+
+  std::size_t TapeFile::encode_block(const AudioFrame* frames, std::byte* out) {
+    std::byte* p = out + nTracks;
+    bool silent = true;
+    for (int t = 0; t < nTracks; t++) {
+      uint32_t bits[BlockSize];
+      uint32_t any = 0;
+      for (int i = 0; i < BlockSize; i++) {
+        std::memcpy(&bits[i], &frames[i][t], sizeof(float));
+        any |= bits[i];
+      }
+      if (any == 0) {
+        out[t] = std::byte(Coding::Silent);
+        continue;
+      }
+      silent = false;
+
+      std::byte* start = p;
+      std::byte* nibbles = p;
+      std::fill(nibbles, nibbles + BlockSize / 2, std::byte(0));
+      p += BlockSize / 2;
+      uint32_t prev = 0;
+      for (int i = 0; i < BlockSize; i++) {
+        uint32_t x = bits[i] ^ prev;
+        prev = bits[i];
+        int n = x == 0 ? 0 : x < (1u << 8) ? 1 : x < (1u << 16) ? 2 : x < (1u << 24) ? 3 : 4;
+        nibbles[i / 2] |= std::byte(n << (4 * (i & 1)));
+        for (int k = 0; k < n; k++) {
+          *p++ = std::byte(x >> (8 * k));
+        }
+      }
+      if (std::size_t(p - start) < rawTrackBytes) {
+        out[t] = std::byte(Coding::Xor);
+      } else {
+        // Noise does not compress
+        std::memcpy(start, bits, rawTrackBytes);
+        p = start + rawTrackBytes;
+        out[t] = std::byte(Coding::Raw);
+      }
+    }
+    if (silent) return 0;
+    while ((p - out) % sizeof(float) != 0) *p++ = std::byte(0);
+    return p - out;
+  }
+
+  void TapeFile::decode_block(const std::byte* in, std::size_t size, AudioFrame* frames) {
+    if (size == 0) {
+      std::fill(frames, frames + BlockSize, AudioFrame{});
+      return;
+    }
+    const std::byte* end = in + size;
+    const std::byte* p = in + nTracks;
+    auto corrupt = [] { throw "Corrupt tape block"; };
+    for (int t = 0; t < nTracks; t++) {
+      switch (Coding(in[t])) {
+      case Coding::Silent:
+        for (int i = 0; i < BlockSize; i++) frames[i][t] = 0;
+        break;
+      case Coding::Raw:
+        if (end - p < std::ptrdiff_t(rawTrackBytes)) corrupt();
+        for (int i = 0; i < BlockSize; i++, p += sizeof(float)) {
+          std::memcpy(&frames[i][t], p, sizeof(float));
+        }
+        break;
+      case Coding::Xor: {
+        const std::byte* nibbles = p;
+        p += BlockSize / 2;
+        if (p > end) corrupt();
+        std::size_t needed = 0;
+        for (int i = 0; i < BlockSize / 2; i++) {
+          needed += (uint8_t(nibbles[i]) & 0xF) + (uint8_t(nibbles[i]) >> 4);
+        }
+        if (std::size_t(end - p) < needed) corrupt();
+        uint32_t prev = 0;
+        for (int i = 0; i < BlockSize; i++) {
+          int n = (uint8_t(nibbles[i / 2]) >> (4 * (i & 1))) & 0xF;
+          uint32_t x = 0;
+          for (int k = 0; k < n; k++) {
+            x |= uint32_t(*p++) << (8 * k);
+          }
+          prev ^= x;
+          std::memcpy(&frames[i][t], &prev, sizeof(float));
+        }
+        break;
+      }
+      default:
+        corrupt();
+      }
+    }
+  }
+
+  /// The encoded size of each stored block, for compressed tapes
+  struct BIDXChunk : Chunk {
+    BIDXChunk(const Chunk& c) : Chunk(c) {}
+    BIDXChunk() : Chunk("BIDX") {}
+
+    void write_fields(ByteFile& f) override {
+      auto& tf = dynamic_cast<TapeFile&>(f);
+      f.write_bytes(bytes<4>::from_u(tf.blockBytes.size()));
+      f.write_bytes((std::byte*) tf.blockBytes.data(),
+        tf.blockBytes.size() * sizeof(uint32_t));
+    }
+
+    void read_fields(ByteFile& f) override {
+      auto& tf = dynamic_cast<TapeFile&>(f);
+      bytes<4> count;
+      f.read_bytes(count).unwrap_ok();
+      tf.blockBytes.resize(count.as_u());
+      f.read_bytes((std::byte*) tf.blockBytes.data(),
+        tf.blockBytes.size() * sizeof(uint32_t)).unwrap_ok();
+    }
+  };
+
+  /// The block map. Without it, the audio is stored in order.
+  struct BMAPChunk : Chunk {
+    BMAPChunk(const Chunk& c) : Chunk(c) {}
+    BMAPChunk() : Chunk("BMAP") {}
+
+    void write_fields(ByteFile& f) override {
+      auto& tf = dynamic_cast<TapeFile&>(f);
+      f.write_bytes(bytes<4>::from_u(TapeFile::BlockSize));
+      f.write_bytes(bytes<4>::from_u(tf.tapeLength));
+      f.write_bytes(bytes<4>::from_u(tf.blockMap.size()));
+      f.write_bytes((std::byte*) tf.blockMap.data(),
+        tf.blockMap.size() * sizeof(uint32_t));
+    }
+
+    void read_fields(ByteFile& f) override {
+      auto& tf = dynamic_cast<TapeFile&>(f);
+      bytes<4> blockSize, length, count;
+      f.read_bytes(blockSize).unwrap_ok();
+      f.read_bytes(length).unwrap_ok();
+      f.read_bytes(count).unwrap_ok();
+      if (blockSize.as_u() != TapeFile::BlockSize) {
+        throw "Unsupported tape block size";
       }
+      tf.tapeLength = length.as_u();
+      tf.blockMap.resize(count.as_u());
+      f.read_bytes((std::byte*) tf.blockMap.data(),
+        tf.blockMap.size() * sizeof(uint32_t)).unwrap_ok();
+      tf.hasBlockMap = true;
+    }
+  };
+
+  /// The lowest level of the peaks. The levels above it are built on load
+  struct PEAKChunk : Chunk {
+    using Peak = TapeFile::PeakPyramid::Peak;
+
+    PEAKChunk(const Chunk& c) : Chunk(c) {}
+    PEAKChunk() : Chunk("PEAK") {}
+
+    void write_fields(ByteFile& f) override {
+      auto& tf = dynamic_cast<TapeFile&>(f);
+      auto peaks = tf.peakPyramid.baseLevel();
+      f.write_bytes(bytes<4>::from_u(TapeFile::PeakPyramid::BaseRatio));
+      f.write_bytes(bytes<4>::from_u(TapeFile::nTracks));
+      f.write_bytes(bytes<4>::from_u(peaks.size()));
+      f.write_bytes((std::byte*) peaks.data(), peaks.size() * sizeof(Peak));
+    }
+
+    void read_fields(ByteFile& f) override {
+      auto& tf = dynamic_cast<TapeFile&>(f);
+      bytes<4> ratio, channels, count;
+      f.read_bytes(ratio).unwrap_ok();
+      f.read_bytes(channels).unwrap_ok();
+      f.read_bytes(count).unwrap_ok();
+      // Otherwise they are computed again from the audio
+      if (ratio.as_u() != TapeFile::PeakPyramid::BaseRatio
+          || channels.as_u() != TapeFile::nTracks) return;
+      std::vector<Peak> peaks(count.as_u());
+      f.read_bytes((std::byte*) peaks.data(), peaks.size() * sizeof(Peak)).unwrap_ok();
+      tf.peakPyramid.setBaseLevel(std::move(peaks));
+      tf.hasPeaks = true;
     }
   };
 
-  void TapeFile::add_custom_chunks(std::vector<std::unique_ptr<Chunk>>& v) {
+  void TapeFile::add_trailing_chunks(std::vector<std::unique_ptr<Chunk>>& v) {
+    read_all_slices();
     v.push_back(std::make_unique<TAPEChunk>());
+    v.push_back(std::make_unique<BMAPChunk>());
+    bool compressed = std::any_of(blockBytes.begin(), blockBytes.end(),
+      [] (uint32_t b) { return b != RawBlock; });
+    if (compressed) {
+      v.push_back(std::make_unique<BIDXChunk>());
+    }
+    v.push_back(std::make_unique<PEAKChunk>());
   }
+
   void TapeFile::replace_custom_chunk(std::unique_ptr<Chunk>& ptr) {
     if (ptr->id == "TAPE") ptr = std::make_unique<TAPEChunk>(*ptr);
+    if (ptr->id == "BMAP") ptr = std::make_unique<BMAPChunk>(*ptr);
+    if (ptr->id == "BIDX") ptr = std::make_unique<BIDXChunk>(*ptr);
+    if (ptr->id == "PEAK") ptr = std::make_unique<PEAKChunk>(*ptr);
+  }
+
+  void TapeFile::read_file() {
+    blockMap.clear();
+    tapeLength = 0;
+    hasBlockMap = false;
+    blockBytes.clear();
+    cachedBlock = NoBlock;
+    versions.clear();
+    hasPeaks = false;
+    peakPyramid.clear();
+
+    SoundFile::read_file();
+    if (!info.is_native()) {
+      refuse("Tape files must hold 32 bit float wave data");
+    }
+    bool widened = info.channels < nTracks;
+    if (widened) widen_tracks();
+    if (info.channels != nTracks) {
+      refuse("The tape file has more tracks than this build of the tape. "
+             "Build with TOP1_TAPE_TRACKS set to the number of tracks");
+    }
+
+    Position stored = stored_length();
+    if (!hasBlockMap) {
+      // Older files are stored in order
+      tapeLength = stored;
+      blockMap.resize((stored + BlockSize - 1) / BlockSize);
+      std::iota(blockMap.begin(), blockMap.end(), 0);
+    }
+    refCount.assign((stored + BlockSize - 1) / BlockSize, 0);
+    for (auto b : blockMap) {
+      if (b == NoBlock) continue;
+      if (b >= refCount.size()) refCount.resize(b + 1, 0);
+      refCount[b]++;
+    }
+    // Blocks without an encoded size are stored raw
+    blockBytes.resize(refCount.size(), RawBlock);
+    freeBlocks.clear();
+    releasedBlocks.clear();
+    mapChanged = false;
+    for (uint32_t b = refCount.size(); b > 0; b--) {
+      if (refCount[b - 1] == 0) freeBlocks.push_back(b - 1);
+    }
+    std::size_t peakCount = (tapeLength + PeakPyramid::BaseRatio - 1)
+      / PeakPyramid::BaseRatio * nTracks;
+    if (!hasPeaks || peakPyramid.baseLevel().size() != peakCount) {
+      // Written without peaks, or by something else
+      peakPyramid.clear();
+      read_peaks(0, tapeLength);
+    }
+    tapePos = 0;
+    // The header has to say how the audio is stored now
+    if (widened) write_file();
+  }
+
+  void TapeFile::refuse(const char* why) {
+    // Closed without writing it, so it is left as it is
+    ::close(fd);
+    fd = -1;
+    throw why;
+  }
+
+  void TapeFile::widen_tracks() {
+    int from = info.channels;
+    bool compressed = std::any_of(blockBytes.begin(), blockBytes.end(),
+      [] (uint32_t b) { return b != RawBlock; });
+    if (compressed) {
+      refuse("The tape file has fewer tracks than this build of the tape, "
+             "and is compressed, so it can not be widened");
+    }
+    LOGI << "Widening the tape file from " << from << " to " << nTracks
+         << " tracks";
+    // The slices may be stored after the audio data, where it grows
+    read_all_slices();
+
+    // Each frame moves further from the start, so moving them from the end
+    // overwrites none that are still to be moved
+    Position frames = audioSize / (from * sample_size);
+    constexpr Position Batch = 1 << 14;
+    std::vector<Sample> in(Batch * from);
+    std::vector<AudioFrame> out(Batch);
+    for (Position end = frames; end > 0;) {
+      Position begin = std::max<Position>(end - Batch, 0);
+      Position n = end - begin;
+      read_at(audioOffset + begin * from * sample_size,
+        reinterpret_cast<std::byte*>(in.data()), n * from * sample_size);
+      for (Position i = 0; i < n; i++) {
+        out[i] = AudioFrame{};
+        for (int t = 0; t < from; t++) out[i][t] = in[i * from + t];
+      }
+      write_at(audioOffset + begin * sizeof(AudioFrame),
+        reinterpret_cast<std::byte*>(out.data()), n * sizeof(AudioFrame));
+      end = begin;
+    }
+    audioSize = frames * sizeof(AudioFrame);
+    info.channels = nTracks;
+  }
+
+  void TapeFile::write_file() {
+    if (is_mapped()) {
+      // The mapping grows into the space after the frames in use, so keep
+      // the trailing chunks clear of it
+      audioSize = std::size_t(mapCapacity) * sizeof(AudioFrame);
+    }
+    SoundFile::write_file();
+    // The map on disk is up to date, so the released blocks are unused there
+    mapChanged = false;
+    freeBlocks.insert(freeBlocks.end(), releasedBlocks.begin(), releasedBlocks.end());
+    releasedBlocks.clear();
+  }
+
+  TapeFile::SliceList& TapeFile::slices(int track) {
+    auto& unread = unreadSlices.at(track);
+    auto& slices = sliceLists.at(track);
+    if (unread.offset >= 0) {
+      auto pos = ByteFile::position();
+      slices.resize(unread.count);
+      ByteFile::seek(unread.offset);
+      read_bytes((std::byte*) slices.data(),
+        slices.size() * sizeof(SliceData)).unwrap_ok();
+      ByteFile::seek(pos);
+      unread = {};
+    }
+    return slices;
+  }
+
+  void TapeFile::read_all_slices() {
+    for (int t = 0; t < nTracks; t++) {
+      slices(t);
+    }
+  }
+
+  /*
+   * Frame access
+   */
+
+  TapeFile::~TapeFile() {
+    unmap_audio();
+  }
+
+  Position TapeFile::seek_frame(Position p) {
+    return tapePos = std::max<Position>(p, 0);
+  }
+
+  Position TapeFile::length_frames() {
+    return tapeLength;
+  }
+
+  void TapeFile::read_frames(AudioFrame* f, int n) {
+    while (n > 0) {
+      int idx = tapePos / BlockSize;
+      int offset = tapePos % BlockSize;
+      int count = std::min(n, BlockSize - offset);
+      uint32_t b = idx < int(blockMap.size()) ? blockMap[idx] : NoBlock;
+      if (b == NoBlock) {
+        std::fill(f, f + count, AudioFrame{});
+      } else if (is_raw(b)) {
+        read_stored(block_sample(b, offset), reinterpret_cast<Sample*>(f),
+          count * nTracks);
+      } else {
+        load_block(b);
+        std::copy_n(blockCache.data() + offset, count, f);
+      }
+      tapePos += count;
+      f += count;
+      n -= count;
+    }
+  }
+
+  void TapeFile::write_frames(const AudioFrame* f, int n) {
+    // The slices may be stored where the audio data grows
+    read_all_slices();
+    Position from = tapePos;
+    const AudioFrame* data = f;
+    int total = n;
+    while (n > 0) {
+      int idx = tapePos / BlockSize;
+      int offset = tapePos % BlockSize;
+      int count = std::min(n, BlockSize - offset);
+      uint32_t b = block_for_write(idx);
+      if (!compression && is_raw(b)) {
+        write_stored(block_sample(b, offset), reinterpret_cast<const Sample*>(f),
+          count * nTracks);
+        if (cachedBlock == b) cachedBlock = NoBlock;
+      } else {
+        // Compressed blocks are rewritten as a whole
+        if (count < BlockSize) load_block(b);
+        std::copy_n(f, count, blockCache.data() + offset);
+        store_block(b);
+      }
+      tapePos += count;
+      f += count;
+      n -= count;
+    }
+    tapeLength = std::max(tapeLength, tapePos);
+    update_peaks(from, data, total);
+  }
+
+  /*
+   * Peaks
+   */
+
+  void TapeFile::update_peaks(Position from, const AudioFrame* f, int n) {
+    constexpr int ratio = PeakPyramid::BaseRatio;
+    Position to = from + n;
+    Position first = from / ratio * ratio;
+    Position last = std::min((to + ratio - 1) / ratio * ratio, tapeLength);
+    // The peaks covered by `f` alone. The last one may be cut short by the
+    // end of the tape
+    Position in = (from + ratio - 1) / ratio * ratio;
+    Position out = to >= tapeLength ? to : to / ratio * ratio;
+    if (out <= in) {
+      read_peaks(first, last);
+      return;
+    }
+    read_peaks(first, in);
+    peakPyramid.update(in, f + (in - from), out - in);
+    read_peaks(out, last);
+  }
+
+  void TapeFile::read_peaks(Position from, Position to) {
+    to = std::min(to, tapeLength);
+    if (from >= to) return;
+    Position pos = tapePos;
+    peakBuf.resize(BlockSize);
+    tapePos = from;
+    while (tapePos < to) {
+      Position start = tapePos;
+      int n = std::min<Position>(BlockSize, to - start);
+      read_frames(peakBuf.data(), n);
+      peakPyramid.update(start, peakBuf.data(), n);
+    }
+    tapePos = pos;
+  }
+
+  /*
+   * Stored blocks
+   */
+
+  uint32_t TapeFile::block_for_write(int idx) {
+    if (idx >= int(blockMap.size())) {
+      blockMap.resize(idx + 1, NoBlock);
+    }
+    uint32_t& block = blockMap[idx];
+    if (block == NoBlock) {
+      block = take_block(idx);
+      mapChanged = true;
+      if (cachedBlock == block) cachedBlock = NoBlock;
+      if (compression) {
+        // A silent block takes no space
+        blockBytes[block] = 0;
+      } else {
+        write_stored(block_sample(block), reinterpret_cast<const Sample*>(zeroBlock.data()),
+          BlockSize * nTracks);
+        blockBytes[block] = RawBlock;
+      }
+    } else if (refCount[block] > 1) {
+      // Shared with a saved version. The saved versions get a copy, so the
+      // tape stays where it is. Blocks are only ever shared by the same part
+      // of the tape.
+      uint32_t copy = new_block();
+      load_block(block);
+      store_block(copy);
+      for (auto&& v : versions) {
+        if (idx < int(v.map.size()) && v.map[idx] == block) v.map[idx] = copy;
+      }
+      refCount[copy] = refCount[block] - 1;
+      refCount[block] = 1;
+    }
+    return block;
+  }
+
+  uint32_t TapeFile::take_block(uint32_t idx) {
+    if (idx >= refCount.size()) {
+      // Blocks past the end are in no map, so the ones skipped are free
+      for (uint32_t b = refCount.size(); b < idx; b++) freeBlocks.push_back(b);
+      refCount.resize(idx + 1, 0);
+      blockBytes.resize(idx + 1, RawBlock);
+      refCount[idx] = 1;
+      return idx;
+    }
+    auto it = std::find(freeBlocks.begin(), freeBlocks.end(), idx);
+    if (it == freeBlocks.end()) return new_block();
+    freeBlocks.erase(it);
+    refCount[idx] = 1;
+    return idx;
+  }
+
+  uint32_t TapeFile::new_block() {
+    if (!freeBlocks.empty()) {
+      uint32_t b = freeBlocks.back();
+      freeBlocks.pop_back();
+      refCount[b] = 1;
+      return b;
+    }
+    refCount.push_back(1);
+    blockBytes.push_back(RawBlock);
+    return refCount.size() - 1;
+  }
+
+  void TapeFile::release_block(uint32_t block) {
+    if (block == NoBlock) return;
+    if (--refCount[block] == 0) {
+      // The map on disk may still use it
+      releasedBlocks.push_back(block);
+    }
+  }
+
+  void TapeFile::swap_blocks(uint32_t a, uint32_t b) {
+    load_block(a);
+    std::vector<AudioFrame> frames = blockCache;
+    load_block(b);
+    store_block(a);
+    blockCache = std::move(frames);
+    store_block(b);
+  }
+
+  void TapeFile::put_in_order() {
+    while (!versions.empty()) drop_oldest_version();
+
+    // The part of the tape in each stored block
+    std::vector<uint32_t> part(refCount.size(), NoBlock);
+    for (uint32_t idx = 0; idx < blockMap.size(); idx++) {
+      if (blockMap[idx] != NoBlock) part[blockMap[idx]] = idx;
+    }
+    for (uint32_t idx = 0; idx < blockMap.size(); idx++) {
+      uint32_t b = blockMap[idx];
+      if (b == NoBlock || b == idx) continue;
+      if (idx >= refCount.size()) {
+        refCount.resize(idx + 1, 0);
+        blockBytes.resize(idx + 1, RawBlock);
+        part.resize(idx + 1, NoBlock);
+      }
+      if (uint32_t other = part[idx]; other != NoBlock) {
+        // Another part is where this one goes, so it goes where this one is
+        swap_blocks(idx, b);
+        blockMap[other] = b;
+        part[b] = other;
+      } else {
+        load_block(b);
+        store_block(idx);
+        refCount[idx] = 1;
+        refCount[b] = 0;
+        part[b] = NoBlock;
+      }
+      blockMap[idx] = idx;
+      part[idx] = idx;
+      mapChanged = true;
+    }
+
+    // Now every part is in its own block, and the blocks past the last part
+    // are unused. Cut them off, and silence the unused blocks in between.
+    uint32_t used = blockMap.size();
+    while (used > 0 && blockMap[used - 1] == NoBlock) used--;
+    refCount.resize(std::min<std::size_t>(refCount.size(), used));
+    blockBytes.resize(refCount.size());
+    freeBlocks.clear();
+    releasedBlocks.clear();
+    cachedBlock = NoBlock;
+    Position stored = stored_length();
+    for (uint32_t b = 0; b < refCount.size(); b++) {
+      if (refCount[b] > 0) continue;
+      if (block_sample(b) < stored * nTracks) {
+        write_stored(block_sample(b), reinterpret_cast<const Sample*>(zeroBlock.data()),
+          BlockSize * nTracks);
+      }
+      blockBytes[b] = RawBlock;
+      // Until the map is written, it may still be in use there
+      releasedBlocks.push_back(b);
+    }
+    // A raw last block is silent past the end of the tape
+    Position end = used > 0 && !is_raw(used - 1)
+      ? Position(used) * BlockSize : tapeLength;
+    end = std::min(end, stored_length());
+    if (is_mapped()) {
+      mapLength = end;
+    } else {
+      audioSize = std::size_t(end) * sizeof(AudioFrame);
+    }
+  }
+
+  void TapeFile::push_version() {
+    for (auto b : blockMap) {
+      if (b != NoBlock) refCount[b]++;
+    }
+    versions.push_back({blockMap, tapeLength});
+  }
+
+  bool TapeFile::pop_version() {
+    if (versions.empty()) return false;
+    for (auto b : blockMap) release_block(b);
+    BlockMap old = std::move(blockMap);
+    blockMap = std::move(versions.back().map);
+    tapeLength = versions.back().length;
+    versions.pop_back();
+    mapChanged = true;
+
+    // Only the peaks of blocks that changed are read again
+    peakPyramid.truncate(tapeLength);
+    int blocks = std::max(old.size(), blockMap.size());
+    auto at = [] (const BlockMap& map, int idx) {
+      return idx < int(map.size()) ? map[idx] : NoBlock;
+    };
+    for (int idx = 0; idx < blocks; idx++) {
+      if (at(old, idx) == at(blockMap, idx)) continue;
+      int end = idx + 1;
+      while (end < blocks && at(old, end) != at(blockMap, end)) end++;
+      read_peaks(Position(idx) * BlockSize, Position(end) * BlockSize);
+      idx = end;
+    }
+    return true;
+  }
+
+  void TapeFile::drop_oldest_version() {
+    if (versions.empty()) return;
+    for (auto b : versions.front().map) release_block(b);
+    versions.pop_front();
+  }
+
+  Position TapeFile::stored_length() {
+    if (is_mapped()) return mapLength;
+    return length() / nTracks;
+  }
+
+  void TapeFile::read_stored(Position p, Sample* s, int n) {
+    int avail = std::clamp<Position>(stored_length() * nTracks - p, 0, n);
+    if (is_mapped()) {
+      std::memcpy(s, mapData + p * sample_size, avail * sample_size);
+    } else {
+      seek(p);
+      read_samples(static_cast<Sample*>(s), avail);
+    }
+    std::fill(s + avail, s + n, 0);
+  }
+
+  void TapeFile::write_stored(Position p, const Sample* s, int n) {
+    Position end = (p + n + nTracks - 1) / nTracks;
+    if (is_mapped() && end > mapCapacity) {
+      try {
+        // Grow in large steps, to not remap all the time
+        remap(std::max<Position>({end, 2 * mapCapacity, 1 << 20}));
+      } catch (ByteFile::Error& e) {
+        LOGE << "Could not grow the tape mapping, unmapping it: " << e.what();
+        unmap_audio();
+      }
+    }
+    if (is_mapped()) {
+      std::memcpy(mapData + p * sample_size, s, n * sample_size);
+      mapLength = std::max(mapLength, end);
+      return;
+    }
+    if (p + n > length()) {
+      // Written over the trailing chunks, so write them again soon
+      mapChanged = true;
+    }
+    seek(p);
+    write_samples(const_cast<Sample*>(s), n);
+  }
+
+  bool TapeFile::is_raw(uint32_t block) const {
+    return block >= blockBytes.size() || blockBytes[block] == RawBlock;
+  }
+
+  void TapeFile::load_block(uint32_t block) {
+    if (cachedBlock == block) return;
+    blockCache.resize(BlockSize);
+    if (is_raw(block)) {
+      read_stored(block_sample(block), reinterpret_cast<Sample*>(blockCache.data()),
+        BlockSize * nTracks);
+    } else {
+      uint32_t bytes = blockBytes[block];
+      encodeBuf.resize(bytes);
+      read_stored(block_sample(block), reinterpret_cast<Sample*>(encodeBuf.data()),
+        bytes / sample_size);
+      decode_block(encodeBuf.data(), bytes, blockCache.data());
+    }
+    cachedBlock = block;
+  }
+
+  void TapeFile::store_block(uint32_t block) {
+    encodeBuf.resize(max_encoded_size);
+    std::size_t bytes = compression
+      ? encode_block(blockCache.data(), encodeBuf.data())
+      : RawBlock;
+    if (bytes >= BlockSize * sizeof(AudioFrame)) {
+      write_stored(block_sample(block), reinterpret_cast<Sample*>(blockCache.data()),
+        BlockSize * nTracks);
+      blockBytes[block] = RawBlock;
+    } else {
+      write_stored(block_sample(block), reinterpret_cast<Sample*>(encodeBuf.data()),
+        bytes / sample_size);
+      blockBytes[block] = bytes;
+    }
+    cachedBlock = block;
+  }
+
+  /*
+   * Memory mapping
+   */
+
+  void TapeFile::map_audio() {
+    if (is_mapped()) return;
+    read_all_slices();
+    // Make sure the header is on disk, and audioOffset is up to date
+    flush();
+    mapFd = ::open(path.c_str(), O_RDWR);
+    if (mapFd < 0) {
+      throw ByteFile::Error(ByteFile::Error::Type::ExceptionThrown,
+        std::strerror(errno));
+    }
+    mapLength = stored_length();
+    try {
+      remap(mapLength);
+    } catch (ByteFile::Error& e) {
+      ::close(mapFd);
+      mapFd = -1;
+      throw;
+    }
+  }
+
+  void TapeFile::remap(Position capacity) {
+    std::size_t bytes = audioOffset + std::size_t(capacity) * sizeof(AudioFrame);
+    if (mapData != nullptr) {
+      munmap(mapData - audioOffset, mapBytes);
+      mapData = nullptr;
+    }
+    if (capacity > mapLength && ftruncate(mapFd, bytes) != 0) {
+      throw ByteFile::Error(ByteFile::Error::Type::ExceptionThrown,
+        std::strerror(errno));
+    }
+    // The offset has to be page aligned, so the header is mapped too
+    void* ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, mapFd, 0);
+    if (ptr == MAP_FAILED) {
+      throw ByteFile::Error(ByteFile::Error::Type::ExceptionThrown,
+        std::strerror(errno));
+    }
+    mapBytes = bytes;
+    mapCapacity = capacity;
+    mapData = static_cast<std::byte*>(ptr) + audioOffset;
+  }
+
+  void TapeFile::unmap_audio() {
+    // After a failed remap, the file is open but not mapped
+    if (mapFd < 0) return;
+    if (mapData != nullptr) {
+      munmap(mapData - audioOffset, mapBytes);
+      mapData = nullptr;
+    }
+    audioSize = std::size_t(mapLength) * sizeof(AudioFrame);
+    // Cut off the unused part of the last growth step
+    if (ftruncate(mapFd, audioOffset + std::size_t(mapLength) * sizeof(AudioFrame)) != 0) {
+      LOGE << "Failed to trim tape file: " << std::strerror(errno);
+    }
+    ::close(mapFd);
+    mapFd = -1;
+  }
+
+  void TapeFile::will_need(Position p, int n) {
+    if (!is_mapped()) return;
+    // madvise needs a page aligned address
+    static const std::uintptr_t pageMask = ~std::uintptr_t(sysconf(_SC_PAGESIZE) - 1);
+    p = std::max<Position>(p, 0);
+    for (Position idx = p / BlockSize; idx * BlockSize < p + n; idx++) {
+      if (idx >= Position(blockMap.size())) break;
+      uint32_t b = blockMap[idx];
+      if (b == NoBlock) continue;
+      std::size_t first, last;
+      if (is_raw(b)) {
+        first = block_sample(b, std::max<Position>(p - idx * BlockSize, 0)) * sample_size;
+        last = block_sample(b, std::min<Position>(p + n - idx * BlockSize, BlockSize)) * sample_size;
+      } else {
+        // Compressed blocks are read whole
+        first = block_sample(b) * sample_size;
+        last = first + blockBytes[b];
+      }
+      last = std::min(last, std::size_t(mapLength) * sizeof(AudioFrame));
+      if (last <= first) continue;
+      auto begin = reinterpret_cast<std::uintptr_t>(mapData + first);
+      auto aligned = begin & pageMask;
+      madvise(reinterpret_cast<void*>(aligned), begin + (last - first) - aligned,
+        MADV_WILLNEED);
+    }
   }
 }
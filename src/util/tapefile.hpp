@@ -1,30 +1,313 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+
 #include "util/soundfile.hpp"
+#include "util/audio.hpp"
+#include "util/tape-config.hpp"
+#include "util/peak-pyramid.hpp"
 
 namespace top1 {
 
   class TapeFile : public SoundFile {
   public:
     using SoundFile::Info;
+    using AudioFrame = TapeFrame;
+    constexpr static int nTracks = nTapeTracks;
 
     struct SliceData {
       uint32_t in = 0;
       uint32_t out = 0;
     };
 
-    struct SliceArray {
-      std::array<SliceData, 2048> array;
-      uint16_t count = 0;
-    };
+    using SliceList = std::vector<SliceData>;
+
+    /// The slices on `track`.
+    ///
+    /// They are read from the file the first time this is called.
+    SliceList& slices(int track);
+
+    TapeFile() {
+      info.channels = nTracks;
+    }
+
+    ~TapeFile();
+
+    /**
+     * Frames per block.
+     *
+     * The audio is stored as blocks of frames. The block map says which
+     * stored block holds each part of the tape, and blocks can be shared
+     * between versions of the tape, see <push_version>.
+     *
+     * Each part of the tape is kept in the stored block with the same index
+     * where possible. Only an undo moves parts elsewhere, and <put_in_order>
+     * moves them back, so a closed file without compressed blocks is a
+     * valid WAV file of the tape to other programs.
+     */
+    constexpr static int BlockSize = 1 << 12;
+
+    /**
+     * Whether blocks are stored compressed when written.
+     *
+     * The compression is lossless, and a silent track takes no space in a
+     * block. Nothing is written for a block where all tracks are silent,
+     * though it keeps its place in the file. A file can mix compressed and
+     * uncompressed blocks, so this can be changed at any time.
+     */
+    bool compression = TOP1_TAPE_COMPRESSION;
+
+    /// Seek to a frame, i.e. a position on all tracks at once
+    Position seek_frame(Position p);
+
+    /// The number of frames on the tape
+    Position length_frames();
+
+    /// Read `n` frames from the current position into `f`.
+    ///
+    /// Frames past the end of the tape are read as silence.
+    void read_frames(AudioFrame* f, int n);
+
+    /// Write `n` frames from `f` at the current position
+    void write_frames(const AudioFrame* f, int n);
+
+    /**
+     * Map the audio data into memory.
+     *
+     * Until <unmap_audio> is called, <read_frames> and <write_frames> are
+     * plain copies to and from the mapping, and the file is grown in large
+     * steps as needed. Nothing else may touch the audio data meanwhile.
+     *
+     * If the mapping can not be grown later, the file is unmapped, and
+     * used unmapped from then on.
+     *
+     * @throws ByteFile::Error if the file could not be mapped. The file is
+     *         left as it was, and can still be used unmapped.
+     */
+    void map_audio();
 
-    std::array<SliceArray, 4> slices;
+    /// Unmap the audio data, and trim the file to the frames in use
+    void unmap_audio();
 
-    TapeFile() = default;
+    bool is_mapped() const {
+      return mapData != nullptr;
+    }
+
+    /// Hint that `n` frames from `p` will be read soon.
+    ///
+    /// Only does anything when mapped.
+    void will_need(Position p, int n);
+
+    /**
+     * Save the current version of the tape, to restore with <pop_version>.
+     *
+     * Only the block map is copied. The blocks are shared with the saved
+     * version, until a block is written to and copied (copy on write). The
+     * cost is proportional to the length of the tape in blocks, not to the
+     * amount of audio.
+     *
+     * Saved versions are not stored in the file.
+     */
+    void push_version();
+
+    /// Go back to the version saved last with <push_version>.
+    /// @return false if there is none
+    bool pop_version();
+
+    /// Forget the oldest saved version, freeing the blocks only it uses
+    void drop_oldest_version();
+
+    /// The number of saved versions
+    int version_count() const {
+      return versions.size();
+    }
+
+    /**
+     * Whether the block map in the file is out of date.
+     *
+     * Until it is written with <flush>, a crash loses the audio in blocks
+     * the map on disk does not know of, and blocks that are no longer used
+     * are not reused, as the map on disk may still use them.
+     */
+    bool block_map_changed() const {
+      return mapChanged || !releasedBlocks.empty();
+    }
+
+    /**
+     * Forget the saved versions, and move each part of the tape back to the
+     * stored block with the same index, where an undo has moved it from.
+     *
+     * Costs in proportion to the number of parts that were moved. Call it
+     * before closing the file.
+     */
+    void put_in_order();
+
+    using PeakPyramid = audio::PeakPyramid<nTracks>;
+
+    /**
+     * Min/max peaks of the tape, for drawing it.
+     *
+     * Kept up to date by <write_frames> and <pop_version>, and stored in
+     * the file. Can be read from any thread.
+     */
+    const PeakPyramid& peaks() const {
+      return peakPyramid;
+    }
 
   protected:
 
-    void add_custom_chunks(std::vector<std::unique_ptr<Chunk>>& v) override;
+    /// A part of the tape that is not stored, and reads as silence
+    constexpr static uint32_t NoBlock = ~uint32_t(0);
+
+    using BlockMap = std::vector<uint32_t>;
+
+    struct Version {
+      BlockMap map;
+      Position length;
+    };
+
+    /// The stored block holding each part of the tape, or <NoBlock>
+    BlockMap blockMap;
+    /// The number of frames on the tape
+    Position tapeLength = 0;
+    /// The current frame
+    Position tapePos = 0;
+    /// Whether the block map was read from the file
+    bool hasBlockMap = false;
+
+    /// The number of versions using each stored block
+    std::vector<uint32_t> refCount;
+    /// Stored blocks that are not used, to be reused before growing the file
+    std::vector<uint32_t> freeBlocks;
+    /// Stored blocks that are no longer used, but may still be in the block
+    /// map on disk. They are free once the map is written
+    std::vector<uint32_t> releasedBlocks;
+    /// Whether <blockMap> has changed since it was written
+    bool mapChanged = false;
+    /// Saved versions, oldest first
+    std::deque<Version> versions;
+
+    /**
+     * The stored block to write the part `idx` of the tape to.
+     *
+     * Allocates the block as needed, in place if it is free. A block shared
+     * with saved versions is copied, and the saved versions get the copy,
+     * so the tape stays in place.
+     */
+    uint32_t block_for_write(int idx);
+    /// Take stored block `idx` if it is free, or else any free block
+    uint32_t take_block(uint32_t idx);
+    /// Take a free stored block
+    uint32_t new_block();
+    /// Stop using a stored block
+    void release_block(uint32_t block);
+    /// Swap the contents of two stored blocks
+    void swap_blocks(uint32_t a, uint32_t b);
+
+    /// The number of stored frames
+    Position stored_length();
+    /// Read `n` stored samples, from sample `p` of the audio data
+    void read_stored(Position p, Sample* s, int n);
+    /// Write `n` stored samples, at sample `p` of the audio data
+    void write_stored(Position p, const Sample* s, int n);
+
+    /// The first sample of a stored block, plus `offset` frames
+    static Position block_sample(uint32_t block, int offset = 0) {
+      return (Position(block) * BlockSize + offset) * nTracks;
+    }
+
+    // Compression
+
+    /// <blockBytes> of a block that is not compressed
+    constexpr static uint32_t RawBlock = ~uint32_t(0);
+
+    /// The encoded size of each stored block in bytes, or <RawBlock>.
+    /// 0 means all silent
+    std::vector<uint32_t> blockBytes;
+
+    /// The last block read or written, so a block is not decoded again
+    /// for each small read
+    std::vector<AudioFrame> blockCache;
+    uint32_t cachedBlock = NoBlock;
+    std::vector<std::byte> encodeBuf;
+    /// Written to new blocks that are not compressed
+    const std::vector<AudioFrame> zeroBlock = std::vector<AudioFrame>(BlockSize);
+
+    bool is_raw(uint32_t block) const;
+    /// Read a stored block into `blockCache`, decoding it if needed
+    void load_block(uint32_t block);
+    /// Write `blockCache` to a stored block, encoding it if <compression>
+    void store_block(uint32_t block);
+
+    /// The most bytes a block can take while encoding
+    static const std::size_t max_encoded_size;
+    /// Encode <BlockSize> frames.
+    /// @return the encoded size. 0 if all silent
+    static std::size_t encode_block(const AudioFrame* frames, std::byte* out);
+    static void decode_block(const std::byte* in, std::size_t size, AudioFrame* frames);
+
+    /**
+     * Read the file, and check that it holds a tape.
+     *
+     * A tape file with fewer tracks than <nTracks> is widened, which
+     * rewrites all of the audio once. A file that is not a tape, or has
+     * more tracks, is closed without writing it.
+     * @throws const char* saying what is wrong with the file
+     */
+    void read_file() override;
+    void write_file() override;
+
+    /// Close the file without writing anything, and throw `why`
+    [[noreturn]] void refuse(const char* why);
+    /// Add silent tracks to a file with fewer than <nTracks> tracks
+    void widen_tracks();
+
+    // Peaks
+
+    PeakPyramid peakPyramid;
+    std::vector<AudioFrame> peakBuf;
+    /// Whether the peaks were read from the file
+    bool hasPeaks = false;
+
+    /// Update the peaks after `n` frames from `f` were written at `from`.
+    /// Only the parts of `f` that do not cover whole peaks are read back.
+    void update_peaks(Position from, const AudioFrame* f, int n);
+    /// Update the peaks of `[from, to)` from the tape
+    void read_peaks(Position from, Position to);
+
+    // Memory mapping
+    int mapFd = -1;
+    std::byte* mapData = nullptr;
+    std::size_t mapBytes = 0;
+    /// Frames that fit in the mapping
+    Position mapCapacity = 0;
+    /// Stored frames actually in use
+    Position mapLength = 0;
+
+    void remap(Position capacity);
+
+
+    void add_trailing_chunks(std::vector<std::unique_ptr<Chunk>>& v) override;
     void replace_custom_chunk(std::unique_ptr<Chunk>& ptr) override;
 
+    friend struct TRCKChunk;
+    friend struct BMAPChunk;
+    friend struct BIDXChunk;
+    friend struct PEAKChunk;
+
+    std::array<SliceList, nTracks> sliceLists;
+
+    /// Where the slices of a track are in the file, until they are read
+    struct UnreadSlices {
+      Position offset = -1;
+      uint32_t count = 0;
+    };
+    std::array<UnreadSlices, nTracks> unreadSlices;
+
+    /// Read the slices of all tracks, before the data is overwritten
+    void read_all_slices();
+
   };
 
 }
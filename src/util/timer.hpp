@@ -4,7 +4,13 @@
 #include <vector>
 #include <utility>
 #include <map>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
 #include <numeric>
 #include <algorithm>
 #include <fstream>
@@ -14,6 +20,11 @@
 
 namespace top1::timer {
 
+  /**
+   * Keeps every measured time, so it grows without bound. Fine for timing
+   * a few calls, but use <TIME_SCOPE> for anything that runs on the audio
+   * thread.
+   */
   struct Timer {
     using Duration = std::chrono::nanoseconds;
     using Clock = std::chrono::steady_clock;
@@ -91,6 +102,195 @@ namespace top1::timer {
     }
   };
 
+  /**
+   * A histogram of durations, with a fixed number of logarithmic buckets.
+   *
+   * Each power of two is split into <SubBuckets> buckets, so a value is
+   * known to within 1/<SubBuckets> of itself. The counters are atomic, but
+   * only one thread should <record> into a histogram, as the increments
+   * are not atomic. Any thread may read it.
+   */
+  struct Histogram {
+    using Duration = std::chrono::nanoseconds;
+
+    static constexpr int SubBits = 3;
+    static constexpr int SubBuckets = 1 << SubBits;
+    /// Times from 2^MaxExp ns (about 18 minutes) end up in the last bucket
+    static constexpr int MaxExp = 40;
+    static constexpr int Buckets = (MaxExp - SubBits + 2) * SubBuckets;
+
+    std::array<std::atomic<std::uint32_t>, Buckets> counts {};
+    std::atomic<std::uint64_t> total {0};
+    std::atomic<std::uint64_t> sum {0};
+    std::atomic<std::uint64_t> max {0};
+
+    static int bucket(std::uint64_t ns) {
+      if (ns < SubBuckets) return ns;
+      int exp = 63 - __builtin_clzll(ns);
+      if (exp > MaxExp) return Buckets - 1;
+      int sub = (ns >> (exp - SubBits)) & (SubBuckets - 1);
+      return (exp - SubBits + 1) * SubBuckets + sub;
+    }
+
+    /// The smallest value in bucket `idx`
+    static std::uint64_t lowerBound(int idx) {
+      if (idx < SubBuckets) return idx;
+      int exp = idx / SubBuckets - 1 + SubBits;
+      int sub = idx % SubBuckets;
+      return std::uint64_t(SubBuckets + sub) << (exp - SubBits);
+    }
+
+    void record(Duration d) {
+      constexpr auto relaxed = std::memory_order_relaxed;
+      std::uint64_t ns = std::max<std::int64_t>(d.count(), 0);
+      auto& c = counts[bucket(ns)];
+      c.store(c.load(relaxed) + 1, relaxed);
+      total.store(total.load(relaxed) + 1, relaxed);
+      sum.store(sum.load(relaxed) + ns, relaxed);
+      if (ns > max.load(relaxed)) max.store(ns, relaxed);
+    }
+
+    /// A copy of one or more histograms, to calculate percentiles from
+    struct Summary {
+      std::array<std::uint64_t, Buckets> counts {};
+      std::uint64_t total = 0;
+      std::uint64_t sum = 0;
+      std::uint64_t max = 0;
+
+      void add(const Histogram& h) {
+        constexpr auto relaxed = std::memory_order_relaxed;
+        for (int i = 0; i < Buckets; i++) {
+          counts[i] += h.counts[i].load(relaxed);
+        }
+        total += h.total.load(relaxed);
+        sum += h.sum.load(relaxed);
+        max = std::max(max, h.max.load(relaxed));
+      }
+
+      /// The time below which a fraction `p` of the recorded times fall.
+      /// Reported as the middle of its bucket, but never above the maximum,
+      /// which is exact
+      Duration percentile(double p) const {
+        std::uint64_t rank = std::max<std::uint64_t>(std::ceil(p * total), 1);
+        if (rank >= total) return Duration(max);
+        std::uint64_t seen = 0;
+        for (int i = 0; i < Buckets; i++) {
+          seen += counts[i];
+          if (seen >= rank) {
+            std::uint64_t mid = (lowerBound(i) + lowerBound(i + 1) - 1) / 2;
+            return Duration(std::min(mid, max));
+          }
+        }
+        return Duration(max);
+      }
+
+      Duration mean() const {
+        return Duration(total > 0 ? sum / total : 0);
+      }
+
+      nlohmann::json jsonSerialize() const {
+        auto ret = nlohmann::json::object();
+        ret["count"] = total;
+        ret["mean"] = Timer::numSecs(mean());
+        ret["p50"] = Timer::numSecs(percentile(0.5));
+        ret["p99"] = Timer::numSecs(percentile(0.99));
+        ret["p999"] = Timer::numSecs(percentile(0.999));
+        ret["max"] = Timer::numSecs(Duration(max));
+        return ret;
+      }
+    };
+  };
+
+  /**
+   * The histogram timers of <TIME_SCOPE>.
+   *
+   * Timers are registered during static initialization, so the audio
+   * thread never looks up a name. Each thread records into its own slot of
+   * histograms, so recording takes no locks and no read-modify-writes.
+   * Threads beyond <MaxThreads> share the last slot, and may lose a few
+   * counts to each other.
+   */
+  class TimerRegistry {
+  public:
+    static constexpr int MaxTimers = 32;
+    static constexpr int MaxThreads = 16;
+
+    static TimerRegistry& get() {
+      static TimerRegistry registry;
+      return registry;
+    }
+
+    /// Register a timer, or get the id of the one with this name.
+    /// Not for the audio thread
+    int add(const char* name) {
+      std::lock_guard lock (mutex);
+      int n = count.load();
+      for (int i = 0; i < n; i++) {
+        if (std::strcmp(names[i], name) == 0) return i;
+      }
+      if (n == MaxTimers) throw "Too many timers registered";
+      names[n] = name;
+      count.store(n + 1);
+      return n;
+    }
+
+    void record(int id, Histogram::Duration d) {
+      thread_local Slot& slot = slots[std::min(usedSlots++, MaxThreads - 1)];
+      slot[id].record(d);
+    }
+
+    /// The times of timer `id`, from all threads
+    Histogram::Summary summary(int id) const {
+      Histogram::Summary ret;
+      int n = std::min(usedSlots.load(), MaxThreads);
+      for (int i = 0; i < n; i++) {
+        ret.add(slots[i][id]);
+      }
+      return ret;
+    }
+
+    nlohmann::json jsonSerialize() const {
+      auto ret = nlohmann::json::object();
+      int n = count.load();
+      for (int i = 0; i < n; i++) {
+        ret[names[i]] = summary(i).jsonSerialize();
+      }
+      return ret;
+    }
+
+  private:
+    using Slot = std::array<Histogram, MaxTimers>;
+
+    TimerRegistry() = default;
+
+    std::mutex mutex;
+    std::array<const char*, MaxTimers> names {};
+    std::atomic_int count {0};
+    std::array<Slot, MaxThreads> slots {};
+    std::atomic_int usedSlots {0};
+  };
+
+  /// The id of the timer named by `Tag::str()`, registered before `main`
+  template<typename Tag>
+  struct TimerId {
+    static inline const int id = TimerRegistry::get().add(Tag::str());
+  };
+
+  /// Records the time from creation until destruction into a registered
+  /// timer
+  struct HistogramScope {
+    using Clock = std::chrono::steady_clock;
+
+    int id;
+    Clock::time_point start;
+
+    explicit HistogramScope(int id) : id (id), start (Clock::now()) {}
+
+    ~HistogramScope() {
+      TimerRegistry::get().record(id, Clock::now() - start);
+    }
+  };
+
   struct TimerDispatcher {
     std::unordered_map<std::string, Timer> timers;
     std::string path = "data/timers.json";
@@ -111,7 +311,7 @@ namespace top1::timer {
       return ScopeTimer(timers[name]);
     }
 
-    nlohmann::json jsonSerialize() {
+    virtual nlohmann::json jsonSerialize() {
       nlohmann::json output = nlohmann::json::object();
       for (auto&& [n, t] : timers) {
         output[n] = t.jsonSerialize();
@@ -126,13 +326,24 @@ namespace top1::timer {
     }
   };
 
-  /// Writes to file on destruction. 
+  /// Writes to file on destruction, together with the histogram timers
   struct GlobalTimerDispatcher : public TimerDispatcher {
 
     GlobalTimerDispatcher() : TimerDispatcher() {
+      // Construct the registry first, so it outlives this
+      TimerRegistry::get();
       timers["Program time"].startTimer();
     }
 
+    nlohmann::json jsonSerialize() override {
+      auto output = TimerDispatcher::jsonSerialize();
+      auto histograms = TimerRegistry::get().jsonSerialize();
+      for (auto it = histograms.begin(); it != histograms.end(); ++it) {
+        output[it.key()] = it.value();
+      }
+      return output;
+    }
+
     ~GlobalTimerDispatcher() {
       timers["Program time"].stopTimer();
       writeToFile();
@@ -141,6 +352,21 @@ namespace top1::timer {
 
   inline GlobalTimerDispatcher dispatcher {};
 
-#define TIME_SCOPE(name) auto timer = top1::timer::dispatcher.timeScope(name);
+/**
+ * Time the rest of the enclosing scope into a histogram, reported in
+ * `data/timers.json` with its percentiles.
+ *
+ * Realtime safe: the name is registered before `main`, and nothing is
+ * allocated or locked. `name` must be a string literal. A scope can have
+ * more than one, but only one per line.
+ */
+#define TIME_SCOPE(name) TIME_SCOPE_AT(name, __LINE__)
+
+// Expands `line` before pasting it into the names
+#define TIME_SCOPE_AT(name, line) TIME_SCOPE_NAMED(name, line)
+#define TIME_SCOPE_NAMED(name, line)                                      \
+  struct TimeScopeTag##line { static const char* str() { return name; } }; \
+  top1::timer::HistogramScope timeScope##line                             \
+    (top1::timer::TimerId<TimeScopeTag##line>::id);
 
 } // top1::timer
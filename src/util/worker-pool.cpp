@@ -0,0 +1,105 @@
+#include "worker-pool.hpp"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <algorithm>
+#include <plog/Log.h>
+
+namespace top1 {
+
+  WorkerPool::WorkerPool(int nWorkers, bool pin) {
+    threads.reserve(std::max(nWorkers, 0));
+    for (int i = 0; i < nWorkers; i++) {
+      threads.emplace_back(&WorkerPool::loop, this);
+#ifdef __linux__
+      if (pin) {
+        unsigned cpus = std::max(std::thread::hardware_concurrency(), 1u);
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET((i + 1) % cpus, &set);
+        if (pthread_setaffinity_np(threads.back().native_handle(),
+                                   sizeof(set), &set) != 0) {
+          LOGD << "Could not pin worker " << i;
+        }
+      }
+#endif
+    }
+  }
+
+  WorkerPool::~WorkerPool() {
+    stop = true;
+    for (std::size_t i = 0; i < threads.size(); i++) {
+      wake.post();
+    }
+    for (auto&& t : threads) {
+      t.join();
+    }
+  }
+
+  bool WorkerPool::setRealtime(int priority) {
+    bool ok = true;
+#ifdef __linux__
+    sched_param param {};
+    param.sched_priority = priority;
+    for (auto&& t : threads) {
+      if (pthread_setschedparam(t.native_handle(), SCHED_FIFO, &param) != 0) {
+        ok = false;
+      }
+    }
+#else
+    ok = threads.empty();
+#endif
+    if (!ok) LOGD << "Could not give the workers realtime priority";
+    return ok;
+  }
+
+  void WorkerPool::publish(int nTasks) {
+    pending.store(nTasks, std::memory_order_relaxed);
+    Word gen = generation(work.load(std::memory_order_relaxed)) + 1;
+    work.store((gen << 32) | (Word(nTasks) << 16));
+    // The sleepers count is incremented before a worker checks the work, so
+    // either it sees the new batch, or we see it sleeping. A worker that saw
+    // the batch may get a post it does not need, and only wakes once more
+    for (int n = sleepers.exchange(0); n > 0; n--) {
+      wake.post();
+    }
+  }
+
+  bool WorkerPool::claim() {
+    Word w = work.load(std::memory_order_acquire);
+    while (index(w) < count(w)) {
+      if (work.compare_exchange_weak(w, w + 1, std::memory_order_acquire)) {
+        task.call(task.ctx, index(w));
+        pending.fetch_sub(1, std::memory_order_release);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void WorkerPool::loop() {
+    while (!stop) {
+      if (claim()) continue;
+      Word last = work.load();
+      auto spinEnd = std::chrono::steady_clock::now()
+        + spinTime.load(std::memory_order_relaxed);
+      for (int i = 0; work.load(std::memory_order_relaxed) == last; i++) {
+        if (stop) return;
+        if (i % 64 == 63) {
+          if (std::chrono::steady_clock::now() > spinEnd) break;
+          std::this_thread::yield();
+        }
+      }
+      if (work.load() != last) continue;
+
+      sleepers++;
+      while (!stop && work.load() == last) {
+        wake.wait_for(std::chrono::milliseconds(100));
+      }
+    }
+  }
+
+} // top1
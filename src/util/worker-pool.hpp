@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "util/semaphore.hpp"
+
+namespace top1 {
+
+  /**
+   * A fixed set of threads that run a batch of tasks together with the
+   * calling thread.
+   *
+   * Made for the audio thread: <run> never allocates, and the calling thread
+   * takes part in the work, so a pool with no workers just runs everything
+   * serially. Idle workers spin for the spin time after each batch, in case
+   * the next one comes soon. After that they sleep, and the next <run> wakes
+   * them with a <Semaphore>, which takes no lock.
+   *
+   * A spinning worker keeps its cpu busy, and at realtime priority nothing
+   * else gets to run there, so for audio the spin time should be a small
+   * part of a period, see <setSpinTime>.
+   *
+   * Only one thread may call <run> at a time.
+   */
+  class WorkerPool {
+  public:
+
+    /// How long an idle worker polls for work before it sleeps, unless
+    /// set with <setSpinTime>
+    static constexpr std::chrono::microseconds DefaultSpinTime {100};
+
+    /**
+     * Start `nWorkers` threads.
+     *
+     * When `pin` is set, worker `i` is pinned to cpu `i + 1`, so no two
+     * workers share a cpu. The thread that calls <run> is not pinned.
+     * Pinning is only done on Linux.
+     */
+    explicit WorkerPool(int nWorkers = 0, bool pin = false);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    int size() const {
+      return threads.size();
+    }
+
+    /**
+     * Give the workers realtime priority, to match the thread that calls
+     * <run>. Only done on Linux, and returns false if not permitted.
+     */
+    bool setRealtime(int priority);
+
+    /// Set how long an idle worker polls for work before it sleeps.
+    /// Can be called from any thread
+    void setSpinTime(std::chrono::nanoseconds time) {
+      spinTime.store(time, std::memory_order_relaxed);
+    }
+
+    /**
+     * Call `f(i)` for each `i` in `[0, nTasks)`, and return when all calls
+     * have returned.
+     *
+     * The calls are spread across the workers and the calling thread, in no
+     * particular order.
+     */
+    template<typename F>
+    void run(int nTasks, F&& f) {
+      using Func = std::remove_reference_t<F>;
+      if (nTasks <= 0) return;
+      if (threads.empty() || nTasks == 1) {
+        for (int i = 0; i < nTasks; i++) f(i);
+        return;
+      }
+      task = {[] (void* ctx, int i) { (*static_cast<Func*>(ctx))(i); },
+              const_cast<void*>(static_cast<const void*>(&f))};
+      publish(nTasks);
+      while (claim());
+      while (pending.load(std::memory_order_acquire) > 0) {
+        std::this_thread::yield();
+      }
+    }
+
+  private:
+
+    struct Task {
+      void (*call)(void*, int) = nullptr;
+      void* ctx = nullptr;
+    };
+
+    /// The packed state of the current batch: the generation in the upper
+    /// 32 bits, the number of tasks in the next 16, and the index of the
+    /// next unclaimed task in the lower 16
+    using Word = std::uint64_t;
+
+    static int index(Word w) { return w & 0xFFFF; }
+    static int count(Word w) { return (w >> 16) & 0xFFFF; }
+    static Word generation(Word w) { return w >> 32; }
+
+    std::atomic<Word> work {0};
+    std::atomic_int pending {0};
+    Task task;
+
+    std::atomic<std::chrono::nanoseconds> spinTime {DefaultSpinTime};
+
+    std::atomic_bool stop {false};
+    /// Workers that are going to sleep, and have not been posted for yet
+    std::atomic_int sleepers {0};
+    Semaphore wake;
+
+    std::vector<std::thread> threads;
+
+    void publish(int nTasks);
+    /// Claim and run the next task of the current batch.
+    /// Returns false if there was nothing left to claim
+    bool claim();
+    void loop();
+  };
+
+} // top1
@@ -0,0 +1,58 @@
+#include "../../testing.t.hpp"
+
+#include <thread>
+
+#include "core/audio/dsp-stats.hpp"
+
+namespace top1::audio {
+
+  using namespace std::chrono_literals;
+
+  TEST_CASE("DspStats track the load of each period", "[DspStats]") {
+    DspStats stats;
+    auto start = DspStats::Clock::now();
+
+    stats.beginPeriod(start);
+    stats.endPeriod(1ms, 4ms);
+    stats.beginPeriod(start + 4ms);
+    stats.endPeriod(3ms, 4ms);
+    stats.beginPeriod(start + 10ms);
+    stats.endPeriod(2ms, 4ms);
+
+    auto s = stats.snapshot();
+    REQUIRE(s.callbacks == 3);
+    REQUIRE(s.load == Approx(0.5));
+    REQUIRE(s.maxLoad == Approx(0.75));
+    REQUIRE(s.avgLoad == Approx(0.5));
+    REQUIRE(s.worstWork == 3ms);
+    REQUIRE(s.worstInterval == 6ms);
+    REQUIRE(s.xruns == 0);
+
+    stats.xrun();
+    stats.setLatency(512);
+    s = stats.snapshot();
+    REQUIRE(s.xruns == 1);
+    REQUIRE(s.latency == 512);
+  }
+
+  TEST_CASE("DspStats time the modules", "[DspStats]") {
+    DspStats stats;
+    bool ran = false;
+    stats.time(DspStats::Node::Synth, [&] {
+        ran = true;
+        std::this_thread::sleep_for(2ms);
+      });
+    stats.time(DspStats::Node::Synth, [] {});
+    REQUIRE(ran);
+
+    auto s = stats.snapshot();
+    int synth = static_cast<int>(DspStats::Node::Synth);
+    REQUIRE(s.nodeWorst[synth] >= 2ms);
+    REQUIRE(s.nodeTime[synth] < s.nodeWorst[synth]);
+    REQUIRE(s.nodeWorst[static_cast<int>(DspStats::Node::Drums)] == 0ms);
+
+    auto json = s.jsonSerialize();
+    REQUIRE(json["modules"]["Synth"]["worst"] >= 0.002);
+  }
+
+} // top1::audio
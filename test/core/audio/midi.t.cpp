@@ -0,0 +1,46 @@
+#include "../../testing.t.hpp"
+
+#include "core/audio/midi.hpp"
+
+namespace top1::midi {
+
+  TEST_CASE("MidiEventBuffer", "[midi]") {
+    MidiEventBuffer buf;
+
+    MidiEvent::byte noteOn[] = {0x91, 60, 100};
+    MidiEvent::byte cc[] = {0xB0, 7, 64};
+    MidiEvent::byte pitchBend[] = {0xE0, 0, 64};
+
+    REQUIRE(buf.push(noteOn, 3, 10));
+    REQUIRE(buf.push(cc, 3, 20));
+    REQUIRE_FALSE(buf.push(pitchBend, 3, 30));
+    REQUIRE_FALSE(buf.push(noteOn, 2, 30));
+    REQUIRE(buf.size() == 2);
+
+    auto& on = std::get<NoteOnEvent>(buf[0]);
+    REQUIRE(on.channel == 1);
+    REQUIRE(on.key == 60);
+    REQUIRE(on.velocity == 100);
+    REQUIRE(on.time == 10);
+
+    int controls = 0;
+    for (auto&& event : buf) {
+      match(event, [&] (ControlChangeEvent& e) {
+          REQUIRE(e.controler == 7);
+          REQUIRE(e.value == 64);
+          controls++;
+        }, [] (auto&&) {});
+    }
+    REQUIRE(controls == 1);
+
+    SECTION("Events past the capacity are dropped") {
+      for (std::size_t i = 0; i < MidiEventBuffer::Capacity; i++) {
+        buf.push(NoteOffEvent(0, 60, 0, i));
+      }
+      REQUIRE(buf.size() == MidiEventBuffer::Capacity);
+      REQUIRE(buf.dropped() == 2);
+      buf.clear();
+      REQUIRE(buf.empty());
+    }
+  }
+}
@@ -0,0 +1,79 @@
+#include "../../testing.t.hpp"
+
+#include "core/audio/offline.hpp"
+#include "core/globals.hpp"
+
+namespace top1::audio {
+
+  /// Plays a constant while a note is held
+  struct TestSynth : modules::SynthModule {
+    bool on = false;
+
+    void process(const ProcessData& data) override {
+      for (auto&& event : data.midi) {
+        if (std::holds_alternative<midi::NoteOnEvent>(event)) on = true;
+        if (std::holds_alternative<midi::NoteOffEvent>(event)) on = false;
+      }
+      if (on) {
+        for (auto& f : data.audio.proc) f += 0.5;
+      }
+    }
+  };
+
+  TEST_CASE("OfflineAudio renders a midi file", "[audio]") {
+    fs::path midiPath = test::dir / "offline.mid";
+    fs::path outPath = test::dir / "offline.wav";
+
+    // One track, 96 ticks per quarter note at 120 bpm: a note from the
+    // start, released after a tick, i.e. 230 frames
+    std::vector<char> data = {
+      'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 0, 0, 1, 0, 96,
+      'M', 'T', 'r', 'k', 0, 0, 0, 12,
+      0x00, char(0x90), 60, 100,
+      0x01, char(0x80), 60, 0,
+      0x00, char(0xFF), 0x2F, 0,
+    };
+    {
+      std::ofstream file(midiPath, std::ios::binary | std::ios::trunc);
+      file.write(data.data(), data.size());
+    }
+
+    Globals::synth.registerModule<TestSynth>("Test");
+
+    // Not a whole number of periods
+    int length = 1000;
+    OfflineAudio::Options options;
+    options.midi = midiPath;
+    options.output = outPath;
+    options.length = length;
+    options.bufferSize = 64;
+    OfflineAudio driver(options);
+    driver.init();
+    driver.render();
+    driver.exit();
+    Globals::synth.unregisterModule("Test");
+
+    SoundFile out;
+    out.open(outPath);
+    REQUIRE(out.info.channels == 2);
+    REQUIRE(out.length() == 2 * length);
+
+    std::vector<float> samples(2 * length);
+    out.seek(0);
+    out.read_samples(samples.data(), samples.size());
+    REQUIRE(samples[0] != 0);
+    REQUIRE(samples[1] != 0);
+    REQUIRE(samples[2 * length - 1] == 0);
+  }
+
+  TEST_CASE("The audio driver can be replaced", "[audio]") {
+    // Like `main` does for --render
+    Globals::audioDriver = std::make_unique<OfflineAudio>(OfflineAudio::Options());
+    Globals::audioDriver = std::make_unique<OfflineAudio>(OfflineAudio::Options());
+    // Only the buffers of the current driver are resized
+    Globals::events.bufferSizeChanged.runAll(128);
+    Globals::audioDriver = nullptr;
+    Globals::events.bufferSizeChanged.runAll(256);
+  }
+
+}
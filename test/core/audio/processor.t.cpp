@@ -0,0 +1,80 @@
+#include "../../testing.t.hpp"
+
+#include "core/audio/processor.hpp"
+#include "core/globals.hpp"
+
+namespace top1::audio {
+
+  TEST_CASE("ProcessData is split at midi events", "[midi]") {
+    std::vector<float> buf(256);
+    std::vector<midi::AnyMidiEvent> events = {
+      midi::NoteOnEvent(0, 60, 100, 5),
+      midi::NoteOnEvent(0, 62, 100, 100),
+      midi::NoteOffEvent(0, 60, 0, 108),
+      midi::NoteOffEvent(0, 62, 0, 200),
+    };
+    ProcessData data;
+    data.nframes = 256;
+    data.audio.outL = data.audio.outR = data.audio.input = data.audio.proc = buf;
+    data.midi = events;
+
+    std::vector<ProcessData> slices;
+    data.splitAtEvents(16, [&] (const ProcessData& s) { slices.push_back(s); });
+
+    // The first event is close enough to the start to not split there,
+    // and so is the third to the second
+    REQUIRE(slices.size() == 3);
+    REQUIRE(slices[0].audio.offset == 0);
+    REQUIRE(slices[0].nframes == 100);
+    REQUIRE(slices[0].midi.size() == 1);
+    REQUIRE(slices[1].audio.offset == 100);
+    REQUIRE(slices[1].nframes == 100);
+    REQUIRE(slices[1].audio.proc.data() == buf.data() + 100);
+    REQUIRE(slices[1].midi.size() == 2);
+    REQUIRE(slices[2].audio.offset == 200);
+    REQUIRE(slices[2].nframes == 56);
+    REQUIRE(midi::eventTime(slices[2].midi[0]) == 200);
+
+    SECTION("Slices have the events in their frames") {
+      auto s = data.slice({100, 200});
+      REQUIRE(s.midi.size() == 2);
+      auto inner = s.slice({50, 100});
+      REQUIRE(inner.audio.offset == 150);
+      REQUIRE(inner.midi.empty());
+      REQUIRE_THROWS(s.slice({50, 101}));
+    }
+
+    SECTION("Without events, the period is not split") {
+      data.midi = {};
+      int calls = 0;
+      data.splitAtEvents(16, [&] (const ProcessData& s) {
+          REQUIRE(s.nframes == 256);
+          calls++;
+        });
+      REQUIRE(calls == 1);
+    }
+
+    SECTION("An event at the start of a slice does not end it") {
+      events.insert(events.begin(), midi::NoteOnEvent(0, 64, 100, 0));
+      data.midi = events;
+      std::vector<ProcessData> split;
+      data.splitAtEvents(0, [&] (const ProcessData& s) { split.push_back(s); });
+      REQUIRE(split.size() == 5);
+      REQUIRE(split[0].nframes == 5);
+      REQUIRE(split[0].midi.size() == 1);
+      REQUIRE(split[4].audio.offset == 200);
+      REQUIRE(split[4].nframes == 56);
+    }
+  }
+
+  TEST_CASE("RTBuffers are resized until they are destroyed", "[audio]") {
+    RTBuffer<float> kept (2);
+    {
+      RTBuffer<float> gone;
+      Globals::events.bufferSizeChanged.runAll(64);
+      REQUIRE(gone.size() == 64);
+    }
+    Globals::events.bufferSizeChanged.runAll(128);
+    REQUIRE(kept.size() == 256);
+  }
+}
@@ -0,0 +1,63 @@
+#include "testing.t.hpp"
+
+#include "core/modules/module-dispatcher.hpp"
+
+namespace top1::modules {
+
+  /// Records the events of every slice it is given
+  struct EventRecorder : SynthModule {
+    std::vector<std::vector<midi::AnyMidiEvent>> slices;
+
+    void process(const audio::ProcessData& data) override {
+      slices.emplace_back(data.midi.begin(), data.midi.end());
+    }
+  };
+
+  TEST_CASE("SynthModuleDispatcher holds back note-offs of short notes", "[modules]") {
+    SynthModuleDispatcher dispatcher;
+    dispatcher.registerModule<EventRecorder>("Recorder");
+    auto& recorder = static_cast<EventRecorder&>(dispatcher.current());
+
+    std::vector<float> buf(64);
+    std::vector<midi::AnyMidiEvent> events = {
+      midi::NoteOnEvent(0, 60, 100, 0),
+      midi::NoteOnEvent(0, 62, 100, 2),
+      midi::NoteOffEvent(0, 62, 0, 4),
+      midi::NoteOffEvent(0, 64, 0, 6),
+    };
+    audio::ProcessData data;
+    data.nframes = 64;
+    data.audio.outL = data.audio.outR = data.audio.input = data.audio.proc = buf;
+    data.midi = events;
+
+    dispatcher.process(data);
+    REQUIRE(recorder.slices.size() == 1);
+    // The note-off of 62 waits for the next slice, the other one does not
+    auto& first = recorder.slices[0];
+    REQUIRE(first.size() == 3);
+    REQUIRE(std::get<midi::NoteOffEvent>(first[2]).key == 64);
+
+    data.midi = {};
+    dispatcher.process(data);
+    REQUIRE(recorder.slices.size() == 2);
+    auto& second = recorder.slices[1];
+    REQUIRE(second.size() == 1);
+    REQUIRE(std::get<midi::NoteOffEvent>(second[0]).key == 62);
+    REQUIRE(midi::eventTime(second[0]) == 0);
+
+    SECTION("A note started again in the slice is not released") {
+      events = {
+        midi::NoteOnEvent(0, 60, 100, 0),
+        midi::NoteOffEvent(0, 60, 0, 2),
+        midi::NoteOnEvent(0, 60, 100, 4),
+      };
+      data.midi = events;
+      dispatcher.process(data);
+      data.midi = {};
+      dispatcher.process(data);
+      REQUIRE(recorder.slices[2].size() == 2);
+      REQUIRE(recorder.slices[3].empty());
+    }
+  }
+
+}
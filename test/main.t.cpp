@@ -1,6 +1,8 @@
 #define CATCH_CONFIG_RUNNER
 #include "testing.t.hpp"
 
+#include "core/globals.hpp"
+
 #include <plog/Log.h>
 #include <plog/Appenders/ConsoleAppender.h>
 
@@ -17,6 +19,9 @@ int main( int argc, char* argv[] )
 
   fs::create_directories(test::dir);
 
+  // Like at startup, for the modules in Globals
+  top1::Globals::events.preInit.runAll();
+
   int result = Catch::Session().run( argc, argv );
 
   // global clean-up...
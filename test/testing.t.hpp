@@ -6,8 +6,11 @@
 #include <fmt/format.h>
 #include <random.hpp>
 #include <fstream>
+#include <vector>
 #include <filesystem.hpp>
 
+#include "util/soundfile.hpp"
+
 using Random = effolkronium::random_static;
 namespace fs = filesystem;
 
@@ -21,4 +24,17 @@ namespace test {
     fstream.close();
   }
 
+  /// Write a mono sound file in <dir>, with `frames` frames at 0.5
+  inline fs::path writeSample(const std::string& name, int frames) {
+    fs::path path = dir / name;
+    fs::remove(path);
+    top1::SoundFile file;
+    file.info.samplerate = 44100;
+    file.open(path);
+    std::vector<float> audio(frames, 0.5f);
+    file.write_samples(audio.data(), audio.size());
+    file.close();
+    return path;
+  }
+
 }
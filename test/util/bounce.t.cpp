@@ -0,0 +1,64 @@
+#include "../testing.t.hpp"
+
+#include "util/bounce.hpp"
+#include "util/tapefile.hpp"
+
+namespace top1 {
+
+  TEST_CASE("Bounce", "[util]") {
+    fs::path tapePath = test::dir / "bounce.tape";
+    fs::path outPath = test::dir / "bounce.wav";
+
+    // Longer than a batch of blocks, so reading and mixing overlap
+    int n = 3 * (1 << 16) + 1000;
+    {
+      fs::remove(tapePath);
+      TapeFile tape;
+      tape.open(tapePath);
+      std::vector<TapeFile::AudioFrame> frames(n);
+      for (int i = 0; i < n; i++) {
+        for (int t = 0; t < TapeFile::nTracks; t++) {
+          frames[i][t] = (t + 1) * (i % 100) / 1000.f;
+        }
+      }
+      tape.seek_frame(0);
+      tape.write_frames(frames.data(), n);
+      tape.close();
+    }
+
+    TapeMix mix;
+    mix.tracks[0] = {1, -0.5, false};
+    mix.tracks[1] = {0.5, 0.5, true};
+
+    float last = 0;
+    bounce(tapePath, outPath, mix, 2, [&] (float p) { last = p; });
+    REQUIRE(last == 1);
+
+    SoundFile out;
+    out.open(outPath);
+    REQUIRE(out.info.channels == 2);
+    REQUIRE(out.length() == 2 * n);
+    std::vector<float> samples(2 * n);
+    out.seek(0);
+    out.read_samples(samples.data(), 2 * n);
+    for (int i : {0, 99, 1 << 16, n - 1}) {
+      TapeFile::AudioFrame frame;
+      for (int t = 0; t < TapeFile::nTracks; t++) {
+        frame[t] = (t + 1) * (i % 100) / 1000.f;
+      }
+      float l = 0, r = 0;
+      mix.mixFrame(frame, l, r);
+      REQUIRE(samples[2 * i] == Approx(l));
+      REQUIRE(samples[2 * i + 1] == Approx(r));
+    }
+    // Muted tracks are left out
+    TapeFile::AudioFrame muted;
+    muted[1] = 1;
+    float l = 0, r = 0;
+    mix.mixFrame(muted, l, r);
+    REQUIRE(l == 0);
+    REQUIRE(r == 0);
+
+    REQUIRE_THROWS(bounce(test::dir / "missing.tape", outPath, mix));
+  }
+}
@@ -1,6 +1,8 @@
 #include "../testing.t.hpp"
 
 #include <iterator>
+#include <list>
+#include <numeric>
 
 #include "util/bytefile.hpp"
 #include "util/algorithm.hpp"
@@ -72,6 +74,59 @@ namespace top1 {
       REQUIRE(f.read_bytes(readBytes.begin(), 10).is_err());
     }
 
+    SECTION("Positional reads and writes") {
+
+      Path freshPath = test::dir / "positional.bytes";
+      fs::remove(freshPath);
+      REQUIRE_NOTHROW(f.open(freshPath));
+
+      std::array<std::byte, 16> bytes;
+      std::iota((unsigned char*) bytes.begin(), (unsigned char*) bytes.end(), 0);
+      f.write_at(100, bytes.data(), 16);
+      REQUIRE(f.position() == 0);
+      REQUIRE(f.size() == 116);
+
+      std::array<std::byte, 16> readBytes;
+      REQUIRE(f.read_at(100, readBytes.data(), 16) == 16);
+      REQUIRE(readBytes == bytes);
+      REQUIRE(f.read_at(108, readBytes.data(), 16) == 8);
+      REQUIRE(f.position() == 0);
+
+      SECTION("Past 2 GiB") {
+        ByteFile::Position far = (ByteFile::Position(1) << 31) + 100;
+        f.write_at(far, bytes.data(), 16);
+        REQUIRE(f.size() == far + 16);
+        REQUIRE(f.seek(far) == far);
+        REQUIRE(f.read_at(far, readBytes.data(), 16) == 16);
+        REQUIRE(readBytes == bytes);
+      }
+    }
+
+    SECTION("Iterators that are not pointers") {
+
+      REQUIRE_NOTHROW(f.open(somePath));
+
+      // More than one batch
+      constexpr int someSize = 2 * ByteFile::BatchSize + 100;
+      std::list<std::byte> bytes;
+      for (int i = 0; i < someSize; i++) {
+        bytes.push_back(std::byte(i * 7));
+      }
+      f.write_bytes(bytes.begin(), bytes.end());
+      REQUIRE(f.position() == someSize);
+
+      f.seek(0);
+      std::vector<std::byte> readBytes;
+      REQUIRE(f.read_bytes(std::back_inserter(readBytes), someSize).is_ok());
+      REQUIRE(std::equal(bytes.begin(), bytes.end(), readBytes.begin()));
+
+      f.seek(-16, std::ios::end);
+      std::list<std::byte> tail (20);
+      auto res = f.read_bytes(tail.begin(), tail.end());
+      REQUIRE(res.is_err());
+      REQUIRE(std::distance(tail.begin(), res.unwrap_err()) == 16);
+    }
+
     SECTION("Chunks") {
 
       Path somePath2 = test::dir / "test2.bytes";
@@ -0,0 +1,49 @@
+#include "../testing.t.hpp"
+
+#include "util/midi-file.hpp"
+
+namespace top1 {
+
+  TEST_CASE("MidiFile", "[util]") {
+    // Format 1, two tracks, 96 ticks per quarter note
+    std::vector<uint8_t> data = {
+      'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 1, 0, 2, 0, 96,
+      // Tempo track: 60 bpm from the second quarter note
+      'M', 'T', 'r', 'k', 0, 0, 0, 11,
+      0x60, 0xFF, 0x51, 3, 0x0F, 0x42, 0x40,
+      0x00, 0xFF, 0x2F, 0,
+      // Notes, with running status
+      'M', 'T', 'r', 'k', 0, 0, 0, 19,
+      0x00, 0x90, 60, 100,
+      0x60, 60, 0,
+      0x60, 0xB1, 7, 64,
+      0x81, 0x40, 0xC0, 5,
+      0x00, 0xFF, 0x2F, 0,
+    };
+
+    MidiFile file;
+    file.parse(data);
+    REQUIRE(file.events.size() == 4);
+
+    auto& e = file.events;
+    REQUIRE(e[0].time == 0);
+    REQUIRE(e[0].bytes[0] == 0x90);
+    REQUIRE(e[0].size == 3);
+    // A quarter note at 120 bpm
+    REQUIRE(e[1].time == Approx(0.5));
+    REQUIRE(e[1].bytes[0] == 0x90);
+    REQUIRE(e[1].bytes[2] == 0);
+    // Then at 60 bpm
+    REQUIRE(e[2].time == Approx(1.5));
+    REQUIRE(e[2].bytes[1] == 7);
+    REQUIRE(e[3].time == Approx(3.5));
+    REQUIRE(e[3].size == 2);
+    REQUIRE(file.length() == Approx(3.5));
+
+    SECTION("Invalid files throw") {
+      REQUIRE_THROWS(file.parse({'R', 'I', 'F', 'F'}));
+      data.resize(30);
+      REQUIRE_THROWS(file.parse(data));
+    }
+  }
+}
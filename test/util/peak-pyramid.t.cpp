@@ -0,0 +1,79 @@
+#include "../testing.t.hpp"
+
+#include "util/peak-pyramid.hpp"
+
+namespace top1::audio {
+
+  using Pyramid = PeakPyramid<2>;
+  using Peak = Pyramid::Peak;
+
+  TEST_CASE("PeakPyramid", "[PeakPyramid] [util]") {
+    Pyramid pyramid;
+
+    // A ramp on the left channel, and a single spike on the right
+    int n = 1 << 16;
+    std::vector<Pyramid::Frame> frames(n);
+    for (int i = 0; i < n; i++) {
+      frames[i][0] = -1 + 2.f * i / n;
+    }
+    frames[1000][1] = 0.5f;
+    pyramid.update(0, frames.data(), n);
+
+    SECTION("Each part covers its own frames") {
+      // At several zooms, down to one frame per part
+      for (int parts : {1, 4, 64, 1024, n}) {
+        std::vector<Peak> out(parts);
+        pyramid.query(0, {0, n}, out);
+        REQUIRE(out.front().min == -127);
+        REQUIRE(out.back().max >= Pyramid::quantize(1 - 2.f * Pyramid::BaseRatio / n));
+        for (int i = 1; i < parts; i++) {
+          REQUIRE(out[i].min >= out[i - 1].min);
+        }
+      }
+    }
+
+    SECTION("Short peaks are not lost when zoomed out") {
+      std::vector<Peak> out(16);
+      pyramid.query(1, {0, n}, out);
+      REQUIRE(out[0].max == Pyramid::quantize(0.5f));
+      for (int i = 1; i < 16; i++) {
+        REQUIRE(out[i].max == 0);
+      }
+    }
+
+    SECTION("Outside the audio is silent") {
+      std::vector<Peak> out(4);
+      pyramid.query(0, {-4 * n, 0}, out);
+      for (auto p : out) {
+        REQUIRE(p.min == 0);
+        REQUIRE(p.max == 0);
+      }
+      pyramid.query(0, {n, 2 * n}, out);
+      REQUIRE(out[0].max == 0);
+    }
+
+    SECTION("Updates and truncation") {
+      std::vector<Pyramid::Frame> loud(Pyramid::BaseRatio, Pyramid::Frame(1.f));
+      pyramid.update(n - Pyramid::BaseRatio, loud.data(), loud.size());
+      std::vector<Peak> out(1);
+      pyramid.query(0, {n / 2, n}, out);
+      REQUIRE(out[0].max == 127);
+
+      pyramid.truncate(n / 2);
+      pyramid.query(0, {n / 2, n}, out);
+      REQUIRE(out[0].max == 0);
+    }
+
+    SECTION("The base level is enough to restore the rest") {
+      Pyramid copy;
+      copy.setBaseLevel(pyramid.baseLevel());
+      std::vector<Peak> a(10), b(10);
+      pyramid.query(0, {0, n}, a);
+      copy.query(0, {0, n}, b);
+      for (int i = 0; i < 10; i++) {
+        REQUIRE(a[i].min == b[i].min);
+        REQUIRE(a[i].max == b[i].max);
+      }
+    }
+  }
+}
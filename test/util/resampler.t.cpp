@@ -0,0 +1,154 @@
+#include "testing.t.hpp"
+
+#include <vector>
+
+#include "util/resampler.hpp"
+
+using namespace top1;
+using Resampler = audio::Resampler<4, float>;
+using Frame = Resampler::Frame;
+using Interpolation = Resampler::Interpolation;
+
+static const Interpolation interpolations[] = {
+  Interpolation::Linear,
+  Interpolation::Cubic,
+  Interpolation::Sinc
+};
+
+SCENARIO("Resamplers read the input at the given speed", "[Resampler]") {
+
+  std::vector<Frame> work(1024);
+  std::vector<Frame> out(64);
+
+  GIVEN("A constant input") {
+    int nRead = 0;
+    auto readConst = [&] (gsl::span<Frame> in) {
+      std::fill(in.begin(), in.end(), Frame(0.5f));
+      nRead += in.size();
+    };
+
+    WHEN("it is resampled at different speeds") {
+      THEN("the output is constant after the first period, "
+           "and the input is consumed at the given speed") {
+        for (auto interpolation : interpolations) {
+          for (float speed : {0.5f, 1.f, 1.7f, 5.f}) {
+            CAPTURE((int) interpolation);
+            CAPTURE(speed);
+            Resampler resampler;
+            resampler.interpolation = interpolation;
+            nRead = 0;
+
+            for (int i = 0; i < 4; i++) {
+              resampler.process(out, speed, work, readConst);
+            }
+
+            for (auto& f : out) {
+              REQUIRE(f[0] == Approx(0.5f).margin(1e-4));
+              REQUIRE(f[1] == Approx(0.f).margin(1e-4));
+            }
+            int expected = 4 * out.size() * speed;
+            REQUIRE(nRead >= expected);
+            REQUIRE(nRead <= expected + Resampler::Lookahead + 2);
+          }
+        }
+      }
+    }
+  }
+
+  GIVEN("A ramp") {
+    int nRead = 0;
+    auto readRamp = [&] (gsl::span<Frame> in) {
+      for (auto& f : in) {
+        for (int c = 0; c < 4; c++) f[c] = nRead * (c + 1);
+        nRead++;
+      }
+    };
+
+    WHEN("it is resampled at speed 1") {
+      THEN("the output is the input") {
+        for (auto interpolation : interpolations) {
+          CAPTURE((int) interpolation);
+          Resampler resampler;
+          resampler.interpolation = interpolation;
+          nRead = 0;
+
+          resampler.process(out, 1, work, readRamp);
+          resampler.process(out, 1, work, readRamp);
+
+          for (int i = 0; i < (int) out.size(); i++) {
+            int t = out.size() + i;
+            REQUIRE(out[i][0] == Approx(t).margin(1e-3));
+            REQUIRE(out[i][3] == Approx(4 * t).margin(1e-3));
+          }
+        }
+      }
+    }
+  }
+
+  GIVEN("A ramp, started in the middle") {
+    // The input position of each frame is its value, so what is heard is
+    // known exactly. Linear and cubic interpolation reproduce a ramp.
+    const int start = 1000;
+    int nRead = start;
+    auto readRamp = [&] (gsl::span<Frame> in) {
+      for (auto& f : in) {
+        f = Frame(float(nRead++));
+      }
+    };
+
+    WHEN("it is resampled at varying speeds") {
+      THEN("the output follows the input position, and the input is "
+           "read exactly ahead() frames past what is heard") {
+        for (auto interpolation : {Interpolation::Linear, Interpolation::Cubic}) {
+          CAPTURE((int) interpolation);
+          Resampler resampler;
+          resampler.interpolation = interpolation;
+          nRead = start - Resampler::History;
+          resampler.reset(work, readRamp);
+          REQUIRE(nRead == start);
+
+          double heard = start;
+          for (float speed : {0.5f, 1.3f, 2.f, 0.75f, 4.9f}) {
+            CAPTURE(speed);
+            resampler.process(out, speed, work, readRamp);
+            for (int i = 0; i < (int) out.size(); i++) {
+              REQUIRE(out[i][0] == Approx(heard + i * speed).margin(1e-2));
+            }
+            heard += out.size() * double(speed);
+            REQUIRE(nRead - resampler.ahead() == int(heard));
+          }
+        }
+      }
+    }
+  }
+
+  GIVEN("A sine, started in the middle") {
+    const float freq = 0.01f;
+    auto sine = [&] (double t) { return float(std::sin(2 * M_PI * freq * t)); };
+    int nRead = 0;
+    auto readSine = [&] (gsl::span<Frame> in) {
+      for (auto& f : in) {
+        f = Frame(sine(nRead++));
+      }
+    };
+
+    WHEN("it is resampled with the sinc interpolation") {
+      THEN("there is no dropout at the start") {
+        Resampler resampler;
+        resampler.interpolation = Interpolation::Sinc;
+        nRead = 500 - Resampler::History;
+        resampler.reset(work, readSine);
+
+        double heard = 500;
+        for (float speed : {0.7f, 1.9f}) {
+          CAPTURE(speed);
+          resampler.process(out, speed, work, readSine);
+          for (int i = 0; i < (int) out.size(); i++) {
+            REQUIRE(out[i][0] == Approx(sine(heard + i * speed)).margin(2e-2));
+          }
+          heard += out.size() * double(speed);
+        }
+      }
+    }
+  }
+}
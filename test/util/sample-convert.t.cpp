@@ -0,0 +1,169 @@
+#include "testing.t.hpp"
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#include "util/sample-convert.hpp"
+
+namespace top1::audio {
+
+  TEST_CASE("Integer samples convert to float", "[util] [sample-convert]") {
+    // Odd sizes, to cover both the vector and the scalar paths
+    constexpr int n = 19;
+
+    SECTION("16 bit") {
+      std::array<std::int16_t, n> in;
+      for (int i = 0; i < n; i++) in[i] = (i - 9) * 3641;
+      in[0] = std::numeric_limits<std::int16_t>::min();
+      in[n - 1] = std::numeric_limits<std::int16_t>::max();
+
+      std::array<float, n> floats;
+      int16_to_float(in.data(), floats.data(), n);
+      REQUIRE(floats[0] == -1.f);
+      REQUIRE(floats[9] == 0.f);
+      REQUIRE(floats[n - 1] == Approx(1).epsilon(1e-4));
+
+      std::array<std::int16_t, n> out;
+      float_to_int16(floats.data(), out.data(), n);
+      REQUIRE(out == in);
+    }
+
+    SECTION("32 bit") {
+      std::array<std::int32_t, n> in;
+      for (int i = 0; i < n; i++) in[i] = (i - 9) * 238609294;
+      in[0] = std::numeric_limits<std::int32_t>::min();
+
+      std::array<float, n> floats;
+      int32_to_float(in.data(), floats.data(), n);
+      REQUIRE(floats[0] == -1.f);
+      REQUIRE(floats[9] == 0.f);
+
+      std::array<std::int32_t, n> out;
+      float_to_int32(floats.data(), out.data(), n);
+      for (int i = 0; i < n - 1; i++) {
+        // A float holds 24 bits, so it is within half a step of 2^7 of the
+        // int at this size, and converts back exactly
+        REQUIRE(std::abs(double(out[i]) - in[i]) <= 64);
+        REQUIRE(out[i] == std::int64_t(double(floats[i]) * 2147483648.0));
+      }
+      // Rounds up to 2^31, which is clamped to the largest float below it
+      REQUIRE(out[n - 1] == 2147483520);
+    }
+
+    SECTION("Every size rounds to nearest") {
+      // Odd sizes, to cover both the vector and the scalar paths
+      std::array<float, n> in;
+      std::array<int, n> steps;
+      for (int i = 0; i < n; i++) {
+        float x = (i - 9) * 0.3f;
+        in[i] = x;
+        steps[i] = std::lround(x);
+      }
+
+      std::array<float, n> scaled;
+      std::array<std::int16_t, n> out16;
+      for (int i = 0; i < n; i++) scaled[i] = in[i] / 32768;
+      float_to_int16(scaled.data(), out16.data(), n);
+      std::array<std::int32_t, n> out32;
+      for (int i = 0; i < n; i++) scaled[i] = in[i] / 2147483648.f;
+      float_to_int32(scaled.data(), out32.data(), n);
+      std::array<std::int32_t, n> out24;
+      for (int i = 0; i < n; i++) scaled[i] = in[i] / 8388608;
+      float_to_int24(scaled.data(), out24.data(), n);
+
+      for (int i = 0; i < n; i++) {
+        REQUIRE(out16[i] == steps[i]);
+        REQUIRE(out32[i] == steps[i]);
+        REQUIRE(out24[i] == steps[i] * 256);
+      }
+    }
+
+    SECTION("Every size rounds ties to even") {
+      std::array<float, n> in;
+      std::array<int, n> steps;
+      for (int i = 0; i < n; i++) {
+        float x = i - 9.5f;
+        in[i] = x;
+        steps[i] = 2 * std::lround(x / 2);
+      }
+
+      std::array<float, n> scaled;
+      std::array<std::int16_t, n> out16;
+      for (int i = 0; i < n; i++) scaled[i] = in[i] / 32768;
+      float_to_int16(scaled.data(), out16.data(), n);
+      std::array<std::int32_t, n> out32;
+      for (int i = 0; i < n; i++) scaled[i] = in[i] / 2147483648.f;
+      float_to_int32(scaled.data(), out32.data(), n);
+      std::array<std::int32_t, n> out24;
+      for (int i = 0; i < n; i++) scaled[i] = in[i] / 8388608;
+      float_to_int24(scaled.data(), out24.data(), n);
+
+      for (int i = 0; i < n; i++) {
+        REQUIRE(out16[i] == steps[i]);
+        REQUIRE(out32[i] == steps[i]);
+        REQUIRE(out24[i] == steps[i] * 256);
+      }
+    }
+
+    SECTION("Clipping") {
+      std::array<float, 9> in = {2, -2, 1, -1, 1e10, -1e10, 0.5, -0.5, 0};
+      std::array<std::int16_t, 9> out16;
+      float_to_int16(in.data(), out16.data(), 9);
+      REQUIRE(out16 == (std::array<std::int16_t, 9>{
+            32767, -32768, 32767, -32768, 32767, -32768, 16384, -16384, 0}));
+
+      std::array<std::int32_t, 9> out32;
+      float_to_int32(in.data(), out32.data(), 9);
+      REQUIRE(out32[0] > 2147483000);
+      REQUIRE(out32[1] == std::numeric_limits<std::int32_t>::min());
+      REQUIRE(out32[4] > 2147483000);
+      REQUIRE(out32[8] == 0);
+
+      std::array<std::int32_t, 9> out24;
+      float_to_int24(in.data(), out24.data(), 9);
+      REQUIRE(out24 == (std::array<std::int32_t, 9>{
+            0x7FFFFF00, std::numeric_limits<std::int32_t>::min(),
+            0x7FFFFF00, std::numeric_limits<std::int32_t>::min(),
+            0x7FFFFF00, std::numeric_limits<std::int32_t>::min(),
+            0x40000000, -0x40000000, 0}));
+    }
+  }
+
+  TEST_CASE("24 bit samples and byte order", "[util] [sample-convert]") {
+    std::array<std::uint8_t, 6> le = {0x56, 0x34, 0x12, 0x00, 0x00, 0x80};
+    std::array<std::uint8_t, 6> be = {0x12, 0x34, 0x56, 0x80, 0x00, 0x00};
+    std::array<std::int32_t, 2> ints;
+
+    unpack_int24(reinterpret_cast<std::byte*>(le.data()), ints.data(), 2, false);
+    REQUIRE(ints[0] == 0x12345600);
+    REQUIRE(ints[1] == std::numeric_limits<std::int32_t>::min());
+
+    unpack_int24(reinterpret_cast<std::byte*>(be.data()), ints.data(), 2, true);
+    REQUIRE(ints[0] == 0x12345600);
+    REQUIRE(ints[1] == std::numeric_limits<std::int32_t>::min());
+
+    std::array<std::uint8_t, 6> packed;
+    pack_int24(ints.data(), reinterpret_cast<std::byte*>(packed.data()), 2, true);
+    REQUIRE(packed == be);
+    pack_int24(ints.data(), reinterpret_cast<std::byte*>(packed.data()), 2, false);
+    REQUIRE(packed == le);
+
+    // The low byte is rounded away
+    ints = {0x12345680, 0x7FFFFFFF};
+    pack_int24(ints.data(), reinterpret_cast<std::byte*>(packed.data()), 2, true);
+    REQUIRE((packed == std::array<std::uint8_t, 6>{0x12, 0x34, 0x57, 0x7F, 0xFF, 0xFF}));
+    ints = {0x1234567F, -0x17F};
+    pack_int24(ints.data(), reinterpret_cast<std::byte*>(packed.data()), 2, true);
+    REQUIRE((packed == std::array<std::uint8_t, 6>{0x12, 0x34, 0x56, 0xFF, 0xFF, 0xFF}));
+
+    std::int16_t s = 0x1234;
+    swap_bytes(&s, 1);
+    REQUIRE(s == 0x3412);
+    std::int32_t l = 0x12345678;
+    swap_bytes(&l, 1);
+    REQUIRE(l == 0x78563412);
+  }
+
+} // top1::audio
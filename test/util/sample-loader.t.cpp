@@ -0,0 +1,123 @@
+#include "../testing.t.hpp"
+
+#include <cmath>
+#include <vector>
+
+#include "util/sample-loader.hpp"
+#include "util/soundfile.hpp"
+#include "modules/sample-playback.hpp"
+
+namespace top1 {
+
+  static float sine(float freq, int samplerate, int i) {
+    return std::sin(2 * M_PI * freq * i / samplerate);
+  }
+
+  TEST_CASE("Samples are mixed down to mono", "[SampleLoader] [util]") {
+    std::vector<float> stereo = {1, 0, 0.5, 0.5, -1, 1, 0.25, 0.75};
+    std::vector<float> mono(4);
+    audio::downmix(stereo.data(), mono.data(), 4, 2);
+    REQUIRE((mono == std::vector<float>{0.5, 0.5, 0, 0.5}));
+
+    SECTION("In place") {
+      audio::downmix(stereo.data(), stereo.data(), 4, 2);
+      REQUIRE(std::vector<float>(stereo.begin(), stereo.begin() + 4) == mono);
+    }
+  }
+
+  TEST_CASE("Samples are converted to the samplerate of the audio system",
+            "[SampleLoader] [util]") {
+    for (int from : {22050, 44100, 48000, 96000}) {
+      CAPTURE(from);
+      const int to = 48000;
+      std::vector<float> in(from / 10);
+      for (int i = 0; i < int(in.size()); i++) in[i] = sine(440, from, i);
+
+      auto out = audio::convert_samplerate(in, from, to);
+      REQUIRE(out.size() == std::size_t(std::ceil(in.size() * double(to) / from)));
+
+      // Away from the edges, the 440 Hz sine is reproduced at the new rate
+      float maxError = 0;
+      for (int i = 100; i < int(out.size()) - 100; i++) {
+        maxError = std::max(maxError, std::abs(out[i] - sine(440, to, i)));
+      }
+      REQUIRE(maxError < 0.01);
+    }
+  }
+
+  TEST_CASE("Sound files are loaded as mono at the given samplerate",
+            "[SampleLoader] [util]") {
+    fs::path path = test::dir / "sample-loader.wav";
+    fs::remove(path);
+    const int frames = 4410;
+    {
+      SoundFile file;
+      file.info.channels = 2;
+      file.info.samplerate = 44100;
+      file.open(path);
+      std::vector<float> audio;
+      for (int i = 0; i < frames; i++) {
+        audio.push_back(sine(1000, 44100, i));
+        audio.push_back(0.5);
+      }
+      file.write_samples(audio.data(), audio.size());
+      file.close();
+    }
+
+    SECTION("At the samplerate of the file") {
+      auto mono = audio::load_mono(path, 44100, 1 << 20);
+      REQUIRE(mono.size() == frames);
+      for (int i = 0; i < frames; i++) {
+        REQUIRE(mono[i] == Approx((sine(1000, 44100, i) + 0.5) / 2).margin(1e-6));
+      }
+    }
+
+    SECTION("Converted to another samplerate") {
+      auto mono = audio::load_mono(path, 48000, 1 << 20);
+      REQUIRE(mono.size() == 4800);
+    }
+
+    SECTION("Cut to the maximum length") {
+      auto mono = audio::load_mono(path, 48000, 1000);
+      REQUIRE(mono.size() == 1000);
+      REQUIRE(mono[500] == Approx((sine(1000, 48000, 500) + 0.5) / 2).margin(0.01));
+    }
+    fs::remove(path);
+  }
+
+  TEST_CASE("Samples are played back by the samplers", "[SampleLoader] [util]") {
+    std::vector<float> sample = {1, 2, 3, 4, 5};
+
+    SECTION("Forwards at unity speed, stopping at the end") {
+      std::vector<float> out(4);
+      float p = modules::play_sample(out, sample, 2, 1, true, false);
+      REQUIRE((out == std::vector<float>{3, 4, 5, 0}));
+      REQUIRE(p == -1);
+    }
+
+    SECTION("Forwards at unity speed, looping") {
+      std::vector<float> out(7);
+      float p = modules::play_sample(out, sample, 3, 1, true, true);
+      REQUIRE((out == std::vector<float>{4, 5, 1, 2, 3, 4, 5}));
+      REQUIRE(p == 0);
+    }
+
+    SECTION("Backwards at unity speed") {
+      std::vector<float> out(4);
+      float p = modules::play_sample(out, sample, 4, 1, false, false);
+      REQUIRE((out == std::vector<float>{5, 4, 3, 2}));
+      REQUIRE(p == 0);
+      p = modules::play_sample(out, sample, p, 1, false, true);
+      REQUIRE((out == std::vector<float>{6, 9, 7, 5}));
+      REQUIRE(p == 1);
+    }
+
+    SECTION("At other speeds") {
+      std::vector<float> out(3);
+      float p = modules::play_sample(out, sample, 0, 1.5, true, false);
+      REQUIRE((out == std::vector<float>{1, 2, 4}));
+      REQUIRE(p == 4.5);
+    }
+  }
+
+}
@@ -0,0 +1,78 @@
+#include "../testing.t.hpp"
+
+#include <thread>
+#include <vector>
+
+#include "util/sample-pool.hpp"
+
+namespace top1 {
+
+  using audio::SamplePool;
+
+  TEST_CASE("Samples are shared through the pool", "[SamplePool] [util]") {
+    auto a = test::writeSample("pool-a.wav", 1000);
+    auto b = test::writeSample("pool-b.wav", 2000);
+    const std::size_t max = 1 << 20;
+
+    SECTION("Each file is loaded once") {
+      SamplePool pool (1 << 20);
+      auto s1 = pool.get(a, 44100, max);
+      auto s2 = pool.get(a, 44100, max);
+      REQUIRE(s1 == s2);
+      REQUIRE(s1->frames.size() == 1000);
+      REQUIRE(s1->samplerate == 44100);
+      REQUIRE(pool.size() == 1000 * sizeof(float));
+
+      auto s3 = pool.get(a, 48000, max);
+      REQUIRE(s3 != s1);
+      REQUIRE(s3->samplerate == 48000);
+    }
+
+    SECTION("Concurrent loads of the same file wait for each other") {
+      SamplePool pool (1 << 20);
+      std::vector<SamplePool::Handle> got(8);
+      std::vector<std::thread> threads;
+      for (int i = 0; i < 8; i++) {
+        threads.emplace_back([&, i] { got[i] = pool.get(b, 44100, max); });
+      }
+      for (auto&& t : threads) t.join();
+      for (auto&& s : got) {
+        REQUIRE(s == got[0]);
+      }
+      REQUIRE(pool.size() == 2000 * sizeof(float));
+    }
+
+    SECTION("Unused samples are dropped over the budget, oldest first") {
+      SamplePool pool (3000 * sizeof(float));
+      pool.get(a, 44100, max);
+      pool.get(b, 44100, max);
+      pool.get(a, 44100, max);
+      REQUIRE(pool.size() == 3000 * sizeof(float));
+      // Going over the budget drops b, the least recently used
+      pool.get(a, 44100, 500);
+      REQUIRE(pool.size() == 1500 * sizeof(float));
+
+      pool.setBudget(0);
+      REQUIRE(pool.size() == 0);
+    }
+
+    SECTION("Samples in use are kept") {
+      SamplePool pool (0);
+      auto held = pool.get(a, 44100, max);
+      pool.get(b, 44100, max);
+      // b is dropped on the next call
+      REQUIRE(pool.get(a, 44100, max) == held);
+      REQUIRE(pool.size() == 1000 * sizeof(float));
+
+      pool.clear();
+      REQUIRE(pool.size() == 1000 * sizeof(float));
+      held = nullptr;
+      pool.clear();
+      REQUIRE(pool.size() == 0);
+    }
+
+    fs::remove(a);
+    fs::remove(b);
+  }
+
+}
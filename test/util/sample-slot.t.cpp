@@ -0,0 +1,114 @@
+#include "../testing.t.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <thread>
+
+#include "util/sample-slot.hpp"
+
+namespace top1 {
+
+  using audio::SampleSlot;
+  using namespace std::chrono_literals;
+
+  static SampleSlot::Handle makeSample(int frames) {
+    auto s = std::make_shared<SampleSlot::Sample>();
+    s->frames.resize(frames, 0.5f);
+    return s;
+  }
+
+  TEST_CASE("Samples are swapped in while the audio thread plays",
+            "[SampleSlot] [util]") {
+    SampleSlot slot;
+    REQUIRE(slot.acquire() == nullptr);
+    slot.release();
+
+    auto first = makeSample(10);
+    slot.swap(first);
+    REQUIRE(slot.acquire() == first.get());
+    slot.release();
+    REQUIRE(slot.current() == first);
+
+    SECTION("The old sample is dropped once the audio thread lets go") {
+      std::weak_ptr<const SampleSlot::Sample> old = first;
+      first = nullptr;
+
+      const auto* playing = slot.acquire();
+      std::atomic_bool swapped {false};
+      std::thread loader ([&] {
+          slot.swap(makeSample(20));
+          swapped = true;
+        });
+
+      std::this_thread::sleep_for(20ms);
+      REQUIRE_FALSE(swapped);
+      REQUIRE_FALSE(old.expired());
+      REQUIRE(playing->frames.size() == 10);
+
+      slot.release();
+      loader.join();
+      REQUIRE(swapped);
+      REQUIRE(old.expired());
+
+      REQUIRE(slot.acquire()->frames.size() == 20);
+      slot.release();
+    }
+
+    SECTION("The next period plays the new sample") {
+      std::atomic_bool stop {false};
+      std::atomic_int played {0};
+      std::thread audio ([&] {
+          while (!stop) {
+            const auto* s = slot.acquire();
+            if (s) played = s->frames.size();
+            slot.release();
+          }
+        });
+      for (int frames : {30, 40, 50}) {
+        slot.swap(makeSample(frames));
+        while (played != frames) std::this_thread::yield();
+      }
+      stop = true;
+      audio.join();
+    }
+  }
+
+  TEST_CASE("Samples are loaded in the background", "[SampleSlot] [util]") {
+    audio::SamplePool pool (1 << 20);
+    SampleSlot slot;
+    auto a = test::writeSample("slot-a.wav", 1000);
+    auto b = test::writeSample("slot-b.wav", 2000);
+
+    slot.load(pool, a, 44100, 1 << 20);
+    slot.wait();
+    REQUIRE(slot.current()->frames.size() == 1000);
+    unsigned swaps = slot.swapCount();
+
+    SECTION("The last load asked for is swapped in last") {
+      for (int i = 0; i < 20; i++) {
+        slot.load(pool, i % 2 ? a : b, 44100, 1 << 20);
+      }
+      slot.wait();
+      REQUIRE(slot.current()->frames.size() == 1000);
+      REQUIRE(slot.swapCount() > swaps);
+    }
+
+    SECTION("A sample that fails to load keeps the current one") {
+      auto bad = test::dir / "slot-bad.wav";
+      std::ofstream(bad) << "Not a sound file";
+      slot.load(pool, bad, 44100, 1 << 20);
+      slot.wait();
+      REQUIRE(slot.current()->frames.size() == 1000);
+      REQUIRE(slot.swapCount() == swaps);
+    }
+
+    SECTION("An empty path swaps in no sample") {
+      slot.load(pool, {}, 44100, 1 << 20);
+      slot.wait();
+      REQUIRE(slot.current() == nullptr);
+      REQUIRE(slot.swapCount() == swaps + 1);
+    }
+  }
+
+}
@@ -0,0 +1,35 @@
+#include "../testing.t.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "util/semaphore.hpp"
+
+namespace top1 {
+
+  using namespace std::chrono_literals;
+
+  TEST_CASE("Semaphores count posts", "[Semaphore] [util]") {
+    Semaphore sem;
+    REQUIRE_FALSE(sem.try_wait());
+    REQUIRE_FALSE(sem.wait_for(1ms));
+
+    sem.post();
+    sem.post();
+    REQUIRE(sem.try_wait());
+    REQUIRE(sem.wait_for(0ms));
+    REQUIRE_FALSE(sem.try_wait());
+
+    SECTION("A waiting thread is woken by a post") {
+      std::atomic_bool woken {false};
+      std::thread waiter ([&] { woken = sem.wait_for(10s); });
+      std::this_thread::sleep_for(10ms);
+      sem.post();
+      waiter.join();
+      REQUIRE(woken);
+      REQUIRE_FALSE(sem.try_wait());
+    }
+  }
+
+}
@@ -90,4 +90,148 @@ namespace top1 {
     }
 
   }
+  TEST_CASE("Integer PCM and AIFF files", "[SoundFile] [util]") {
+    using Type = SoundFile::Info::Type;
+    using Format = SoundFile::Info::Format;
+
+    std::vector<Sample> audio;
+    std::generate_n(std::back_inserter(audio), 3001,
+      []{return Random::get<float>(-1.0, 1.0);});
+
+    auto roundTrip = [&] (Type type, Format format, float precision) {
+      fs::path path = test::dir / "pcm.snd";
+      fs::remove(path);
+      {
+        SoundFile file;
+        file.info.type = type;
+        file.info.format = format;
+        file.info.samplerate = 48000;
+        file.open(path);
+        file.write_samples(audio.begin(), audio.end());
+        REQUIRE(file.length() == 3001);
+        file.close();
+      }
+      SoundFile file;
+      file.open(path);
+      REQUIRE(file.info.type == type);
+      REQUIRE(file.info.format == format);
+      REQUIRE(file.info.samplerate == 48000);
+      REQUIRE(file.length() == 3001);
+
+      std::vector<Sample> read (3100, 1.f);
+      file.read_samples(read.data(), 3100);
+      for (int i = 0; i < 3001; i++) {
+        REQUIRE(read[i] == Approx(audio[i]).margin(precision));
+      }
+      // Past the end
+      REQUIRE(read[3001] == 0);
+      REQUIRE(read[3099] == 0);
+
+      file.seek(1000);
+      Sample s;
+      file.read_samples(&s, 1);
+      REQUIRE(s == Approx(audio[1000]).margin(precision));
+    };
+
+    SECTION("16 bit wave") {
+      roundTrip(Type::WAVE, Format::Int16, 1.0 / 32768);
+    }
+    SECTION("24 bit wave") {
+      roundTrip(Type::WAVE, Format::Int24, 1.0 / (1 << 23));
+    }
+    SECTION("32 bit wave") {
+      roundTrip(Type::WAVE, Format::Int32, 1e-7);
+    }
+    SECTION("16 bit AIFF") {
+      roundTrip(Type::AIFF, Format::Int16, 1.0 / 32768);
+    }
+    SECTION("24 bit AIFF") {
+      roundTrip(Type::AIFF, Format::Int24, 1.0 / (1 << 23));
+    }
+
+    SECTION("The AIFF header is big-endian") {
+      fs::path path = test::dir / "header.aiff";
+      fs::remove(path);
+      {
+        SoundFile file;
+        file.info.type = Type::AIFF;
+        file.info.format = Format::Int16;
+        file.info.samplerate = 44100;
+        file.open(path);
+        std::vector<Sample> two = {0.5, -0.5};
+        file.write_samples(two.begin(), two.end());
+        file.close();
+      }
+      ByteFile raw;
+      raw.bigEndianChunks = true;
+      raw.open(path);
+      std::vector<unsigned char> data (raw.size());
+      raw.read_at(0, reinterpret_cast<std::byte*>(data.data()), data.size());
+      std::vector<unsigned char> expected = {
+        'F', 'O', 'R', 'M', 0, 0, 0, 50, 'A', 'I', 'F', 'F',
+        'C', 'O', 'M', 'M', 0, 0, 0, 18,
+        0, 1,                 // channels
+        0, 0, 0, 2,           // frames
+        0, 16,                // bits
+        0x40, 0x0E, 0xAC, 0x44, 0, 0, 0, 0, 0, 0, // 44100 as an extended
+        'S', 'S', 'N', 'D', 0, 0, 0, 12,
+        0, 0, 0, 0, 0, 0, 0, 0,
+        0x40, 0x00, 0xC0, 0x00,
+      };
+      REQUIRE(data == expected);
+    }
+  }
+
+  /// A sound file with a chunk of `extra` bytes before the audio data
+  struct PaddedSoundFile : SoundFile {
+    int extra = 0;
+
+    struct Padding : Chunk {
+      int n;
+      Padding(int n) : Chunk("PADD"), n (n) {}
+      void write_fields(ByteFile& file) override {
+        std::vector<std::byte> zeros (n);
+        file.write_bytes(zeros.begin(), zeros.end());
+      }
+    };
+
+    void add_custom_chunks(std::vector<std::unique_ptr<Chunk>>& v) override {
+      v.push_back(std::make_unique<Padding>(extra));
+    }
+  };
+
+  TEST_CASE("Chunks before the audio data can change size",
+            "[SoundFile] [util]") {
+    fs::path path = test::dir / "padded.wav";
+    fs::remove(path);
+
+    std::vector<Sample> audio;
+    std::generate_n(std::back_inserter(audio), 5000,
+      []{return Random::get<float>(-1.0, 1.0);});
+    {
+      PaddedSoundFile file;
+      file.extra = 20;
+      file.open(path);
+      file.write_samples(audio.begin(), audio.end());
+      file.close();
+    }
+
+    // Shrinking by less than a chunk header, and by more
+    for (int extra : {16, 14, 2, 1}) {
+      CAPTURE(extra);
+      {
+        PaddedSoundFile file;
+        file.extra = extra;
+        file.open(path);
+        REQUIRE_NOTHROW(file.close());
+      }
+      SoundFile file;
+      file.open(path);
+      REQUIRE(file.length() == 5000);
+      std::vector<Sample> read (5000);
+      file.read_samples(read.data(), read.size());
+      REQUIRE(read == audio);
+    }
+  }
+
 }
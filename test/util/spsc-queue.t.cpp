@@ -0,0 +1,61 @@
+#include "testing.t.hpp"
+
+#include <thread>
+#include <numeric>
+
+#include "util/spsc-queue.hpp"
+
+SCENARIO("SPSCQueues pass elements in order", "[SPSCQueue]") {
+
+  GIVEN("An empty queue with capacity 8") {
+    top1::SPSCQueue<int, 8> q;
+
+    THEN("nothing can be popped") {
+      REQUIRE(q.empty());
+      REQUIRE_FALSE(q.pop().has_value());
+    }
+
+    WHEN("it is filled") {
+      for (int i = 0; i < 8; i++) {
+        REQUIRE(q.push(i));
+      }
+
+      THEN("no more elements can be pushed") {
+        REQUIRE(q.size() == 8);
+        REQUIRE_FALSE(q.push(8));
+      }
+
+      THEN("the elements are popped in order") {
+        for (int i = 0; i < 8; i++) {
+          REQUIRE(q.peek() == i);
+          REQUIRE(q.pop() == i);
+        }
+        REQUIRE(q.empty());
+      }
+    }
+  }
+
+  GIVEN("A producer and a consumer thread") {
+    top1::SPSCQueue<int, 64> q;
+    const int n = 100000;
+
+    WHEN("the producer pushes more elements than the capacity") {
+      std::thread producer ([&] {
+          for (int i = 0; i < n;) {
+            if (q.push(i)) i++;
+          }
+        });
+      std::vector<int> received;
+      while ((int) received.size() < n) {
+        if (auto el = q.pop()) received.push_back(*el);
+      }
+      producer.join();
+
+      THEN("the consumer receives all of them, in order") {
+        std::vector<int> expected(n);
+        std::iota(expected.begin(), expected.end(), 0);
+        REQUIRE(received == expected);
+      }
+    }
+  }
+}
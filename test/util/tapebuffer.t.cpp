@@ -0,0 +1,441 @@
+#include "../testing.t.hpp"
+
+#include <utility>
+#include <vector>
+
+#include "util/tapebuffer.hpp"
+#include "util/tapefile.hpp"
+
+namespace top1 {
+
+  TEST_CASE("Tracks are selected in banks of four", "[TapeBuffer] [util]") {
+
+    SECTION("With sixteen tracks, every track can be reached") {
+      const uint n = 16;
+      Track track = Track::makeIdx(0);
+      for (uint bank = 0; bank < 4; bank++) {
+        track = track.select(bank, true, n);
+        for (uint key = 0; key < Track::BankSize; key++) {
+          track = track.select(key, false, n);
+          REQUIRE(track.idx == bank * 4 + key);
+          REQUIRE(track.bank() == bank);
+        }
+      }
+      // Switching banks keeps the place in the bank
+      track = Track::makeIdx(6).select(3, true, n);
+      REQUIRE(track.idx == 14);
+    }
+
+    SECTION("Keys and knobs without a track do nothing") {
+      const uint n = 6;
+      Track track = Track::makeIdx(5);
+      REQUIRE(track.bank() == 1);
+      REQUIRE(track.select(2, false, n).idx == 5);
+      REQUIRE(track.select(0, false, n).idx == 4);
+      REQUIRE(track.select(0, true, n).idx == 1);
+      REQUIRE(track.select(2, true, n).idx == 5);
+
+      REQUIRE(Track::inBank(1, 1, n)->idx == 5);
+      REQUIRE_FALSE(Track::inBank(1, 2, n));
+      REQUIRE_FALSE(Track::inBank(0, 4, n));
+    }
+
+    SECTION("With fewer than four tracks, the rest of the bank is empty") {
+      const uint n = 2;
+      Track track = Track::makeIdx(0);
+      REQUIRE(track.select(1, false, n).idx == 1);
+      REQUIRE(track.select(3, false, n).idx == 0);
+      REQUIRE(track.select(1, true, n).idx == 0);
+      REQUIRE(Track::inBank(0, 1, n));
+      REQUIRE_FALSE(Track::inBank(0, 2, n));
+    }
+  }
+
+  using TapeSliceSet = TapeBuffer::TapeSliceSet;
+
+  using Slices = std::vector<std::pair<int, int>>;
+
+  /// The slices in `set`, as {in, out} pairs
+  static Slices slicesOf(TapeSliceSet& set) {
+    Slices res;
+    for (auto&& s : set) res.push_back({s.in, s.out});
+    return res;
+  }
+
+  TEST_CASE("Slices are erased", "[TapeSliceSet] [util]") {
+    // Both ends of a slice are part of it
+    TapeSliceSet set;
+    set.addSlice({0, 10});
+    set.addSlice({20, 30});
+    set.addSlice({40, 50});
+    REQUIRE((slicesOf(set) == Slices{{0, 10}, {20, 30}, {40, 50}}));
+
+    SECTION("Disjoint") {
+      set.erase({12, 18});
+      set.erase({51, 60});
+      REQUIRE((slicesOf(set) == Slices{{0, 10}, {20, 30}, {40, 50}}));
+    }
+
+    SECTION("Adjacent") {
+      set.erase({11, 19});
+      REQUIRE((slicesOf(set) == Slices{{0, 10}, {20, 30}, {40, 50}}));
+      set.erase({10, 20});
+      REQUIRE((slicesOf(set) == Slices{{0, 9}, {21, 30}, {40, 50}}));
+    }
+
+    SECTION("Overlapping") {
+      set.erase({5, 25});
+      REQUIRE((slicesOf(set) == Slices{{0, 4}, {26, 30}, {40, 50}}));
+      set.erase({28, 45});
+      REQUIRE((slicesOf(set) == Slices{{0, 4}, {26, 27}, {46, 50}}));
+    }
+
+    SECTION("Contained in a slice") {
+      set.erase({22, 28});
+      REQUIRE((slicesOf(set) == Slices{{0, 10}, {20, 21}, {29, 30}, {40, 50}}));
+    }
+
+    SECTION("Containing slices") {
+      set.erase({15, 55});
+      REQUIRE((slicesOf(set) == Slices{{0, 10}}));
+      set.erase({0, 10});
+      REQUIRE(set.size() == 0);
+    }
+  }
+
+  TEST_CASE("Slices are added", "[TapeSliceSet] [util]") {
+    TapeSliceSet set;
+
+    SECTION("Disjoint slices are kept in order") {
+      set.addSlice({40, 50});
+      set.addSlice({0, 10});
+      set.addSlice({20, 30});
+      REQUIRE((slicesOf(set) == Slices{{0, 10}, {20, 30}, {40, 50}}));
+    }
+
+    SECTION("Adjacent slices are not merged") {
+      set.addSlice({0, 10});
+      set.addSlice({11, 20});
+      REQUIRE((slicesOf(set) == Slices{{0, 10}, {11, 20}}));
+    }
+
+    SECTION("A new slice replaces what it overlaps") {
+      set.addSlice({0, 10});
+      set.addSlice({20, 30});
+      set.addSlice({5, 25});
+      REQUIRE((slicesOf(set) == Slices{{0, 4}, {5, 25}, {26, 30}}));
+    }
+
+    SECTION("A slice inside another splits it") {
+      set.addSlice({0, 30});
+      set.addSlice({10, 20});
+      REQUIRE((slicesOf(set) == Slices{{0, 9}, {10, 20}, {21, 30}}));
+    }
+
+    SECTION("A slice containing others replaces them") {
+      set.addSlice({10, 20});
+      set.addSlice({30, 40});
+      set.addSlice({0, 50});
+      REQUIRE((slicesOf(set) == Slices{{0, 50}}));
+    }
+
+    SECTION("A slice being recorded grows in place") {
+      set.addSlice({100, 110});
+      set.addSlice({100, 120});
+      set.addSlice({100, 130});
+      REQUIRE((slicesOf(set) == Slices{{100, 130}}));
+      // Backwards
+      set.addSlice({90, 130});
+      REQUIRE((slicesOf(set) == Slices{{90, 130}}));
+    }
+
+    SECTION("A growing slice replaces what it runs into") {
+      set.addSlice({0, 10});
+      set.addSlice({15, 20});
+      set.addSlice({0, 17});
+      REQUIRE((slicesOf(set) == Slices{{0, 17}, {18, 20}}));
+    }
+  }
+
+  TEST_CASE("Room for more slices is made ahead of time", "[TapeSliceSet] [util]") {
+    TapeSliceSet set;
+    std::size_t reserved = set.capacity();
+    int n = reserved / 2;
+    for (int i = 0; i < n; i++) set.addSlice({10 * i, 10 * i + 5});
+    REQUIRE(set.makeRoom() == reserved);
+
+    set.addSlice({10 * n, 10 * n + 5});
+    REQUIRE(set.makeRoom() >= 2 * reserved);
+    REQUIRE(set.capacity() == reserved);
+    // Taken by the next change
+    set.addSlice({10 * n + 10, 10 * n + 15});
+    REQUIRE(set.capacity() >= 2 * reserved);
+    REQUIRE(slicesOf(set).size() == std::size_t(n + 2));
+    REQUIRE(slicesOf(set).back().first == 10 * n + 10);
+
+    SECTION("Sets the tracks are copied into get room for them") {
+      TapeSliceSet copy;
+      REQUIRE(copy.makeRoom(set.capacity()) >= set.capacity());
+      copy = set;
+      REQUIRE(copy.capacity() >= set.capacity());
+      REQUIRE(slicesOf(copy) == slicesOf(set));
+    }
+  }
+
+  using AudioFrame = TapeBuffer::AudioFrame;
+  using WriteMode = TapeBuffer::WriteMode;
+
+  /// Frames per period, as the tapedeck reads and writes them
+  constexpr int Period = 256;
+  /// Smaller than the default, so the tests go past its ends quickly
+  constexpr uint RingSize = 1 << 14;
+
+  /// A sample that says where on the tape, and on which track, it is.
+  /// Sums of a few of them are exact
+  static float sampleAt(TapeTime t, uint track) {
+    return (t % 1000 + 1 + 1000 * track) / 65536.f;
+  }
+
+  /// Record from `from` to `to` on `track`, a period at a time like the
+  /// tapedeck, with the samples `f(t)`. The tape is synchronous
+  template<typename F>
+  static void record(TapeBuffer& tb, TapeTime from, TapeTime to, Track track,
+                     WriteMode mode, F&& f) {
+    std::vector<AudioFrame> out(Period);
+    std::vector<float> data(Period);
+    tb.goTo(from);
+    while (tb.position() < to) {
+      tb.syncDisk();
+      TapeTime pos = tb.position();
+      REQUIRE(tb.readFW(out) == Period);
+      for (int i = 0; i < Period; i++) data[i] = f(pos + i);
+      REQUIRE(tb.writeFW(data, track, mode) == 0);
+    }
+  }
+
+  /// Play the frames from `from` to `to`, a period at a time
+  static std::vector<AudioFrame> play(TapeBuffer& tb, TapeTime from, TapeTime to) {
+    std::vector<AudioFrame> frames(to - from);
+    tb.goTo(from);
+    for (int i = 0; i < to - from; i += Period) {
+      tb.syncDisk();
+      int n = std::min(Period, to - from - i);
+      REQUIRE(tb.readFW({frames.data() + i, n}) == n);
+    }
+    return frames;
+  }
+
+  TEST_CASE("Recorded audio is read back", "[TapeBuffer] [util]") {
+    fs::path path = test::dir / "tapebuffer.tape";
+    fs::remove(path);
+
+    // Longer than the ring buffer, so the start is read back from disk
+    const int n = 160 * Period;
+    Track t0 = Track::makeIdx(0);
+    Track t1 = Track::makeIdx(1);
+
+    TapeBuffer tb (RingSize);
+    tb.init(path, true);
+    record(tb, 0, n, t0, WriteMode::Overwrite,
+           [] (TapeTime t) { return sampleAt(t, 0); });
+    record(tb, 0, n, t1, WriteMode::Overdub,
+           [] (TapeTime t) { return sampleAt(t, 1); });
+
+    SECTION("Once") {
+      auto frames = play(tb, 0, n);
+      for (int i = 0; i < n; i++) {
+        REQUIRE(frames[i][0] == sampleAt(i, 0));
+        REQUIRE(frames[i][1] == sampleAt(i, 1));
+        REQUIRE(frames[i][2] == 0);
+      }
+    }
+
+    SECTION("After the tape is closed") {
+      tb.exit();
+      TapeBuffer tb2 (RingSize);
+      tb2.init(path, true);
+      auto frames = play(tb2, 0, n);
+      for (int i = 0; i < n; i++) {
+        REQUIRE(frames[i][0] == sampleAt(i, 0));
+        REQUIRE(frames[i][1] == sampleAt(i, 1));
+      }
+    }
+
+    SECTION("Overdubbing adds, overwriting replaces and erasing silences") {
+      record(tb, 4 * Period, 120 * Period, t1, WriteMode::Overdub,
+             [] (TapeTime t) { return sampleAt(t, 1); });
+      record(tb, 40 * Period, 60 * Period, t1, WriteMode::Overwrite,
+             [] (TapeTime t) { return sampleAt(t, 0); });
+      record(tb, 20 * Period, 80 * Period, t0, WriteMode::Erase,
+             [] (TapeTime) { return 1.f; });
+
+      auto frames = play(tb, 0, n);
+      for (int i = 0; i < n; i++) {
+        bool dubbed = 4 * Period <= i && i < 120 * Period;
+        bool overwritten = 40 * Period <= i && i < 60 * Period;
+        bool erased = 20 * Period <= i && i < 80 * Period;
+        REQUIRE(frames[i][0] == (erased ? 0 : sampleAt(i, 0)));
+        REQUIRE(frames[i][1] == (overwritten ? sampleAt(i, 0)
+                                 : dubbed ? 2 * sampleAt(i, 1)
+                                 : sampleAt(i, 1)));
+      }
+    }
+
+    SECTION("Crossfading goes from the track to the data") {
+      std::vector<AudioFrame> out(Period);
+      std::vector<float> data(Period, 1.f);
+      tb.goTo(10 * Period);
+      tb.syncDisk();
+      REQUIRE(tb.readFW(out) == Period);
+      REQUIRE(tb.writeFW(data, t1, WriteMode::Crossfade, 0, {0, 1}) == 0);
+
+      auto frames = play(tb, 10 * Period, 11 * Period);
+      REQUIRE(frames[0][1] == sampleAt(10 * Period, 1));
+      float half = sampleAt(10 * Period + Period / 2, 1);
+      REQUIRE(frames[Period / 2][1] == Approx(half + (1 - half) * (Period / 2) / float(Period - 1)));
+      REQUIRE(frames[Period - 1][1] == Approx(1));
+      REQUIRE(frames[0][0] == sampleAt(10 * Period, 0));
+    }
+
+    SECTION("Recordings to frames that are not loaded wait for them") {
+      Track t2 = Track::makeIdx(2);
+      std::vector<float> data(Period);
+      for (int i = 0; i < Period; i++) data[i] = sampleAt(i, 2);
+      // Far from what is loaded, and the disk has not caught up yet
+      tb.goTo(100 * Period);
+      REQUIRE(tb.writeFW(data, t2, WriteMode::Overwrite) == 0);
+      tb.syncDisk();
+      tb.flushPendingWrites();
+      REQUIRE(tb.lostFrames == 0);
+
+      auto frames = play(tb, 99 * Period, 100 * Period);
+      for (int i = 0; i < Period; i++) {
+        REQUIRE(frames[i][2] == sampleAt(i, 2));
+        REQUIRE(frames[i][0] == sampleAt(99 * Period + i, 0));
+      }
+    }
+
+    SECTION("Frames taken out of the ring buffer are read as silence") {
+      TapeTime pos = 8 * Period;
+      tb.goTo(pos);
+      tb.syncDisk();
+      auto loaded = tb.buffer.loaded.load();
+      REQUIRE(loaded.in <= pos);
+      REQUIRE(loaded.out >= pos + Period);
+
+      // The disk thread shrinks the loaded frames before it overwrites them
+      tb.buffer.loaded.store({loaded.in, pos + 100});
+      // Not silent, to see that the rest is zeroed
+      std::vector<AudioFrame> out(Period, AudioFrame(1.f));
+      REQUIRE(tb.readFW(out) == 100);
+      REQUIRE(tb.position() == pos + 100);
+      for (int i = 0; i < Period; i++) {
+        REQUIRE(out[i][0] == (i < 100 ? sampleAt(pos + i, 0) : 0));
+      }
+
+      pos = tb.position();
+      tb.buffer.loaded.store({pos - 49, loaded.out});
+      std::fill(out.begin(), out.end(), AudioFrame(1.f));
+      REQUIRE(tb.readBW(out) == 50);
+      REQUIRE(tb.position() == pos - 50);
+      for (int i = 0; i < Period; i++) {
+        REQUIRE(out[i][0] == (i < 50 ? sampleAt(pos - i, 0) : 0));
+      }
+    }
+  }
+
+  TEST_CASE("Cuts are done by the audio thread", "[TapeBuffer] [util]") {
+    fs::path path = test::dir / "tapebuffer-cut.tape";
+    fs::remove(path);
+    Track t0 = Track::makeIdx(0);
+
+    TapeBuffer tb (RingSize);
+    tb.init(path, true);
+    tb.trackSlices[0].addSlice({0, 1000});
+    tb.goTo(500);
+
+    tb.cut(t0);
+    REQUIRE(tb.trackSlices[0].size() == 1);
+    tb.applyPendingCut();
+    REQUIRE(tb.trackSlices[0].size() == 2);
+    REQUIRE(tb.trackSlices[0].current(499).out == 499);
+    REQUIRE(tb.trackSlices[0].current(500).in == 500);
+
+    // Only once
+    tb.applyPendingCut();
+    REQUIRE(tb.trackSlices[0].size() == 2);
+  }
+
+  TEST_CASE("A loop longer than the ring buffer plays from the prefetch",
+            "[TapeBuffer] [util]") {
+    fs::path path = test::dir / "tapebuffer-loop.tape";
+    fs::remove(path);
+    const int n = 1 << 16;
+    {
+      TapeFile tape;
+      tape.open(path);
+      std::vector<AudioFrame> frames(n);
+      for (int i = 0; i < n; i++) {
+        for (uint t = 0; t < nTapeTracks; t++) frames[i][t] = sampleAt(i, t);
+      }
+      tape.seek_frame(0);
+      tape.write_frames(frames.data(), n);
+      tape.close();
+    }
+
+    TapeBuffer tb (RingSize);
+    tb.init(path, true);
+    TapeBuffer::TapeSlice loop = {1000, 50000};
+    REQUIRE(loop.size() > int(RingSize));
+    std::vector<AudioFrame> out(Period);
+
+    SECTION("Forwards") {
+      tb.setLoop(loop);
+      tb.goTo(loop.out - 100);
+      tb.syncDisk();
+      REQUIRE(tb.buffer.loaded.load().in > loop.in);
+
+      // The tapedeck jumps back within the period
+      REQUIRE(tb.readFW({out.data(), 100}) == 100);
+      tb.goTo(loop.in);
+      REQUIRE(tb.readFW({out.data() + 100, Period - 100}) == Period - 100);
+      for (int i = 0; i < Period; i++) {
+        TapeTime t = i < 100 ? loop.out - 100 + i : loop.in + i - 100;
+        REQUIRE(out[i][0] == sampleAt(t, 0));
+      }
+
+      // The disk catches up in the next period
+      TapeTime pos = tb.position();
+      tb.syncDisk();
+      REQUIRE(tb.readFW(out) == Period);
+      for (int i = 0; i < Period; i++) {
+        REQUIRE(out[i][1] == sampleAt(pos + i, 1));
+      }
+    }
+
+    SECTION("Backwards") {
+      tb.setLoop(loop);
+      tb.goTo(loop.in + 100);
+      tb.syncDisk();
+      REQUIRE(tb.buffer.loaded.load().out < loop.out);
+
+      REQUIRE(tb.readBW({out.data(), 100}) == 100);
+      tb.goTo(loop.out);
+      REQUIRE(tb.readBW({out.data() + 100, Period - 100}) == Period - 100);
+      for (int i = 0; i < Period; i++) {
+        TapeTime t = i < 100 ? loop.in + 100 - i : loop.out + 100 - i;
+        REQUIRE(out[i][0] == sampleAt(t, 0));
+      }
+    }
+
+    SECTION("Without the loop, the jump is silent until the disk catches up") {
+      tb.goTo(loop.out - 100);
+      tb.syncDisk();
+      tb.goTo(loop.in);
+      std::fill(out.begin(), out.end(), AudioFrame(1.f));
+      REQUIRE(tb.readFW(out) == 0);
+      for (auto&& frame : out) REQUIRE(frame[0] == 0);
+    }
+  }
+
+}
@@ -15,25 +15,363 @@ namespace top1 {
 
     f.open(somePath);
 
-    REQUIRE(std::all_of(std::begin(f.slices), std::end(f.slices),
-        [] (auto&& slices) {
-          return slices.count == 0;
-        }));
+    for (int t = 0; t < TapeFile::nTracks; t++) {
+      REQUIRE(f.slices(t).empty());
+    }
 
-    std::array<TapeFile::SliceData, 128> testData;
+    // More than the 2048 slices of version 1
+    std::vector<TapeFile::SliceData> testData(3000);
     std::generate(std::begin(testData), std::end(testData),
       [] () -> TapeFile::SliceData {
         return {Random::get<uint32_t>(), Random::get<uint32_t>()};
       });
 
-    std::copy(std::begin(testData), std::end(testData),
-      std::begin(f.slices[0].array));
+    f.slices(0) = testData;
+    f.slices(2) = {{1, 2}};
 
     f.close();
 
     f.open(somePath);
 
-    REQUIRE(std::equal(std::begin(testData), std::end(testData),
-        std::begin(f.slices[0].array)));
+    REQUIRE(f.slices(0) == testData);
+    REQUIRE(f.slices(1).empty());
+    REQUIRE(f.slices(2).size() == 1);
+  }
+
+  TEST_CASE("Slices are kept when the tape grows", "[TapeFile] [util]") {
+    fs::path somePath = test::dir / "test3.tape";
+
+    TapeFile tf;
+    tf.open(somePath);
+    tf.slices(1) = {{10, 20}, {30, 40}};
+    tf.close();
+
+    tf.open(somePath);
+    std::vector<TapeFile::AudioFrame> frames(500, TapeFile::AudioFrame(0.5f));
+    tf.seek_frame(0);
+    tf.write_frames(frames.data(), frames.size());
+    tf.close();
+
+    tf.open(somePath);
+    REQUIRE(tf.length_frames() == 500);
+    REQUIRE(tf.slices(1).size() == 2);
+    REQUIRE(tf.slices(1)[1].out == 40);
+  }
+
+  TEST_CASE("Mapped and unmapped frames", "[TapeFile] [util]") {
+    fs::path somePath = test::dir / "test2.tape";
+    fs::remove(somePath);
+    bool mapped = false;
+    SECTION("Mapped") {
+      mapped = true;
+    }
+    SECTION("Unmapped") {
+      mapped = false;
+    }
+
+    std::vector<TapeFile::AudioFrame> testData(3000);
+    for (auto& frame : testData) {
+      for (int t = 0; t < TapeFile::nTracks; t++) {
+        frame[t] = Random::get(-1.f, 1.f);
+      }
+    }
+
+    TapeFile tf;
+    tf.open(somePath);
+    if (mapped) {
+      tf.map_audio();
+      REQUIRE(tf.is_mapped());
+    }
+    tf.seek_frame(100);
+    tf.write_frames(testData.data(), testData.size());
+    REQUIRE(tf.length_frames() == 3100);
+    tf.unmap_audio();
+    tf.close();
+
+    tf.open(somePath);
+    REQUIRE(tf.length_frames() == 3100);
+    // Read back the other way
+    if (!mapped) tf.map_audio();
+    std::vector<TapeFile::AudioFrame> readData(testData.size() + 10);
+    tf.seek_frame(100);
+    tf.read_frames(readData.data(), readData.size());
+    for (std::size_t i = 0; i < testData.size(); i++) {
+      for (int t = 0; t < TapeFile::nTracks; t++) {
+        REQUIRE(readData[i][t] == testData[i][t]);
+      }
+    }
+    // Past the end is silence
+    REQUIRE(readData.back()[0] == 0);
+  }
+
+  TEST_CASE("Versions", "[TapeFile] [util]") {
+    fs::path somePath = test::dir / "test4.tape";
+
+    auto frames = [] (float value, int n) {
+      return std::vector<TapeFile::AudioFrame>(n, TapeFile::AudioFrame(value));
+    };
+    auto readAt = [] (TapeFile& tf, int pos) {
+      TapeFile::AudioFrame frame;
+      tf.seek_frame(pos);
+      tf.read_frames(&frame, 1);
+      return frame[0];
+    };
+
+    TapeFile tf;
+    tf.open(somePath);
+    auto first = frames(0.25f, 3 * TapeFile::BlockSize);
+    tf.seek_frame(0);
+    tf.write_frames(first.data(), first.size());
+
+    tf.push_version();
+    // Across a block boundary, and past the end
+    auto second = frames(0.5f, 3 * TapeFile::BlockSize);
+    tf.seek_frame(TapeFile::BlockSize + 10);
+    tf.write_frames(second.data(), second.size());
+    REQUIRE(tf.length_frames() == 4 * TapeFile::BlockSize + 10);
+    REQUIRE(readAt(tf, TapeFile::BlockSize + 9) == 0.25f);
+    REQUIRE(readAt(tf, TapeFile::BlockSize + 10) == 0.5f);
+
+    REQUIRE(tf.pop_version());
+    REQUIRE_FALSE(tf.pop_version());
+    REQUIRE(tf.length_frames() == 3 * TapeFile::BlockSize);
+    for (int pos : {0, TapeFile::BlockSize + 10, 3 * TapeFile::BlockSize - 1}) {
+      REQUIRE(readAt(tf, pos) == 0.25f);
+    }
+    REQUIRE(readAt(tf, 3 * TapeFile::BlockSize) == 0);
+
+    // The freed blocks are reused, and the map is kept in the file
+    tf.push_version();
+    tf.seek_frame(0);
+    tf.write_frames(second.data(), 10);
+    tf.drop_oldest_version();
+    REQUIRE(tf.version_count() == 0);
+    tf.close();
+
+    tf.open(somePath);
+    REQUIRE(tf.length_frames() == 3 * TapeFile::BlockSize);
+    REQUIRE(readAt(tf, 9) == 0.5f);
+    REQUIRE(readAt(tf, 10) == 0.25f);
+    REQUIRE(readAt(tf, 2 * TapeFile::BlockSize) == 0.25f);
+  }
+
+  TEST_CASE("The tape is kept in order", "[TapeFile] [util]") {
+    fs::path somePath = test::dir / "test7.tape";
+    fs::path crashPath = test::dir / "test7-crash.tape";
+    fs::remove(somePath);
+    fs::remove(crashPath);
+    constexpr int B = TapeFile::BlockSize;
+
+    auto write = [] (TapeFile& tf, int block, float value) {
+      std::vector<TapeFile::AudioFrame> data(B, TapeFile::AudioFrame(value));
+      tf.seek_frame(block * B);
+      tf.write_frames(data.data(), data.size());
+    };
+    auto readAt = [] (TapeFile& tf, int block) {
+      TapeFile::AudioFrame frame;
+      tf.seek_frame(block * B + 1);
+      tf.read_frames(&frame, 1);
+      return frame[0];
+    };
+
+    struct : TapeFile {
+      uint32_t blockAt(int idx) { return blockMap.at(idx); }
+    } tf;
+    tf.open(somePath);
+    tf.map_audio();
+    for (int i = 0; i < 3; i++) write(tf, i, i + 1);
+    tf.flush();
+    REQUIRE_FALSE(tf.block_map_changed());
+
+    // The saved version gets the copy
+    tf.push_version();
+    write(tf, 1, 0.5f);
+    REQUIRE(tf.blockAt(1) == 1);
+    REQUIRE(tf.pop_version());
+    REQUIRE(readAt(tf, 1) == 2);
+    REQUIRE(tf.blockAt(1) != 1);
+    REQUIRE(tf.block_map_changed());
+
+    // Block 1 is still in the map on disk, so it is not reused yet
+    tf.push_version();
+    write(tf, 0, 0.75f);
+    fs::copy_file(somePath, crashPath);
+    {
+      TapeFile crashed;
+      crashed.open(crashPath);
+      REQUIRE(readAt(crashed, 0) == 0.75f);
+      REQUIRE(readAt(crashed, 1) == 0.5f);
+      REQUIRE(readAt(crashed, 2) == 3);
+    }
+
+    REQUIRE(tf.pop_version());
+    tf.put_in_order();
+    REQUIRE(tf.version_count() == 0);
+    for (int i = 0; i < 3; i++) {
+      REQUIRE(tf.blockAt(i) == uint32_t(i));
+      REQUIRE(readAt(tf, i) == i + 1);
+    }
+    tf.unmap_audio();
+    tf.close();
+
+    // Other programs read the tape
+    SoundFile sf;
+    sf.open(somePath);
+    REQUIRE(sf.length() == 3 * B * TapeFile::nTracks);
+    std::vector<float> samples;
+    sf.read_samples(std::back_inserter(samples), sf.length());
+    for (int i = 0; i < 3; i++) {
+      REQUIRE(samples[(i * B + 10) * TapeFile::nTracks] == i + 1);
+    }
+  }
+
+  TEST_CASE("Tapes with fewer tracks are widened", "[TapeFile] [util]") {
+    fs::path somePath = test::dir / "test8.tape";
+    fs::remove(somePath);
+    constexpr int from = TapeFile::nTracks - 1;
+    int n = 20000;
+    {
+      SoundFile sf;
+      sf.open(somePath);
+      sf.info.channels = from;
+      std::vector<float> samples(n * from);
+      for (std::size_t i = 0; i < samples.size(); i++) samples[i] = i % 100 / 100.f;
+      sf.write_samples(samples.begin(), samples.end());
+      sf.close();
+    }
+
+    for (int pass = 0; pass < 2; pass++) {
+      TapeFile tf;
+      tf.open(somePath);
+      REQUIRE(tf.info.channels == TapeFile::nTracks);
+      REQUIRE(tf.length_frames() == n);
+      std::vector<TapeFile::AudioFrame> frames(n);
+      tf.read_frames(frames.data(), n);
+      for (int i = 0; i < n; i += 997) {
+        for (int t = 0; t < from; t++) {
+          REQUIRE(frames[i][t] == (i * from + t) % 100 / 100.f);
+        }
+        REQUIRE(frames[i][from] == 0);
+      }
+    }
+  }
+
+  TEST_CASE("Tapes with more tracks are refused", "[TapeFile] [util]") {
+    fs::path somePath = test::dir / "test9.tape";
+    fs::remove(somePath);
+    {
+      SoundFile sf;
+      sf.open(somePath);
+      sf.info.channels = TapeFile::nTracks + 1;
+      std::vector<float> samples(1000 * sf.info.channels, 0.5f);
+      sf.write_samples(samples.begin(), samples.end());
+      sf.close();
+    }
+    auto size = fs::file_size(somePath);
+
+    TapeFile tf;
+    REQUIRE_THROWS_AS(tf.open(somePath), const char*);
+    REQUIRE_FALSE(tf.is_open());
+    REQUIRE(fs::file_size(somePath) == size);
+  }
+
+  TEST_CASE("Compressed blocks", "[TapeFile] [util]") {
+    fs::path somePath = test::dir / "test5.tape";
+
+    // A tone on the first track, noise on the last, and silence between
+    int n = 5 * TapeFile::BlockSize + 123;
+    std::vector<TapeFile::AudioFrame> testData(n);
+    for (int i = 0; i < n; i++) {
+      testData[i][0] = 0.5f * std::sin(i * 0.01f);
+      testData[i][TapeFile::nTracks - 1] = Random::get(-1.f, 1.f);
+    }
+    auto readAll = [&] (TapeFile& tf) {
+      std::vector<TapeFile::AudioFrame> data(n);
+      tf.seek_frame(0);
+      tf.read_frames(data.data(), n);
+      return data;
+    };
+    auto same = [&] (const std::vector<TapeFile::AudioFrame>& data) {
+      for (int i = 0; i < n; i++) {
+        for (int t = 0; t < TapeFile::nTracks; t++) {
+          if (data[i][t] != testData[i][t]) return false;
+        }
+      }
+      return true;
+    };
+
+    struct : TapeFile {
+      uint32_t encodedSize(uint32_t block) { return blockBytes.at(block); }
+      uint32_t blockAt(int idx) { return blockMap.at(idx); }
+    } tf;
+    tf.compression = true;
+    tf.open(somePath);
+    tf.map_audio();
+    // Written in small pieces, so blocks are decoded and encoded again
+    for (int i = 0; i < n; i += 1000) {
+      tf.seek_frame(i);
+      tf.write_frames(testData.data() + i, std::min(1000, n - i));
+    }
+    // Nothing is written for a block of silence
+    std::vector<TapeFile::AudioFrame> silence(TapeFile::BlockSize);
+    tf.seek_frame(10 * TapeFile::BlockSize);
+    tf.write_frames(silence.data(), silence.size());
+    REQUIRE(same(readAll(tf)));
+    // Only the encoded bytes are read and written
+    REQUIRE(tf.encodedSize(0) < TapeFile::BlockSize * sizeof(TapeFile::AudioFrame));
+    REQUIRE(tf.encodedSize(tf.blockAt(10)) == 0);
+    tf.unmap_audio();
+    tf.close();
+
+    tf.compression = false;
+    tf.open(somePath);
+    REQUIRE(tf.length_frames() == 11 * TapeFile::BlockSize);
+    REQUIRE(same(readAll(tf)));
+
+    // Writing uncompressed to a compressed block
+    testData[10][1] = 0.75f;
+    tf.seek_frame(10);
+    tf.write_frames(&testData[10], 1);
+    REQUIRE(same(readAll(tf)));
+  }
+
+  TEST_CASE("Peaks", "[TapeFile] [util]") {
+    fs::path somePath = test::dir / "test6.tape";
+    using Peak = TapeFile::PeakPyramid::Peak;
+
+    auto peakAt = [] (TapeFile& tf, int track, int pos) {
+      std::vector<Peak> out(1);
+      tf.peaks().query(track, {pos, pos + 1}, out);
+      return out[0];
+    };
+
+    TapeFile tf;
+    tf.open(somePath);
+    std::vector<TapeFile::AudioFrame> frames(3 * TapeFile::BlockSize);
+    for (auto& frame : frames) frame[1] = 0.5f;
+    tf.seek_frame(0);
+    tf.write_frames(frames.data(), frames.size());
+    REQUIRE(peakAt(tf, 1, 100).max == 64);
+    REQUIRE(peakAt(tf, 0, 100).max == 0);
+
+    // A write that does not line up with the peaks
+    tf.push_version();
+    TapeFile::AudioFrame loud;
+    loud[1] = -1;
+    tf.seek_frame(TapeFile::BlockSize + 1000);
+    tf.write_frames(&loud, 1);
+    REQUIRE(peakAt(tf, 1, TapeFile::BlockSize + 1000).min == -127);
+    REQUIRE(peakAt(tf, 1, TapeFile::BlockSize + 1000).max == 64);
+
+    // Undoing puts the peaks back
+    REQUIRE(tf.pop_version());
+    REQUIRE(peakAt(tf, 1, TapeFile::BlockSize + 1000).min == 0);
+    tf.seek_frame(10);
+    tf.write_frames(&loud, 1);
+    tf.close();
+
+    tf.open(somePath);
+    REQUIRE(peakAt(tf, 1, 10).min == -127);
+    REQUIRE(peakAt(tf, 1, 2 * TapeFile::BlockSize).max == 64);
   }
 }
@@ -1,5 +1,6 @@
 #include "testing.t.hpp"
 
+#include <cstdint>
 #include <thread>
 
 #include "util/timer.hpp"
@@ -34,4 +35,83 @@ namespace top1::timer {
     }
   }
 
+  TEST_CASE("Histogram buckets", "[timer]") {
+    using H = Histogram;
+
+    SECTION("Buckets are contiguous and ordered") {
+      for (int i = 0; i < H::Buckets - 1; i++) {
+        REQUIRE(H::lowerBound(i) < H::lowerBound(i + 1));
+        REQUIRE(H::bucket(H::lowerBound(i)) == i);
+        REQUIRE(H::bucket(H::lowerBound(i + 1) - 1) == i);
+      }
+    }
+
+    SECTION("Values are known to within an eighth") {
+      for (std::uint64_t v : {9ul, 100ul, 12345ul, 987654321ul}) {
+        int b = H::bucket(v);
+        double width = H::lowerBound(b + 1) - H::lowerBound(b);
+        REQUIRE(width / v <= 1.0 / H::SubBuckets);
+      }
+    }
+
+    SECTION("Huge values go in the last bucket") {
+      REQUIRE(H::bucket(~0ul) == H::Buckets - 1);
+    }
+  }
+
+  TEST_CASE("Histogram percentiles", "[timer]") {
+    Histogram h;
+    for (int i = 1; i <= 1000; i++) {
+      h.record(std::chrono::microseconds(i));
+    }
+    h.record(std::chrono::milliseconds(50));
+
+    Histogram::Summary s;
+    s.add(h);
+    REQUIRE(s.total == 1001);
+    REQUIRE(s.max == 50'000'000);
+    using us = std::chrono::microseconds;
+    auto approx = [] (us d) { return Approx(d.count() * 1000).epsilon(0.07); };
+    REQUIRE(s.percentile(0.5).count() == approx(us(501)));
+    REQUIRE(s.percentile(0.99).count() == approx(us(991)));
+    REQUIRE(s.percentile(0.999).count() == approx(us(1000)));
+    REQUIRE(s.percentile(1).count() == 50'000'000);
+  }
+
+  static void timedFunction() {
+    TIME_SCOPE("timedFunction");
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  static void twiceTimedFunction() {
+    TIME_SCOPE("twiceTimedFunction");
+    TIME_SCOPE("twiceTimedFunction::inner");
+  }
+
+  TEST_CASE("TIME_SCOPE", "[timer]") {
+    auto& registry = TimerRegistry::get();
+    auto names = registry.jsonSerialize();
+
+    // Registered before the function ever ran
+    REQUIRE(names.count("timedFunction") == 1);
+    int id = registry.add("timedFunction");
+    auto before = registry.summary(id).total;
+
+    timedFunction();
+    std::thread(timedFunction).join();
+
+    auto s = registry.summary(id);
+    REQUIRE(s.total == before + 2);
+    REQUIRE(s.max >= 1'000'000);
+
+    SECTION("Twice in one scope") {
+      int outer = registry.add("twiceTimedFunction");
+      int inner = registry.add("twiceTimedFunction::inner");
+      REQUIRE(outer != inner);
+      twiceTimedFunction();
+      REQUIRE(registry.summary(outer).total == 1);
+      REQUIRE(registry.summary(inner).total == 1);
+    }
+  }
+
 }
@@ -0,0 +1,74 @@
+#include "testing.t.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#include "util/worker-pool.hpp"
+
+SCENARIO("WorkerPools run every task exactly once", "[WorkerPool]") {
+
+  GIVEN("A pool without workers") {
+    top1::WorkerPool pool;
+
+    THEN("the tasks run in order on the calling thread") {
+      std::vector<int> order;
+      auto id = std::this_thread::get_id();
+      pool.run(4, [&] (int i) {
+          REQUIRE(std::this_thread::get_id() == id);
+          order.push_back(i);
+        });
+      REQUIRE((order == std::vector<int>{0, 1, 2, 3}));
+    }
+  }
+
+  GIVEN("A pool with three workers") {
+    top1::WorkerPool pool (3);
+    REQUIRE(pool.size() == 3);
+
+    THEN("many batches in a row all complete") {
+      std::vector<std::atomic_int> counts (16);
+      for (int batch = 0; batch < 10000; batch++) {
+        int n = 1 + batch % 16;
+        pool.run(n, [&] (int i) { counts[i]++; });
+      }
+      int total = 0;
+      for (auto&& c : counts) total += c;
+      REQUIRE(total == 10000 / 16 * (16 * 17 / 2));
+      for (int i = 0; i < 16; i++) {
+        REQUIRE(counts[i] == 10000 - (10000 / 16) * i);
+      }
+    }
+
+    THEN("the results are visible when run returns") {
+      std::vector<int> out (8);
+      for (int batch = 0; batch < 1000; batch++) {
+        pool.run(8, [&] (int i) { out[i] = batch + i; });
+        for (int i = 0; i < 8; i++) {
+          REQUIRE(out[i] == batch + i);
+        }
+      }
+    }
+
+    THEN("sleeping workers are woken up") {
+      std::atomic_int count {0};
+      pool.run(3, [&] (int) { count++; });
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      pool.run(3, [&] (int) { count++; });
+      REQUIRE(count == 6);
+    }
+  }
+
+  GIVEN("A pool with workers that do not spin") {
+    top1::WorkerPool pool (3);
+    pool.setSpinTime(std::chrono::nanoseconds(0));
+
+    THEN("the workers sleep between batches, and all batches complete") {
+      std::atomic_int count {0};
+      for (int batch = 0; batch < 1000; batch++) {
+        pool.run(4, [&] (int) { count++; });
+      }
+      REQUIRE(count == 4000);
+    }
+  }
+}